@@ -1,5 +1,3 @@
-: ${BOOST_ROOT:?"Please define BOOST_ROOT as the path to your boost directory"}
-
 echo "Generating orders. Please wait..."
 perl sample_data.pl > ../resources/orders.txt
 
@@ -0,0 +1,68 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "include/MappedFile.hpp"
+#include "include/OutputEvents.hpp"
+#include "include/Utils.hpp"
+
+using namespace zeus_core;
+
+// Renders a binary output file written with TradingEngine -o back into the
+// engine's text output format on stdout.
+int main(int argc, char **argv)
+{
+   if (argc != 2)
+   {
+      fprintf(stderr, "Usage: TradingEngineDecoder <binary_output>\n");
+      return -1;
+   }
+
+   int fd = open(argv[1], O_RDONLY);
+   if (fd < 0)
+   {
+      fprintf(stderr, "Unable to open file %s\n", argv[1]);
+      return -1;
+   }
+
+   MappedFile file;
+   if (!file.map(fd))
+   {
+      close(fd);
+      return -1;
+   }
+   close(fd);
+
+   int max_buffer = LOGGERBATCHSIZE;
+   char *buffer = (char *)calloc(max_buffer, sizeof(char));
+   int index = 0;
+
+   const char *position = file.data();
+   const char *end = position + file.size();
+   uint64_t events = 0;
+   while (position + sizeof(EventHeader) <= end)
+   {
+      EventHeader header;
+      memcpy(&header, position, sizeof(header));
+      if (header.length_ < sizeof(EventHeader) || position + header.length_ > end)
+      {
+         fprintf(stderr, "Truncated or corrupt event at offset %lu\n", (unsigned long)(position - file.data()));
+         break;
+      }
+
+      formatOutputEvent(position, header.length_, buffer, index, max_buffer);
+      if (index >= LOGGERBATCHSIZE)
+      {
+         fwrite(buffer, 1, index, stdout);
+         index = 0;
+      }
+      position += header.length_;
+      ++events;
+   }
+   fwrite(buffer, 1, index, stdout);
+   free(buffer);
+
+   fprintf(stderr, "Decoded %lu events.\n", events);
+   return 0;
+}
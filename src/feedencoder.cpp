@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/BinaryFeed.hpp"
+#include "include/FeedErrorStats.hpp"
+
+using namespace zeus_core;
+
+// Converts a text feed into the binary feed format TradingEngine replays
+// without parsing.  Messages are validated here, once, exactly as the text
+// replay would; invalid ones are counted and dropped.
+int main(int argc, char **argv)
+{
+   if (argc != 3)
+   {
+      fprintf(stderr, "Usage: TradingEngineFeedEncoder <text_feed> <binary_feed>\n");
+      return -1;
+   }
+
+   FILE *in = fopen(argv[1], "r");
+   if (in == NULL)
+   {
+      fprintf(stderr, "Unable to open file %s\n", argv[1]);
+      return -1;
+   }
+   FILE *out = fopen(argv[2], "wb");
+   if (out == NULL)
+   {
+      fprintf(stderr, "Unable to create file %s\n", argv[2]);
+      fclose(in);
+      return -1;
+   }
+
+   FeedEncoder encoder(out);
+   bool ok = encoder.begin();
+   char *buffer = NULL;
+   size_t len = 0;
+   while (ok && getline(&buffer, &len, in) != -1)
+   {
+      ok = encoder.encode(buffer, strlen(buffer));
+   }
+   free(buffer);
+   ok = ok && encoder.finish();
+   fclose(in);
+   if (fclose(out) != 0 || !ok)
+   {
+      fprintf(stderr, "Unable to write file %s\n", argv[2]);
+      return -1;
+   }
+
+   FeedErrorStats::printStatistics();
+   fprintf(stderr, "Encoded %lu messages into %lu records.\n", (unsigned long)encoder.header().messages_,
+           (unsigned long)encoder.header().records_);
+   return 0;
+}
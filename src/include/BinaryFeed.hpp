@@ -0,0 +1,274 @@
+#pragma once
+
+#ifndef __BINARYFEED__
+#define __BINARYFEED__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FeedErrorStats.hpp"
+#include "Parser.hpp"
+#include "SymbolDirectory.hpp"
+#include "Utils.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Binary feed records are read in host byte order and must be little-endian."
+#endif
+
+namespace zeus_core
+{
+   static const uint64_t FEEDFILEMAGIC = 0x3144454546535A5AULL;
+   static const uint32_t FEEDFILEVERSION = 3;
+
+   // Binary feed, written by TradingEngineFeedEncoder from the text feed.
+   // A FeedFileHeader is followed by fixed-size records.  Each record is one
+   // message that passed the text parser's validation, so replay applies it
+   // to the book with no parsing or checking.  Symbols are declared by an
+   // eFR_Symbol record before the first record that uses them.
+   enum FeedRecordType
+   {
+      eFR_Add = 'A',
+      eFR_Modify = 'M',
+      eFR_Remove = 'X',
+      eFR_Trade = 'T',
+      eFR_Symbol = 'R'
+   };
+
+#pragma pack(push, 1)
+   // sequence_ is the 1-based number of the source message, so replay can
+   // place book prints where the text feed's message count puts them.
+   // side_ is 'B' or 'S'; trades have no side or order ID.  Prices are in
+   // integer ticks (cents).  flags_ holds an order's OrderFlag bits and
+   // display_quantity_ an iceberg's display quantity.
+   struct FeedRecord
+   {
+      uint8_t type_;
+      uint8_t side_;
+      uint16_t symbol_id_;
+      uint64_t sequence_;
+      uint32_t order_id_;
+      uint32_t quantity_;
+      uint32_t price_;
+      uint32_t display_quantity_;
+      uint8_t flags_;
+      uint8_t reserved_[3];
+   };
+
+   // Names the encoder's symbol_id_ for later records.
+   struct FeedSymbolRecord
+   {
+      uint8_t type_;
+      uint8_t len_;
+      uint16_t symbol_id_;
+      uint64_t sequence_;
+      char name_[SYMBOLLENMAX];
+      uint8_t reserved_[12];
+   };
+
+   // messages_ counts source messages, valid or not.  The counters are the
+   // encoder's parse results; replay credits them to FeedErrorStats so its
+   // statistics read as if the text feed had been parsed.
+   struct FeedFileHeader
+   {
+      uint64_t magic_;
+      uint32_t version_;
+      uint32_t record_size_;
+      uint64_t messages_;
+      uint64_t records_;
+      uint64_t good_;
+      uint64_t corrupt_;
+      uint64_t invalid_quantity_;
+      uint64_t invalid_price_;
+      uint64_t invalid_id_;
+   };
+#pragma pack(pop)
+
+   static_assert(sizeof(FeedRecord) == 32, "FeedRecord layout changed");
+   static_assert(sizeof(FeedSymbolRecord) == sizeof(FeedRecord), "FeedSymbolRecord must fill a FeedRecord");
+   static_assert(MAXPRICE <= 0xFFFFFFFFULL, "Prices must fit a FeedRecord");
+   static_assert(SYMBOLSMAX < 0xFFFF, "Symbol IDs must fit a FeedRecord");
+
+   // True if fd starts with a binary feed header.  Leaves the offset alone.
+   inline bool isBinaryFeed(int fd)
+   {
+      uint64_t magic = 0;
+      return pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) && magic == FEEDFILEMAGIC;
+   }
+
+   // Returns the header of a mapped binary feed, or 0 with a message if it
+   // is not one this build can read.
+   inline const FeedFileHeader *feedFileHeader(const char *data, size_t size)
+   {
+      const FeedFileHeader *header = (const FeedFileHeader *)data;
+      if (size < sizeof(FeedFileHeader) || header->magic_ != FEEDFILEMAGIC)
+      {
+         fprintf(stderr, "Not a binary feed file.\n");
+         return 0;
+      }
+      if (header->version_ != FEEDFILEVERSION || header->record_size_ != sizeof(FeedRecord))
+      {
+         fprintf(stderr, "Unsupported binary feed version %u.\n", header->version_);
+         return 0;
+      }
+      if ((size - sizeof(FeedFileHeader)) / sizeof(FeedRecord) < header->records_)
+      {
+         fprintf(stderr, "Binary feed truncated: %lu of %lu records.\n",
+                 (unsigned long)((size - sizeof(FeedFileHeader)) / sizeof(FeedRecord)), (unsigned long)header->records_);
+         return 0;
+      }
+      return header;
+   }
+
+   inline const FeedRecord *feedRecords(const FeedFileHeader *header)
+   {
+      return (const FeedRecord *)((const char *)header + sizeof(FeedFileHeader));
+   }
+
+   // Adds the encoder's parse results to this thread's FeedErrorStats.
+   inline void creditFeedStats(const FeedFileHeader &header)
+   {
+      FeedErrorStats *stats = FeedErrorStats::instance();
+      stats->add(eFE_GoodMessage, header.good_);
+      stats->add(eFE_CorruptMessage, header.corrupt_);
+      stats->add(eFE_InvalidQuantity, header.invalid_quantity_);
+      stats->add(eFE_InvalidPrice, header.invalid_price_);
+      stats->add(eFE_InvalidID, header.invalid_id_);
+   }
+
+   // Converts text feed messages to binary feed records.  Each message goes
+   // through the same Parser and SymbolDirectory steps as
+   // MarketDataHandler::processMessage(), so the same messages are rejected
+   // and counted in FeedErrorStats; only the valid ones are written.
+   class FeedEncoder
+   {
+   public:
+      FeedEncoder(FILE *out) : out_(out), parser_(), symbols_(), header_(), start_() {}
+
+      // Writes a placeholder header; finish() fills it in.
+      bool begin()
+      {
+         memset(&header_, 0, sizeof(header_));
+         header_.magic_ = FEEDFILEMAGIC;
+         header_.version_ = FEEDFILEVERSION;
+         header_.record_size_ = sizeof(FeedRecord);
+         FeedErrorStats::totals(start_);
+         return fwrite(&header_, sizeof(header_), 1, out_) == 1;
+      }
+
+      bool encode(const char *line, size_t len)
+      {
+         ++header_.messages_;
+         MessageFields fields;
+         parser_.splitFields(line, len, fields);
+
+         const char *symbol;
+         uint32_t symbol_len;
+         parser_.getSymbol(fields, symbol, symbol_len);
+         if (symbol != 0 && !SymbolDirectory::validSymbol(symbol_len))
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return true;
+         }
+
+         MessageType mt = parser_.getMessageType(fields);
+         FeedRecord record;
+         memset(&record, 0, sizeof(record));
+         record.sequence_ = header_.messages_;
+         if (mt == eMT_Unknown)
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return true;
+         }
+         else if (mt == eMT_Trade)
+         {
+            TradeMessage tm;
+            parser_.parseTrade(fields, tm);
+            if (tm.trade_price_ == 0)
+               return true;
+            record.type_ = eFR_Trade;
+            record.quantity_ = tm.trade_qty_;
+            record.price_ = tm.trade_price_;
+         }
+         else
+         {
+            OrderLevelEntry ole;
+            parser_.parseOrder(fields, ole);
+            if (ole.order_side_ == eS_Unknown)
+               return true;
+            record.type_ = mt == eMT_Add ? eFR_Add : (mt == eMT_Modify ? eFR_Modify : eFR_Remove);
+            record.side_ = ole.order_side_ == eS_Buy ? 'B' : 'S';
+            record.order_id_ = ole.order_id_;
+            record.quantity_ = ole.order_qty_;
+            record.price_ = ole.order_price_;
+            record.display_quantity_ = ole.order_display_qty_;
+            record.flags_ = ole.order_flags_;
+         }
+
+         // Only a valid message may add a symbol, as in the handler.
+         if (symbol != 0)
+         {
+            uint32_t known = symbols_.size();
+            uint32_t symbol_id = symbols_.intern(symbol, symbol_len);
+            if (symbol_id == INVALIDSYMBOL)
+            {
+               FeedErrorStats::instance()->corruptMessage();
+               return true;
+            }
+            record.symbol_id_ = symbol_id;
+            if (symbols_.size() != known && !writeSymbol(symbol_id))
+               return false;
+         }
+         return writeRecord(&record);
+      }
+
+      // Rewrites the header with the final counts.  out must be seekable.
+      bool finish()
+      {
+         FeedErrorTotals end;
+         FeedErrorStats::totals(end);
+         header_.good_ = end.counters_[eFE_GoodMessage] - start_.counters_[eFE_GoodMessage];
+         header_.corrupt_ = end.counters_[eFE_CorruptMessage] - start_.counters_[eFE_CorruptMessage];
+         header_.invalid_quantity_ = end.counters_[eFE_InvalidQuantity] - start_.counters_[eFE_InvalidQuantity];
+         header_.invalid_price_ = end.counters_[eFE_InvalidPrice] - start_.counters_[eFE_InvalidPrice];
+         header_.invalid_id_ = end.counters_[eFE_InvalidID] - start_.counters_[eFE_InvalidID];
+         return fseek(out_, 0, SEEK_SET) == 0 && fwrite(&header_, sizeof(header_), 1, out_) == 1 &&
+                fflush(out_) == 0;
+      }
+
+      const FeedFileHeader &header() const { return header_; }
+
+   private:
+      FeedEncoder(const FeedEncoder &);
+      FeedEncoder &operator=(const FeedEncoder &);
+
+      bool writeSymbol(uint32_t symbol_id)
+      {
+         const SymbolEntry *entry = symbols_.find(symbol_id);
+         FeedSymbolRecord record;
+         memset(&record, 0, sizeof(record));
+         record.type_ = eFR_Symbol;
+         record.len_ = strnlen(entry->name_, SYMBOLLENMAX);
+         record.symbol_id_ = symbol_id;
+         record.sequence_ = header_.messages_;
+         memcpy(record.name_, entry->name_, record.len_);
+         return writeRecord(&record);
+      }
+
+      bool writeRecord(const void *record)
+      {
+         ++header_.records_;
+         return fwrite(record, sizeof(FeedRecord), 1, out_) == 1;
+      }
+
+      FILE *out_;
+      Parser parser_;
+      SymbolDirectory symbols_;
+      FeedFileHeader header_;
+      FeedErrorTotals start_;
+   };
+
+}
+
+#endif
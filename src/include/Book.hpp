@@ -6,345 +6,695 @@
 #include <assert.h>
 #include <stdio.h>
 
-#include <map>
-#include <unordered_map>
-
+#include "BookSide.hpp"
+#include "DepthSnapshot.hpp"
+#include "HashOrderIndex.hpp"
+#include "MapPriceLevels.hpp"
 #include "OrderDLList.hpp"
+#include "OrderPool.hpp"
 #include "FeedErrorStats.hpp"
 #include "Logger.hpp"
+#include "OutputEvents.hpp"
 #include "Parser.hpp"
+#include "TopOfBook.hpp"
+#include "TscClock.hpp"
 #include "Utils.hpp"
 
 namespace zeus_core
 {
-   template <typename ORDERIDTYPE, typename ORDERTYPE>
+   // Output conflation for Book.  When enabled, a midpoint is only printed
+   // once the best bid or ask price has changed since the last one printed,
+   // and same-price trades are aggregated into one print.  A pending print
+   // is held back until at least window_messages_ messages and
+   // window_nanos_ have passed since the previous print of that kind; both
+   // 0 prints on every real change.
+   struct ConflationOptions
+   {
+      ConflationOptions() : enabled_(false), window_messages_(0), window_nanos_(0) {}
+
+      bool enabled_;
+      uint32_t window_messages_;
+      uint64_t window_nanos_;
+   };
+
+   // Best bid and offer in integer price ticks; a price and quantity of 0
+   // mean that side is empty.
+   struct BestBidOffer
+   {
+      unsigned long long bid_price_;
+      uint32_t bid_quantity_;
+      unsigned long long ask_price_;
+      uint32_t ask_quantity_;
+   };
+
+   // Order book for one symbol, with every type resolved at compile time:
+   // LEVELS is the price level container (and fixes the price type),
+   // ORDERINDEX maps order IDs to resting orders and SINK receives the
+   // output events.  An order's side is branched on once per operation; the
+   // work below that runs on a BookSide specialised for it.
+   template <typename ORDERIDTYPE, typename ORDERTYPE,
+             typename LEVELS = MapPriceLevels<ORDERTYPE>,
+             typename ORDERINDEX = HashOrderIndex<ORDERIDTYPE, ORDERTYPE>,
+             typename SINK = Logger>
    class Book
    {
    public:
-      Book() : logger_(), recent_trade_price_(0), recent_trade_qty_(0) {}
+      Book(OrderPool<ORDERTYPE> &order_pool, SINK &logger, uint32_t symbol_id = 0)
+          : logger_(logger), order_pool_(order_pool), symbol_id_(symbol_id), snapshot_depth_(0), book_changed_(true),
+            recent_trade_price_(0), recent_trade_qty_(0), sequence_(0), top_of_book_(0), matching_(false),
+            quiet_(false), conflation_(), printed_bid_(0), printed_ask_(0), midpoint_window_(), trade_pending_(false), trade_window_()
+      {
+         logger_.setEventFormatter(&formatOutputEvent);
+      }
 
       ~Book()
       {
-         for (auto it = buy_book_map_.begin(); it != buy_book_map_.end(); ++it)
-         {
-            it->second.clearLevel();
-         }
-         for (auto it = sell_book_map_.begin(); it != sell_book_map_.end(); ++it)
-         {
-            it->second.clearLevel();
-         }
-         buy_book_map_.clear();
-         sell_book_map_.clear();
-         while (!orders_.empty())
-         {
-            auto it = orders_.begin();
-            delete it->second;
-            orders_.erase(it);
-         }
+         buy_.clear();
+         sell_.clear();
+         orders_.forEach([this](ORDERTYPE *order) { order_pool_.release(order); });
+         orders_.clear();
       }
 
-      typedef std::map<unsigned long long, CountedOrderList<ORDERTYPE>> OrderListMap;
-      typedef std::unordered_map<ORDERIDTYPE, ORDERTYPE *> OrderHash;
+      typedef LEVELS PriceLevels;
+      typedef typename LEVELS::Level Level;
+      typedef typename LEVELS::Price Price;
+      typedef ORDERINDEX OrderIndex;
+      typedef BookSide<eS_Buy, LEVELS> BuySide;
+      typedef BookSide<eS_Sell, LEVELS> SellSide;
 
-      Logger &getLoggerReference()
+      SINK &getLoggerReference()
       {
          return logger_;
       }
 
+      uint32_t symbolId() const { return symbol_id_; }
+
+      // Shared-memory record updated in place after every book change, or 0
+      // to stop publishing.
+      void setTopOfBook(TopOfBookRecord *record)
+      {
+         top_of_book_ = record;
+         publishTopOfBook();
+      }
+      uint64_t lastSequence() const { return sequence_; }
+
       void printMidpoint()
       {
-         if (sell_book_map_.empty() || buy_book_map_.empty())
+         if (LIKELY(!conflation_.enabled_))
          {
-            logger_.print("NAN\n");
+            emitMidpoint();
             return;
          }
 
-         unsigned long long sell_min = sell_book_map_.begin()->first;
-         unsigned long long buy_max = buy_book_map_.rbegin()->first;
-         double midpoint = (sell_min + buy_max) / 200.;
-         char buffer[20];
-         sprintf(buffer, "%.2f\n", midpoint);
-         logger_.print(buffer);
+         ++midpoint_window_.messages_;
+         if (bestBid() == printed_bid_ && bestAsk() == printed_ask_)
+            return;
+         if (windowElapsed(midpoint_window_))
+            emitMidpoint();
       }
 
-      void printBook()
+      // In matching mode an add that crosses the opposite best level trades
+      // against it immediately, oldest order first at each price from the
+      // best price inwards, and only the remainder rests.  Each fill prints a
+      // fill event and each price level traded through a trade.  A modify
+      // that moves an order to a crossing price matches the same way.
+      //
+      // Order attributes also apply only in matching mode: an IOC remainder
+      // is dropped, a FOK that the crossed levels cannot fill in full and a
+      // post-only order that would cross are killed without trading, and an
+      // iceberg shows at most its display quantity, refilled at the back of
+      // its level each time the shown part trades.
+      void setMatching(bool matching)
+      {
+         matching_ = matching;
+      }
+
+      // Suppresses output events, e.g. while recovery replays a journal.
+      void setQuiet(bool quiet)
+      {
+         quiet_ = quiet;
+      }
+
+      void setConflation(const ConflationOptions &options)
+      {
+         flushConflated();
+         conflation_ = options;
+      }
+
+      // Prints whatever conflation is still holding back.
+      void flushConflated()
+      {
+         if (trade_pending_)
+            emitTrade();
+         if (conflation_.enabled_ && (bestBid() != printed_bid_ || bestAsk() != printed_ask_))
+            emitMidpoint();
+      }
+
+      // Depth of the snapshot written by printBook(), in levels per side.  0
+      // prints the whole book.
+      void setSnapshotDepth(uint32_t depth)
       {
-         int max_buffer = 500;
-         char *buffer = (char *)calloc(max_buffer, sizeof(char));
-         int index = 0;
+         snapshot_depth_ = depth;
+         book_changed_ = true;
+      }
 
-         for (auto it = sell_book_map_.rbegin(); it != sell_book_map_.rend(); ++it)
+      // How many emptied price levels each side keeps for reuse.
+      void setLevelRetention(uint32_t retention)
+      {
+         buy_.setRetention(retention);
+         sell_.setRetention(retention);
+      }
+
+      void printBook()
+      {
+         if (book_changed_)
          {
-            if (it->second.getQuantity() != 0)
-            {
-               if (index + 100 > max_buffer)
-                  growBuffer(buffer, max_buffer);
-               index += sprintf(&buffer[index], "%.2f ", it->first / 100.);
-
-               it->second.printLevel('S', buffer, index, max_buffer);
-               if (index + 10 > max_buffer)
-                  growBuffer(buffer, max_buffer);
-               index += sprintf(&buffer[index], "\n");
-            }
+            sell_.refreshDepth(snapshot_depth_);
+            buy_.refreshDepth(snapshot_depth_);
+            book_changed_ = false;
          }
-         safeCopyToBuffer(buffer, "\n", index, max_buffer);
-         for (auto it = buy_book_map_.rbegin(); it != buy_book_map_.rend(); ++it)
-         {
-            if (it->second.getQuantity() != 0)
-            {
-               if (index + 100 > max_buffer)
-                  growBuffer(buffer, max_buffer);
-               index += sprintf(&buffer[index], "%.2f ", it->first / 100.);
 
-               it->second.printLevel('B', buffer, index, max_buffer);
+         const DepthSnapshot<PriceLevels> &sell_depth = sell_.depth();
+         const DepthSnapshot<PriceLevels> &buy_depth = buy_.depth();
+         uint32_t len = sizeof(BookSnapshotEvent) + sell_depth.writtenSize() + buy_depth.writtenSize();
+         BookSnapshotEvent *event = (BookSnapshotEvent *)claimEvent(eOE_BookSnapshot, len);
+         if (event == 0)
+            return;
+         event->level_count_ = sell_depth.levelCount() + buy_depth.levelCount();
+         event->order_count_ = sell_depth.orderCount() + buy_depth.orderCount();
 
-               if (index + 10 > max_buffer)
-                  growBuffer(buffer, max_buffer);
-               index += sprintf(&buffer[index], "\n");
-            }
-         }
-         if (index + 10 > max_buffer)
-            growBuffer(buffer, max_buffer);
-         index += sprintf(&buffer[index], "\n");
+         char *position = (char *)event + sizeof(BookSnapshotEvent);
+         position = sell_depth.write(position);
+         buy_depth.write(position);
+         logger_.publish();
+      }
+
+      const DepthSnapshot<PriceLevels> &sellDepth() const { return sell_.depth(); }
+      const DepthSnapshot<PriceLevels> &buyDepth() const { return buy_.depth(); }
+
+      // O(1) reads of the cached best levels.
+      BestBidOffer topOfBook() const
+      {
+         BestBidOffer bbo;
+         bbo.bid_price_ = buy_.best().price_;
+         bbo.bid_quantity_ = buy_.best().quantity_;
+         bbo.ask_price_ = sell_.best().price_;
+         bbo.ask_quantity_ = sell_.best().quantity_;
+         return bbo;
+      }
 
-         logger_.print(buffer);
-         free(buffer);
+      // Ask minus bid in ticks (negative when crossed), or 0 if a side is
+      // empty.
+      long long spread() const
+      {
+         if (buy_.empty() || sell_.empty())
+            return 0;
+         return (long long)sell_.best().price_ - (long long)buy_.best().price_;
+      }
+
+      // Mean of bid and ask rounded down to a whole tick, or 0 if a side is
+      // empty.
+      Price midpoint() const
+      {
+         if (buy_.empty() || sell_.empty())
+            return 0;
+         return (buy_.best().price_ + sell_.best().price_) / 2;
+      }
+
+      // Visits every resting order, bids then asks, best level first and
+      // oldest first within a level: the order restoreOrder() must see them
+      // in to rebuild time priority.
+      template <typename FUNC>
+      void forEachOrder(FUNC func)
+      {
+         buy_.forEachOrder(func);
+         sell_.forEachOrder(func);
+      }
+
+      // Rests order as saved by a snapshot, without matching, checks or
+      // output.
+      void restoreOrder(ORDERTYPE *order)
+      {
+         if (order->order_side_ == eS_Buy)
+            buy_.addOrder(order);
+         else
+            sell_.addOrder(order);
+         orders_.insert(order->order_id_, order);
+         book_changed_ = true;
+      }
+
+      Price lastTradePrice() const { return recent_trade_price_; }
+      uint32_t lastTradeQuantity() const { return recent_trade_qty_; }
+
+      // Restores the last-trade print aggregation saved with a snapshot.
+      void restoreLastTrade(Price price, uint32_t quantity)
+      {
+         recent_trade_price_ = price;
+         recent_trade_qty_ = quantity;
+         publishTopOfBook();
       }
 
       void checkCross() const
       {
-         if (sell_book_map_.empty() || buy_book_map_.empty())
+         if (sell_.empty() || buy_.empty())
          {
             return;
          }
-         auto sit = sell_book_map_.begin();
-         auto bit = buy_book_map_.end();
-         --bit;
-         if (sit->first <= bit->first)
+         if (sell_.best().price_ <= buy_.best().price_)
          {
             FeedErrorStats::instance()->crossedBook();
          }
       }
 
-      void addOrder(ORDERTYPE *ole)
+      // The message handlers return whether the book applied the message,
+      // as opposed to counting it as an error and ignoring it.  An order
+      // that matching fills or kills has still been applied.
+      bool addOrder(ORDERTYPE *ole)
       {
          checkCross();
 
-         auto ooit = orders_.find(ole->order_id_);
-         if (ooit != orders_.end())
+         if (orders_.find(ole->order_id_) != 0)
          {
             FeedErrorStats::instance()->duplicateAdd();
-            delete ole;
-            return;
+            order_pool_.release(ole);
+            return false;
          }
 
-         OrderListMap &map = ole->order_side_ == eS_Buy ? buy_book_map_ : sell_book_map_;
+         book_changed_ = true;
+         if (UNLIKELY(matching_) && !matchOrder(ole))
+         {
+            order_pool_.release(ole);
+            publishTopOfBook();
+            return true;
+         }
 
-         std::pair<typename OrderListMap::iterator, bool> ret;
-         ret = map.insert(
-             std::pair<unsigned long long, CountedOrderList<ORDERTYPE>>(
-                 ole->order_price_, CountedOrderList<ORDERTYPE>()));
-         ret.first->second.addNode(ole);
-         orders_[ole->order_id_] = ole;
+         if (ole->order_side_ == eS_Buy)
+            buy_.addOrder(ole);
+         else
+            sell_.addOrder(ole);
+         orders_.insert(ole->order_id_, ole);
+         publishTopOfBook();
+         return true;
       }
 
-      void modifyOrder(ORDERTYPE *ole)
+      bool modifyOrder(const ORDERTYPE &ole)
       {
          checkCross();
 
-         auto ooit = orders_.find(ole->order_id_);
-         if (ooit == orders_.end())
+         ORDERTYPE *resting = orders_.find(ole.order_id_);
+         if (resting == 0)
          {
             FeedErrorStats::instance()->invalidModify();
-            delete ole;
-            return;
+            return false;
          }
 
-         OrderListMap &map = ooit->second->order_side_ == eS_Buy ? buy_book_map_ : sell_book_map_;
-
-         if (ole->order_price_ == ooit->second->order_price_)
-         {
-            if (ole->order_qty_ <= ooit->second->order_qty_)
-            {
-               typename OrderListMap::iterator pit = map.find(ooit->second->order_price_);
-               pit->second.changeNodeQuantity(ooit->second, ole->order_qty_);
-               delete ole;
-            }
-            else
-            {
-               typename OrderListMap::iterator pit = map.find(ooit->second->order_price_);
-               pit->second.removeNode(ooit->second);
-               delete ooit->second;
-               orders_.erase(ooit);
-
-               pit->second.addNode(ole);
-               orders_[ole->order_id_] = ole;
-            }
-         }
+         book_changed_ = true;
+         if (resting->order_side_ == eS_Buy)
+            modifyResting(buy_, resting, ole);
          else
-         {
-            typename OrderListMap::iterator opit = map.find(ooit->second->order_price_);
-            opit->second.removeNode(ooit->second);
-            delete ooit->second;
-            orders_.erase(ooit);
-
-            if (opit->second.getQuantity() == 0)
-            {
-               map.erase(opit);
-            }
-
-            std::pair<typename OrderListMap::iterator, bool> ret;
-            ret = map.insert(
-                std::pair<unsigned long long, CountedOrderList<ORDERTYPE>>(
-                    ole->order_price_, CountedOrderList<ORDERTYPE>()));
-            ret.first->second.addNode(ole);
-            orders_[ole->order_id_] = ole;
-         }
+            modifyResting(sell_, resting, ole);
+         publishTopOfBook();
+         return true;
       }
 
-      void removeOrder(ORDERTYPE *ole)
+      bool removeOrder(const ORDERTYPE &ole)
       {
          checkCross();
-         auto ooit = orders_.find(ole->order_id_);
-         if (ooit == orders_.end())
+         ORDERTYPE *resting = orders_.find(ole.order_id_);
+         if (resting == 0)
          {
             FeedErrorStats::instance()->badCancel();
-            delete ole;
-            return;
+            return false;
          }
 
-         OrderListMap &map = ooit->second->order_side_ == eS_Buy ? buy_book_map_ : sell_book_map_;
-
-         typename OrderListMap::iterator pit = map.find(ooit->second->order_price_);
-         if (pit == map.end())
-         {
-            fprintf(stderr, "Cancel for order on price level (%llu) not found.\n", ooit->second->order_price_);
-            delete ole;
-            return;
-         }
-         pit->second.removeNode(ooit->second);
-         delete ooit->second;
-         orders_.erase(ooit);
-         delete ole;
-
-         if (pit->second.getQuantity() == 0)
-         {
-            map.erase(pit);
-         }
+         bool removed = resting->order_side_ == eS_Buy ? removeResting(buy_, resting) : removeResting(sell_, resting);
+         if (removed)
+            publishTopOfBook();
+         return removed;
       }
 
-      void handleTrade(TradeMessage &tm)
+      bool handleTrade(TradeMessage &tm)
       {
-         if (buy_book_map_.empty() || sell_book_map_.empty())
+         if (buy_.empty() || sell_.empty())
          {
             FeedErrorStats::instance()->tradeMissingOrders();
-            return;
+            return false;
          }
-         auto bit = buy_book_map_.end();
-         --bit;
-         if (bit->first < tm.trade_price_)
+         Price buy_price = buy_.best().price_;
+         if (buy_price < tm.trade_price_)
          {
             FeedErrorStats::instance()->tradeMissingOrders();
-            return;
+            return false;
          }
-         auto sit = sell_book_map_.find(tm.trade_price_);
-         if (sit == sell_book_map_.end())
+         Level *bit = buy_.best().level_;
+         Level *sit = sell_.findLevel(tm.trade_price_);
+         if (sit == 0)
          {
             FeedErrorStats::instance()->tradeMissingOrders();
-            return;
+            return false;
          }
 
-         if (bit->second.getQuantity() < tm.trade_qty_ ||
-             sit->second.getQuantity() < tm.trade_qty_)
+         if (bit->getQuantity() < tm.trade_qty_ ||
+             sit->getQuantity() < tm.trade_qty_)
          {
             FeedErrorStats::instance()->tradeMissingOrders();
-            return;
+            return false;
          }
 
-         uint32_t trade_qty = tm.trade_qty_;
-         while (trade_qty > 0)
+         book_changed_ = true;
+         fillFromTail(bit, tm.trade_qty_);
+         buy_.levelChanged(buy_price, bit);
+         fillFromTail(sit, tm.trade_qty_);
+         sell_.levelChanged(tm.trade_price_, sit);
+
+         recordTrade(tm.trade_price_, tm.trade_qty_);
+         checkCross();
+         return true;
+      }
+
+   private:
+      struct ConflationWindow
+      {
+         ConflationWindow() : messages_(0), printed_tsc_(0), printed_(false) {}
+
+         uint32_t messages_;
+         uint64_t printed_tsc_;
+         bool printed_;
+      };
+
+      Price bestBid() const { return buy_.best().price_; }
+      Price bestAsk() const { return sell_.best().price_; }
+
+      // A modify to an iceberg in matching mode is a cancel/replace: ole's
+      // quantity is the new total and the order loses its time priority.
+      template <typename BOOKSIDE>
+      void modifyResting(BOOKSIDE &side, ORDERTYPE *resting, const ORDERTYPE &ole)
+      {
+         if (ole.order_price_ == resting->order_price_ && !(matching_ && (resting->order_flags_ & eOF_Iceberg)))
          {
-            ORDERTYPE *tail = bit->second.getTail();
-            if (tail->order_qty_ > trade_qty)
+            Level *level = side.findLevel(resting->order_price_);
+            if (ole.order_qty_ <= resting->order_qty_)
             {
-               trade_qty = 0;
+               level->changeNodeQuantity(resting, ole.order_qty_);
             }
             else
             {
-               trade_qty -= tail->order_qty_;
+               level->removeNode(resting);
+               resting->order_qty_ = ole.order_qty_;
+               level->addNode(resting);
             }
+            side.levelUpdated(resting->order_price_, level);
+            return;
+         }
+
+         Price old_price = resting->order_price_;
+         Level *old_level = side.findLevel(old_price);
+         old_level->removeNode(resting);
+         side.levelChanged(old_price, old_level);
 
-            if (tm.trade_qty_ >= tail->order_qty_)
+         resting->order_price_ = ole.order_price_;
+         resting->order_qty_ = ole.order_qty_;
+         resting->order_hidden_qty_ = 0;
+         if (UNLIKELY(matching_) && !matchOrder(resting))
+         {
+            orders_.erase(resting->order_id_);
+            order_pool_.release(resting);
+            return;
+         }
+         side.addOrder(resting);
+      }
+
+      // Matches order against the opposite side while it crosses.  Returns
+      // false if nothing is left of it to rest.
+      bool matchOrder(ORDERTYPE *order)
+      {
+         if (order->order_side_ == eS_Buy)
+            return matchAgainst(sell_, order);
+         return matchAgainst(buy_, order);
+      }
+
+      template <typename BOOKSIDE>
+      bool matchAgainst(BOOKSIDE &opposite, ORDERTYPE *aggressor)
+      {
+         uint8_t flags = aggressor->order_flags_;
+         if (UNLIKELY(flags != 0))
+         {
+            if (((flags & eOF_PostOnly) && opposite.crossedBy(aggressor->order_price_)) ||
+                ((flags & eOF_FillOrKill) && !opposite.canFill(aggressor->order_price_, aggressor->order_qty_)))
             {
-               bit->second.removeNode(tail);
-               auto odit = orders_.find(tail->order_id_);
-               delete odit->second;
-               orders_.erase(odit);
+               FeedErrorStats::instance()->orderKilled();
+               return false;
             }
-            else
+         }
+
+         while (aggressor->order_qty_ > 0 && opposite.crossedBy(aggressor->order_price_))
+         {
+            Price price = opposite.best().price_;
+            Level *level = opposite.best().level_;
+            uint32_t traded = 0;
+            while (aggressor->order_qty_ > 0 && level->getCount() > 0)
             {
-               bit->second.changeNodeQuantity(tail, tail->order_qty_ - tm.trade_qty_);
+               ORDERTYPE *resting = level->getTail();
+               uint32_t fill = aggressor->order_qty_ < resting->order_qty_ ? aggressor->order_qty_ : resting->order_qty_;
+               emitFill(*aggressor, *resting, price, fill);
+               aggressor->order_qty_ -= fill;
+               traded += fill;
+               if (fill != resting->order_qty_)
+               {
+                  level->changeNodeQuantity(resting, resting->order_qty_ - fill);
+               }
+               else if (UNLIKELY(resting->order_hidden_qty_ != 0))
+               {
+                  refillIceberg(level, resting);
+               }
+               else
+               {
+                  level->removeNode(resting);
+                  orders_.erase(resting->order_id_);
+                  order_pool_.release(resting);
+               }
             }
+            opposite.levelChanged(price, level);
+            recordTrade(price, traded);
+         }
+
+         if (aggressor->order_qty_ == 0)
+            return false;
+         if (UNLIKELY(flags & eOF_ImmediateOrCancel))
+         {
+            FeedErrorStats::instance()->remainderExpired();
+            return false;
          }
-         if (bit->second.getQuantity() == 0)
+         if (UNLIKELY(flags & eOF_Iceberg) && aggressor->order_display_qty_ < aggressor->order_qty_)
          {
-            buy_book_map_.erase(bit);
+            aggressor->order_hidden_qty_ = aggressor->order_qty_ - aggressor->order_display_qty_;
+            aggressor->order_qty_ = aggressor->order_display_qty_;
          }
+         return true;
+      }
 
-         trade_qty = tm.trade_qty_;
-         while (trade_qty > 0)
+      template <typename BOOKSIDE>
+      bool removeResting(BOOKSIDE &side, ORDERTYPE *resting)
+      {
+         Price price = resting->order_price_;
+         Level *level = side.findLevel(price);
+         if (level == 0)
          {
-            ORDERTYPE *tail = sit->second.getTail();
-            if (tail->order_qty_ > trade_qty)
-            {
-               trade_qty = 0;
-            }
-            else
+            fprintf(stderr, "Cancel for order on price level (%llu) not found.\n", (unsigned long long)price);
+            return false;
+         }
+         level->removeNode(resting);
+         orders_.erase(resting->order_id_);
+         order_pool_.release(resting);
+         book_changed_ = true;
+         side.levelChanged(price, level);
+         return true;
+      }
+
+      // Shows the next slice of an iceberg whose displayed quantity has been
+      // filled.  The slice joins the back of the level's queue.
+      void refillIceberg(Level *level, ORDERTYPE *order)
+      {
+         level->removeNode(order);
+         order->order_qty_ = order->order_hidden_qty_ < order->order_display_qty_ ? order->order_hidden_qty_
+                                                                                 : order->order_display_qty_;
+         order->order_hidden_qty_ -= order->order_qty_;
+         level->addNode(order);
+      }
+
+      // Takes trade_qty from the oldest orders at level, releasing the ones
+      // it fills and refilling icebergs from their reserve.
+      void fillFromTail(Level *level, uint32_t trade_qty)
+      {
+         uint32_t remaining = trade_qty;
+         while (remaining > 0)
+         {
+            ORDERTYPE *tail = level->getTail();
+            uint32_t take = remaining < tail->order_qty_ ? remaining : tail->order_qty_;
+            remaining -= take;
+
+            if (take != tail->order_qty_)
             {
-               trade_qty -= tail->order_qty_;
+               level->changeNodeQuantity(tail, tail->order_qty_ - take);
             }
-
-            if (tm.trade_qty_ >= tail->order_qty_)
+            else if (UNLIKELY(tail->order_hidden_qty_ != 0))
             {
-               sit->second.removeNode(tail);
-               auto odit = orders_.find(tail->order_id_);
-               delete odit->second;
-               orders_.erase(odit);
+               refillIceberg(level, tail);
             }
             else
             {
-               sit->second.changeNodeQuantity(tail, tail->order_qty_ - tm.trade_qty_);
+               level->removeNode(tail);
+               orders_.erase(tail->order_id_);
+               order_pool_.release(tail);
             }
          }
-         if (sit->second.getQuantity() == 0)
+      }
+
+      // Adds a trade to the last-trade print, which aggregates consecutive
+      // trades at one price.
+      void recordTrade(Price price, uint32_t quantity)
+      {
+         if (price != recent_trade_price_)
          {
-            sell_book_map_.erase(sit);
+            if (trade_pending_)
+               emitTrade();
+            recent_trade_price_ = price;
+            recent_trade_qty_ = 0;
          }
+         recent_trade_qty_ += quantity;
+         publishTopOfBook();
 
-         if (tm.trade_price_ != recent_trade_price_)
+         if (LIKELY(!conflation_.enabled_))
          {
-            recent_trade_price_ = tm.trade_price_;
-            recent_trade_qty_ = 0;
+            emitTrade();
+         }
+         else
+         {
+            trade_pending_ = true;
+            ++trade_window_.messages_;
+            if (windowElapsed(trade_window_))
+               emitTrade();
          }
-         recent_trade_qty_ += tm.trade_qty_;
+      }
 
-         char trade_buffer[25];
-         sprintf(trade_buffer, "%u@%.2f\n", recent_trade_qty_, recent_trade_price_ / 100.);
-         logger_.print(trade_buffer);
+      bool windowElapsed(const ConflationWindow &window) const
+      {
+         if (!window.printed_)
+            return true;
+         if (window.messages_ < conflation_.window_messages_)
+            return false;
+         if (conflation_.window_nanos_ == 0)
+            return true;
+         const TscClock &clock = TscClock::instance();
+         return clock.toNanos(clock.start() - window.printed_tsc_) >= conflation_.window_nanos_;
+      }
 
-         checkCross();
+      void resetWindow(ConflationWindow &window)
+      {
+         window.messages_ = 0;
+         window.printed_ = true;
+         if (conflation_.window_nanos_ != 0)
+            window.printed_tsc_ = TscClock::instance().start();
       }
 
-   private:
-      Logger logger_;
+      void emitMidpoint()
+      {
+         printed_bid_ = bestBid();
+         printed_ask_ = bestAsk();
+         resetWindow(midpoint_window_);
+
+         MidquoteEvent *event = (MidquoteEvent *)claimEvent(eOE_Midquote, sizeof(MidquoteEvent));
+         if (event == 0)
+            return;
+         event->bid_price_ = printed_bid_;
+         event->ask_price_ = printed_ask_;
+         logger_.publish();
+      }
+
+      void emitTrade()
+      {
+         trade_pending_ = false;
+         resetWindow(trade_window_);
+
+         TradeEvent *event = (TradeEvent *)claimEvent(eOE_Trade, sizeof(TradeEvent));
+         if (event == 0)
+            return;
+         event->price_ = recent_trade_price_;
+         event->quantity_ = recent_trade_qty_;
+         logger_.publish();
+      }
+
+      void emitFill(const ORDERTYPE &aggressor, const ORDERTYPE &resting, Price price, uint32_t quantity)
+      {
+         FillEvent *event = (FillEvent *)claimEvent(eOE_Fill, sizeof(FillEvent));
+         if (event == 0)
+            return;
+         event->price_ = price;
+         event->aggressor_id_ = aggressor.order_id_;
+         event->resting_id_ = resting.order_id_;
+         event->quantity_ = quantity;
+         event->aggressor_side_ = aggressor.order_side_;
+         logger_.publish();
+      }
+
+      void publishTopOfBook()
+      {
+         if (top_of_book_ == 0)
+            return;
+
+         TopOfBookQuote &quote = top_of_book_->beginWrite();
+         quote.bid_price_ = buy_.best().price_;
+         quote.bid_quantity_ = buy_.best().quantity_;
+         quote.ask_price_ = sell_.best().price_;
+         quote.ask_quantity_ = sell_.best().quantity_;
+         quote.last_trade_price_ = recent_trade_price_;
+         quote.last_trade_quantity_ = recent_trade_qty_;
+         quote.update_tsc_ = TscClock::instance().start();
+         top_of_book_->endWrite();
+      }
+
+      char *claimEvent(OutputEventType type, uint32_t len)
+      {
+         if (UNLIKELY(quiet_))
+            return 0;
+         char *data = logger_.claim(type, len);
+         if (data == 0)
+            return 0;
+
+         EventHeader *header = (EventHeader *)data;
+         header->length_ = len;
+         header->type_ = type;
+         header->symbol_ = symbol_id_;
+         header->sequence_ = ++sequence_;
+         header->timestamp_ = eventTimestamp();
+         return data;
+      }
+
+      SINK &logger_;
+      OrderPool<ORDERTYPE> &order_pool_;
+      uint32_t symbol_id_;
+
+      BuySide buy_;
+      SellSide sell_;
 
-      OrderListMap buy_book_map_;
-      OrderListMap sell_book_map_;
+      OrderIndex orders_;
 
-      OrderHash orders_;
+      uint32_t snapshot_depth_;
+      bool book_changed_;
 
-      unsigned long long recent_trade_price_;
+      Price recent_trade_price_;
       uint32_t recent_trade_qty_;
+      uint64_t sequence_;
+      TopOfBookRecord *top_of_book_;
+      bool matching_;
+      bool quiet_;
+
+      ConflationOptions conflation_;
+      Price printed_bid_;
+      Price printed_ask_;
+      ConflationWindow midpoint_window_;
+      bool trade_pending_;
+      ConflationWindow trade_window_;
    };
 
 }
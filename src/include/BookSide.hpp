@@ -0,0 +1,188 @@
+#pragma once
+
+#ifndef __BOOKSIDE__
+#define __BOOKSIDE__
+
+#include <stdint.h>
+
+#include "DepthSnapshot.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Comparisons for one side of the book, fixed at compile time: which end
+   // of the price levels is best and whether one price improves on another.
+   template <Side SIDE>
+   struct SideTraits;
+
+   template <>
+   struct SideTraits<eS_Buy>
+   {
+      template <typename PRICE>
+      static bool better(PRICE lhs, PRICE rhs) { return lhs > rhs; }
+
+      template <typename LEVELS>
+      static typename LEVELS::Price bestPrice(const LEVELS &levels) { return levels.highestPrice(); }
+
+      template <typename LEVELS>
+      static typename LEVELS::Level *bestLevel(LEVELS &levels) { return levels.highestLevel(); }
+
+      template <typename LEVELS, typename FUNC>
+      static void visitFromBest(LEVELS &levels, FUNC func) { levels.visitFromHighest(func); }
+   };
+
+   template <>
+   struct SideTraits<eS_Sell>
+   {
+      template <typename PRICE>
+      static bool better(PRICE lhs, PRICE rhs) { return lhs < rhs; }
+
+      template <typename LEVELS>
+      static typename LEVELS::Price bestPrice(const LEVELS &levels) { return levels.lowestPrice(); }
+
+      template <typename LEVELS>
+      static typename LEVELS::Level *bestLevel(LEVELS &levels) { return levels.lowestLevel(); }
+
+      template <typename LEVELS, typename FUNC>
+      static void visitFromBest(LEVELS &levels, FUNC func) { levels.visitFromLowest(func); }
+   };
+
+   // One side of a Book: its price levels, its depth snapshot and a cache
+   // of its best level, kept current as orders come and go.  Everything
+   // that depends on the side is resolved from SIDE at compile time.
+   template <Side SIDE, typename LEVELS>
+   class BookSide
+   {
+   public:
+      typedef LEVELS PriceLevels;
+      typedef typename LEVELS::Level Level;
+      typedef typename LEVELS::Price Price;
+      typedef SideTraits<SIDE> Traits;
+
+      struct BestLevel
+      {
+         BestLevel() : price_(0), quantity_(0), level_(0) {}
+
+         Price price_;
+         uint32_t quantity_;
+         Level *level_;
+      };
+
+      BookSide() : levels_(), depth_(SIDE), best_() {}
+
+      bool empty() const { return best_.level_ == 0; }
+      const BestLevel &best() const { return best_; }
+
+      Level *findLevel(Price price) { return levels_.findLevel(price); }
+
+      // True if an opposite-side order at price would trade with the best
+      // level.
+      bool crossedBy(Price price) const { return best_.level_ != 0 && !Traits::better(price, best_.price_); }
+
+      // True if the levels an opposite-side order limited at price would
+      // cross hold at least quantity, shown or hidden.  Reads only level
+      // totals, from the best level until they add up.
+      bool canFill(Price price, uint32_t quantity)
+      {
+         if (!crossedBy(price))
+            return false;
+         uint64_t available = best_.quantity_ + best_.level_->getHiddenQuantity();
+         if (LIKELY(available >= quantity))
+            return true;
+
+         available = 0;
+         Traits::visitFromBest(levels_, [&](Price level_price, Level &level) {
+            if (Traits::better(price, level_price))
+               return false;
+            available += level.getQuantity() + level.getHiddenQuantity();
+            return available < quantity;
+         });
+         return available >= quantity;
+      }
+
+      template <typename ORDERTYPE>
+      void addOrder(ORDERTYPE *order)
+      {
+         uint32_t relocations = levels_.relocations();
+         Level &level = levels_.addLevel(order->order_price_);
+         level.addNode(order);
+         if (UNLIKELY(levels_.relocations() != relocations))
+            refreshBest();
+         else
+            levelUpdated(order->order_price_, &level);
+      }
+
+      // level, at price, just lost quantity or orders: removes it if it is
+      // now empty, otherwise updates the cache if it is the best.
+      void levelChanged(Price price, Level *level)
+      {
+         if (level->getQuantity() == 0)
+         {
+            levels_.removeLevel(price);
+            if (price == best_.price_)
+               refreshBest();
+         }
+         else
+         {
+            levelUpdated(price, level);
+         }
+      }
+
+      // level, at price, still holds orders and may have become the best.
+      void levelUpdated(Price price, Level *level)
+      {
+         if (best_.level_ == 0 || Traits::better(price, best_.price_))
+         {
+            best_.price_ = price;
+            best_.level_ = level;
+         }
+         if (price == best_.price_)
+            best_.quantity_ = level->getQuantity();
+      }
+
+      // Visits the side's orders best level first and oldest first within a
+      // level.
+      template <typename FUNC>
+      void forEachOrder(FUNC func)
+      {
+         Traits::visitFromBest(levels_, [&](Price, Level &level) {
+            for (typename Level::Node *order = level.getTail(); order != 0; order = order->next_)
+            {
+               func(*order);
+            }
+            return true;
+         });
+      }
+
+      void setRetention(uint32_t retention) { levels_.setRetention(retention); }
+
+      void refreshDepth(uint32_t depth) { depth_.refresh(levels_, depth); }
+      const DepthSnapshot<LEVELS> &depth() const { return depth_; }
+
+      void clear() { levels_.clear(); best_ = BestLevel(); }
+
+   private:
+      BookSide(const BookSide &);
+      BookSide &operator=(const BookSide &);
+
+      // Re-reads the best level after it was removed or the levels moved.
+      void refreshBest()
+      {
+         if (levels_.empty())
+         {
+            best_ = BestLevel();
+            return;
+         }
+         best_.price_ = Traits::bestPrice(levels_);
+         best_.level_ = Traits::bestLevel(levels_);
+         best_.quantity_ = best_.level_->getQuantity();
+      }
+
+      PriceLevels levels_;
+      DepthSnapshot<LEVELS> depth_;
+      BestLevel best_;
+   };
+
+}
+
+#endif
@@ -13,7 +13,7 @@ namespace zeus_core
    public:
       DLList() : head_(0), tail_(0) {}
 
-      virtual ~DLList() {}
+      ~DLList() {}
 
       void addNode(NODE *input)
       {
@@ -50,8 +50,9 @@ namespace zeus_core
          {
             head_ = 0;
             tail_ = 0;
-            return;
          }
+         target->next_ = 0;
+         target->previous_ = 0;
       }
 
       NODE *getHead() const { return head_; }
@@ -0,0 +1,137 @@
+#pragma once
+
+#ifndef __DEPTHSNAPSHOT__
+#define __DEPTHSNAPSHOT__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "OutputEvents.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Cached depth for one side of the book, best level first.  refresh()
+   // walks at most depth levels and only re-reads the orders of levels that
+   // changed since the previous refresh; clean levels are copied from the
+   // cache.  A depth of 0 means the whole side.
+   template <typename LEVELS>
+   class DepthSnapshot
+   {
+   public:
+      typedef typename LEVELS::Level Level;
+
+      struct DepthLevel
+      {
+         unsigned long long price_;
+         uint32_t quantity_;
+         uint32_t order_count_;
+         uint32_t begin_;
+      };
+
+      DepthSnapshot(Side side)
+          : side_(side), rendered_levels_(0), reused_levels_(0)
+      {
+      }
+
+      void refresh(LEVELS &levels, uint32_t depth)
+      {
+         next_levels_.clear();
+         next_quantities_.clear();
+         uint32_t cursor = 0;
+
+         auto visit = [&](unsigned long long price, Level &level) -> bool {
+            if (depth != 0 && next_levels_.size() >= depth)
+               return false;
+            if (level.getQuantity() == 0)
+               return true;
+
+            while (cursor < levels_.size() && better(levels_[cursor].price_, price))
+               ++cursor;
+
+            DepthLevel entry;
+            entry.price_ = price;
+            entry.quantity_ = level.getQuantity();
+            entry.begin_ = next_quantities_.size();
+            if (!level.isSnapshotDirty() && cursor < levels_.size() && levels_[cursor].price_ == price)
+            {
+               const DepthLevel &cached = levels_[cursor];
+               entry.order_count_ = cached.order_count_;
+               next_quantities_.insert(next_quantities_.end(), quantities_.begin() + cached.begin_,
+                                       quantities_.begin() + cached.begin_ + cached.order_count_);
+               ++reused_levels_;
+            }
+            else
+            {
+               entry.order_count_ = level.getCount();
+               next_quantities_.resize(entry.begin_ + entry.order_count_);
+               if (entry.order_count_ != 0)
+                  level.writeQuantities((char *)&next_quantities_[entry.begin_]);
+               ++rendered_levels_;
+            }
+            level.clearSnapshotDirty();
+            next_levels_.push_back(entry);
+            return true;
+         };
+
+         if (side_ == eS_Sell)
+            levels.visitFromLowest(visit);
+         else
+            levels.visitFromHighest(visit);
+
+         levels_.swap(next_levels_);
+         quantities_.swap(next_quantities_);
+      }
+
+      uint32_t levelCount() const { return levels_.size(); }
+      uint32_t orderCount() const { return quantities_.size(); }
+      const DepthLevel &level(uint32_t i) const { return levels_[i]; }
+
+      // Appends SnapshotLevel entries in descending price order, as printBook
+      // lists both sides.
+      char *write(char *position) const
+      {
+         for (uint32_t n = 0; n < levels_.size(); ++n)
+         {
+            const DepthLevel &entry = levels_[side_ == eS_Sell ? levels_.size() - 1 - n : n];
+            SnapshotLevel snapshot_level;
+            snapshot_level.price_ = entry.price_;
+            snapshot_level.order_count_ = entry.order_count_;
+            snapshot_level.side_ = side_;
+            memcpy(position, &snapshot_level, sizeof(snapshot_level));
+            position += sizeof(snapshot_level);
+            if (entry.order_count_ != 0)
+               memcpy(position, &quantities_[entry.begin_], entry.order_count_ * sizeof(uint32_t));
+            position += entry.order_count_ * sizeof(uint32_t);
+         }
+         return position;
+      }
+
+      uint32_t writtenSize() const
+      {
+         return levels_.size() * sizeof(SnapshotLevel) + quantities_.size() * sizeof(uint32_t);
+      }
+
+      uint64_t renderedLevels() const { return rendered_levels_; }
+      uint64_t reusedLevels() const { return reused_levels_; }
+
+   private:
+      bool better(unsigned long long lhs, unsigned long long rhs) const
+      {
+         return side_ == eS_Sell ? lhs < rhs : lhs > rhs;
+      }
+
+      Side side_;
+      std::vector<DepthLevel> levels_;
+      std::vector<uint32_t> quantities_;
+      std::vector<DepthLevel> next_levels_;
+      std::vector<uint32_t> next_quantities_;
+      uint64_t rendered_levels_;
+      uint64_t reused_levels_;
+   };
+
+}
+
+#endif
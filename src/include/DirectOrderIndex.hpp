@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef __DIRECTORDERINDEX__
+#define __DIRECTORDERINDEX__
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "FlatOrderIndex.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Order index for feeds whose IDs are dense and bounded: IDs below the
+   // bound are a direct array lookup, anything above it falls back to a
+   // FlatOrderIndex.  The array starts small and doubles up to the bound as
+   // higher IDs arrive, so a book only pays for the IDs it has seen.
+   template <typename ORDERIDTYPE, typename ORDERTYPE>
+   class DirectOrderIndex
+   {
+   public:
+      DirectOrderIndex(uint32_t max_id = DIRECTINDEXSIZE)
+          : orders_(), max_id_(max_id), overflow_(), size_(0)
+      {
+      }
+
+      ORDERTYPE *find(ORDERIDTYPE id) const
+      {
+         if (LIKELY((uint64_t)id < orders_.size()))
+            return orders_[id];
+         if ((uint64_t)id < max_id_)
+            return 0;
+         return overflow_.find(id);
+      }
+
+      void insert(ORDERIDTYPE id, ORDERTYPE *order)
+      {
+         if (UNLIKELY((uint64_t)id >= orders_.size() && (uint64_t)id < max_id_))
+            grow(id);
+         if (LIKELY((uint64_t)id < orders_.size()))
+         {
+            if (orders_[id] == 0)
+               ++size_;
+            orders_[id] = order;
+            return;
+         }
+         overflow_.insert(id, order);
+      }
+
+      void erase(ORDERIDTYPE id)
+      {
+         if (LIKELY((uint64_t)id < orders_.size()))
+         {
+            if (orders_[id] != 0)
+               --size_;
+            orders_[id] = 0;
+            return;
+         }
+         if ((uint64_t)id >= max_id_)
+            overflow_.erase(id);
+      }
+
+      bool empty() const { return size_ == 0 && overflow_.empty(); }
+      size_t size() const { return size_ + overflow_.size(); }
+
+      template <typename FUNC>
+      void forEach(FUNC func)
+      {
+         for (size_t i = 0; i < orders_.size(); ++i)
+         {
+            if (orders_[i] != 0)
+               func(orders_[i]);
+         }
+         overflow_.forEach(func);
+      }
+
+      void clear()
+      {
+         std::fill(orders_.begin(), orders_.end(), (ORDERTYPE *)0);
+         overflow_.clear();
+         size_ = 0;
+      }
+
+   private:
+      void grow(ORDERIDTYPE id)
+      {
+         uint64_t size = orders_.empty() ? FLATINDEXSIZE : orders_.size();
+         while (size <= (uint64_t)id)
+            size *= 2;
+         orders_.resize(size < max_id_ ? size : max_id_, (ORDERTYPE *)0);
+      }
+
+      std::vector<ORDERTYPE *> orders_;
+      uint64_t max_id_;
+      FlatOrderIndex<ORDERIDTYPE, ORDERTYPE> overflow_;
+      size_t size_;
+   };
+
+}
+
+#endif
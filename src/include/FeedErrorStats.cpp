@@ -1,5 +1,46 @@
 #pragma once
 
+#include <mutex>
+
 #include "FeedErrorStats.hpp"
 
-zeus_core::FeedErrorStats *zeus_core::FeedErrorStats::instance_ = 0;
+zeus_core::FeedErrorStats *zeus_core::FeedErrorStats::blocks_[FEEDSTATSBLOCKSMAX];
+std::atomic<uint32_t> zeus_core::FeedErrorStats::block_count_(0);
+zeus_core::FeedErrorStats *zeus_core::FeedErrorStats::overflow_ = 0;
+thread_local zeus_core::FeedErrorStats::Holder zeus_core::FeedErrorStats::holder_;
+
+// Reuses a block released by an exited thread, otherwise registers a new
+// one.  Past FEEDSTATSBLOCKSMAX live threads everyone else shares the last
+// block, whose counts are then only approximate.
+zeus_core::FeedErrorStats *zeus_core::FeedErrorStats::acquire()
+{
+   static std::mutex registry_mutex;
+   std::lock_guard<std::mutex> lock(registry_mutex);
+
+   uint32_t blocks = block_count_.load(std::memory_order_relaxed);
+   for (uint32_t i = 0; i < blocks; ++i)
+   {
+      bool released = false;
+      if (blocks_[i] != overflow_ && blocks_[i]->in_use_.compare_exchange_strong(released, true))
+         return blocks_[i];
+   }
+
+   if (blocks < FEEDSTATSBLOCKSMAX)
+   {
+      FeedErrorStats *stats = create();
+      if (stats != 0)
+      {
+         stats->in_use_.store(true, std::memory_order_relaxed);
+         blocks_[blocks] = stats;
+         block_count_.store(blocks + 1, std::memory_order_release);
+         return stats;
+      }
+   }
+
+   if (overflow_ == 0)
+   {
+      fprintf(stderr, "Feed statistics registry full at %u threads; sharing a counter block.\n", blocks);
+      overflow_ = blocks_[blocks - 1];
+   }
+   return overflow_;
+}
@@ -5,70 +5,170 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+#include "Utils.hpp"
 
 namespace zeus_core
 {
-   class FeedErrorStats
+   enum FeedError
+   {
+      eFE_CorruptMessage,
+      eFE_GoodMessage,
+      eFE_DuplicateAdd,
+      eFE_TradeMissingOrders,
+      eFE_BadCancel,
+      eFE_BadModify,
+      eFE_CrossedBook,
+      eFE_InvalidQuantity,
+      eFE_InvalidPrice,
+      eFE_InvalidID,
+      eFE_LevelAllocation,
+      eFE_LevelReuse,
+      eFE_LevelFree,
+      eFE_OrderKilled,
+      eFE_RemainderExpired,
+      eFE_Count
+   };
+
+   // Point-in-time totals summed over every thread's counter block.
+   struct FeedErrorTotals
+   {
+      uint64_t counters_[eFE_Count];
+   };
+
+   // Per-thread block of 64-bit feed counters.  instance() hands each thread
+   // its own cache-line-aligned block, so the hot path is a plain load and
+   // store with no sharing between threads.  Blocks live in a fixed registry
+   // that readers sum lock-free via totals(); a thread's block is released
+   // when it exits and reused, still holding its counts, by the next thread
+   // that needs one, so totals never go backwards.
+   class alignas(64) FeedErrorStats
    {
    public:
       static FeedErrorStats *instance()
       {
-         if (instance_ == 0)
+         FeedErrorStats *stats = holder_.stats_;
+         if (UNLIKELY(stats == 0))
+            stats = holder_.stats_ = acquire();
+         return stats;
+      }
+
+      void duplicateAdd() { increment(eFE_DuplicateAdd); }
+      void tradeMissingOrders() { increment(eFE_TradeMissingOrders); }
+      void badCancel() { increment(eFE_BadCancel); }
+      void crossedBook() { increment(eFE_CrossedBook); }
+      void corruptMessage() { increment(eFE_CorruptMessage); }
+      void invalidQuantity() { increment(eFE_InvalidQuantity); }
+      void invalidPrice() { increment(eFE_InvalidPrice); }
+      void invalidID() { increment(eFE_InvalidID); }
+      void invalidModify() { increment(eFE_BadModify); }
+      void goodMessage() { increment(eFE_GoodMessage); }
+      void levelAllocated() { increment(eFE_LevelAllocation); }
+      void levelReused() { increment(eFE_LevelReuse); }
+      void levelFreed() { increment(eFE_LevelFree); }
+      void orderKilled() { increment(eFE_OrderKilled); }
+      void remainderExpired() { increment(eFE_RemainderExpired); }
+
+      // Adds count to counter at once, e.g. results counted by another
+      // process.
+      void add(FeedError counter, uint64_t count)
+      {
+         counters_[counter].store(counters_[counter].load(std::memory_order_relaxed) + count,
+                                  std::memory_order_relaxed);
+      }
+
+      uint64_t count(FeedError counter) const
+      {
+         return counters_[counter].load(std::memory_order_relaxed);
+      }
+
+      static void totals(FeedErrorTotals &totals)
+      {
+         memset(&totals, 0, sizeof(totals));
+         uint32_t blocks = block_count_.load(std::memory_order_acquire);
+         for (uint32_t i = 0; i < blocks; ++i)
          {
-            instance_ = new FeedErrorStats();
+            for (uint32_t counter = 0; counter < eFE_Count; ++counter)
+            {
+               totals.counters_[counter] += blocks_[i]->count((FeedError)counter);
+            }
          }
-         return instance_;
       }
 
-      void init() {}
-
-      void duplicateAdd() { ++duplicate_add_; }
-      void tradeMissingOrders() { ++trade_missing_orders_; }
-      void badCancel() { ++bad_cancels_; }
-      void crossedBook() { ++crossed_book_; }
-      void corruptMessage() { ++corrupt_messages_; }
-      void invalidQuantity() { ++invalid_qtys_; }
-      void invalidPrice() { ++invalid_prices_; }
-      void invalidID() { ++invalid_ids_; }
-      void invalidModify() { ++bad_modifies_; }
-      void goodMessage() { ++good_messages_; }
+      static const char *counterName(uint32_t counter)
+      {
+         static const char *names[eFE_Count] = {
+             "Corrupt Messages", "Good Messages:", "Duplicate Adds:", "Trades Missing Orders:",
+             "Cancels for Missing ID's:", "Modifies for Missing ID's:", "Crossed Book:",
+             "Invalid Quantities:", "Invalid Prices:", "Invalid IDs:", "Level Allocations:",
+             "Level Reuses:", "Level Frees:", "Killed FOK/Post-Only Orders:", "Expired IOC Remainders:"};
+         return counter < eFE_Count ? names[counter] : "";
+      }
 
-      void printStatistics()
+      static void printStatistics()
       {
+         FeedErrorTotals all;
+         totals(all);
          fprintf(stderr, "\n[Feed Handler Statistics]\n");
-         fprintf(stderr, "   %-30s %10u\n", "Corrupt Messages", corrupt_messages_);
-         fprintf(stderr, "   %-30s %10u\n", "Good Messages:", good_messages_);
-         fprintf(stderr, "   %-30s %10u\n", "Duplicate Adds:", duplicate_add_);
-         fprintf(stderr, "   %-30s %10u\n", "Trades Missing Orders:", trade_missing_orders_);
-         fprintf(stderr, "   %-30s %10u\n", "Cancels for Missing ID's:", bad_cancels_);
-         fprintf(stderr, "   %-30s %10u\n", "Modifies for Missing ID's:", bad_modifies_);
-         fprintf(stderr, "   %-30s %10u\n", "Crossed Book:", crossed_book_);
-         fprintf(stderr, "   %-30s %10u\n", "Invalid Quantities:", invalid_qtys_);
-         fprintf(stderr, "   %-30s %10u\n", "Invalid Prices:", invalid_prices_);
-         fprintf(stderr, "   %-30s %10u\n", "Invalid IDs:", invalid_ids_);
+         for (uint32_t counter = 0; counter < eFE_Count; ++counter)
+         {
+            fprintf(stderr, "   %-30s %10lu\n", counterName(counter), all.counters_[counter]);
+         }
       }
 
-      ~FeedErrorStats()
+   private:
+      FeedErrorStats() : in_use_(false)
       {
-         delete instance_;
+         for (uint32_t counter = 0; counter < eFE_Count; ++counter)
+         {
+            counters_[counter].store(0, std::memory_order_relaxed);
+         }
       }
 
-   private:
-      FeedErrorStats() {}
+      FeedErrorStats(const FeedErrorStats &);
+      FeedErrorStats &operator=(const FeedErrorStats &);
+
+      // Only the owning thread writes, so no locked read-modify-write is
+      // needed; the atomic store just keeps concurrent readers well defined.
+      inline void increment(FeedError counter)
+      {
+         counters_[counter].store(counters_[counter].load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+      }
 
-      static FeedErrorStats *instance_;
+      struct Holder
+      {
+         Holder() : stats_(0) {}
+         ~Holder()
+         {
+            if (stats_ != 0 && stats_ != overflow_)
+               stats_->in_use_.store(false, std::memory_order_release);
+         }
+         FeedErrorStats *stats_;
+      };
+
+      static FeedErrorStats *acquire();
+
+      static FeedErrorStats *create()
+      {
+         void *memory = 0;
+         if (posix_memalign(&memory, 64, sizeof(FeedErrorStats)) != 0)
+            return 0;
+         return new (memory) FeedErrorStats();
+      }
 
-      uint32_t duplicate_add_ = 0;
-      uint32_t trade_missing_orders_ = 0;
-      uint32_t bad_cancels_ = 0;
-      uint32_t bad_modifies_ = 0;
-      uint32_t crossed_book_ = 0;
+      std::atomic<uint64_t> counters_[eFE_Count];
+      std::atomic<bool> in_use_;
 
-      uint32_t corrupt_messages_ = 0;
-      uint32_t invalid_qtys_ = 0;
-      uint32_t invalid_prices_ = 0;
-      uint32_t invalid_ids_ = 0;
-      uint32_t good_messages_ = 0;
+      static FeedErrorStats *blocks_[FEEDSTATSBLOCKSMAX];
+      static std::atomic<uint32_t> block_count_;
+      static FeedErrorStats *overflow_;
+      static thread_local Holder holder_;
    };
 
 }
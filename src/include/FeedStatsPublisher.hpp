@@ -0,0 +1,259 @@
+#pragma once
+
+#ifndef __FEEDSTATSPUBLISHER__
+#define __FEEDSTATSPUBLISHER__
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "FeedErrorStats.hpp"
+#include "SpscRing.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   static const uint64_t FEEDSTATSMAGIC = 0x5354415453444546ULL;
+
+   // One published interval: running totals, the change since the previous
+   // snapshot and that change as a per-second rate.
+   struct FeedStatsSnapshot
+   {
+      uint64_t publish_count_;
+      uint64_t wall_nanos_;
+      uint64_t interval_nanos_;
+      uint64_t totals_[eFE_Count];
+      uint64_t deltas_[eFE_Count];
+      double rates_[eFE_Count];
+   };
+
+   // Layout of the shared-memory object.  snapshot_ is guarded by a seqlock:
+   // sequence_ is odd while the publisher is writing, so a reader copies the
+   // snapshot and retries if the sequence moved underneath it.
+   struct FeedStatsRegion
+   {
+      uint64_t magic_;
+      uint32_t counter_count_;
+      uint32_t snapshot_size_;
+      alignas(64) std::atomic<uint64_t> sequence_;
+      FeedStatsSnapshot snapshot_;
+   };
+
+   inline uint64_t clockNanos(clockid_t clock)
+   {
+      struct timespec ts;
+      clock_gettime(clock, &ts);
+      return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+   }
+
+   // Background thread that sums FeedErrorStats every interval and publishes
+   // the snapshot to the POSIX shared-memory object name (e.g. /zeus_stats).
+   // The feed threads are never touched; a monitor maps the same object with
+   // FeedStatsReader.
+   class FeedStatsPublisher
+   {
+   public:
+      FeedStatsPublisher(const std::string &name, uint32_t interval_ms = FEEDSTATSINTERVALMS)
+          : name_(name), interval_ms_(interval_ms == 0 ? 1 : interval_ms), region_(0), thread_(0),
+            exit_(false), last_(), last_nanos_(0)
+      {
+      }
+
+      ~FeedStatsPublisher()
+      {
+         stop();
+      }
+
+      bool start()
+      {
+         int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+         if (fd < 0)
+         {
+            fprintf(stderr, "Unable to create shared memory %s.\n", name_.c_str());
+            return false;
+         }
+         if (ftruncate(fd, sizeof(FeedStatsRegion)) != 0)
+         {
+            fprintf(stderr, "Unable to size shared memory %s.\n", name_.c_str());
+            close(fd);
+            return false;
+         }
+         void *memory = mmap(0, sizeof(FeedStatsRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+         close(fd);
+         if (memory == MAP_FAILED)
+         {
+            fprintf(stderr, "Unable to map shared memory %s.\n", name_.c_str());
+            return false;
+         }
+
+         region_ = new (memory) FeedStatsRegion();
+         region_->sequence_.store(0, std::memory_order_relaxed);
+         memset(&region_->snapshot_, 0, sizeof(region_->snapshot_));
+         region_->counter_count_ = eFE_Count;
+         region_->snapshot_size_ = sizeof(FeedStatsSnapshot);
+         std::atomic_thread_fence(std::memory_order_release);
+         region_->magic_ = FEEDSTATSMAGIC;
+
+         FeedErrorStats::totals(last_);
+         last_nanos_ = clockNanos(CLOCK_MONOTONIC);
+         thread_ = new std::thread(&FeedStatsPublisher::run, this);
+         return true;
+      }
+
+      // Publishes a final snapshot, then unmaps and removes the object.
+      void stop()
+      {
+         if (thread_ != 0)
+         {
+            {
+               std::lock_guard<std::mutex> lock(mutex_);
+               exit_ = true;
+            }
+            wake_.notify_one();
+            thread_->join();
+            delete thread_;
+            thread_ = 0;
+         }
+         if (region_ != 0)
+         {
+            munmap(region_, sizeof(FeedStatsRegion));
+            shm_unlink(name_.c_str());
+            region_ = 0;
+         }
+      }
+
+      void publish()
+      {
+         uint64_t now = clockNanos(CLOCK_MONOTONIC);
+         FeedErrorTotals current;
+         FeedErrorStats::totals(current);
+
+         uint64_t sequence = region_->sequence_.load(std::memory_order_relaxed);
+         region_->sequence_.store(sequence + 1, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_release);
+
+         FeedStatsSnapshot &snapshot = region_->snapshot_;
+         snapshot.publish_count_ += 1;
+         snapshot.wall_nanos_ = clockNanos(CLOCK_REALTIME);
+         snapshot.interval_nanos_ = now - last_nanos_;
+         for (uint32_t counter = 0; counter < eFE_Count; ++counter)
+         {
+            snapshot.totals_[counter] = current.counters_[counter];
+            snapshot.deltas_[counter] = current.counters_[counter] - last_.counters_[counter];
+            snapshot.rates_[counter] = snapshot.interval_nanos_ != 0
+                                           ? snapshot.deltas_[counter] * 1e9 / snapshot.interval_nanos_
+                                           : 0;
+         }
+
+         region_->sequence_.store(sequence + 2, std::memory_order_release);
+         last_ = current;
+         last_nanos_ = now;
+      }
+
+   private:
+      FeedStatsPublisher(const FeedStatsPublisher &);
+      FeedStatsPublisher &operator=(const FeedStatsPublisher &);
+
+      void run()
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         while (!exit_)
+         {
+            wake_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+            publish();
+         }
+      }
+
+      std::string name_;
+      uint32_t interval_ms_;
+      FeedStatsRegion *region_;
+      std::thread *thread_;
+      std::mutex mutex_;
+      std::condition_variable wake_;
+      bool exit_;
+      FeedErrorTotals last_;
+      uint64_t last_nanos_;
+   };
+
+   // Read-only view of a publisher's region for an external monitor.
+   class FeedStatsReader
+   {
+   public:
+      FeedStatsReader() : region_(0) {}
+
+      ~FeedStatsReader()
+      {
+         detach();
+      }
+
+      bool attach(const std::string &name)
+      {
+         detach();
+         int fd = shm_open(name.c_str(), O_RDONLY, 0);
+         if (fd < 0)
+            return false;
+         void *memory = mmap(0, sizeof(FeedStatsRegion), PROT_READ, MAP_SHARED, fd, 0);
+         close(fd);
+         if (memory == MAP_FAILED)
+            return false;
+
+         region_ = (const FeedStatsRegion *)memory;
+         if (region_->magic_ != FEEDSTATSMAGIC || region_->counter_count_ != eFE_Count ||
+             region_->snapshot_size_ != sizeof(FeedStatsSnapshot))
+         {
+            fprintf(stderr, "Shared memory %s is not a compatible feed statistics region.\n", name.c_str());
+            detach();
+            return false;
+         }
+         return true;
+      }
+
+      void detach()
+      {
+         if (region_ != 0)
+         {
+            munmap((void *)region_, sizeof(FeedStatsRegion));
+            region_ = 0;
+         }
+      }
+
+      // Copies a consistent snapshot; false if nothing has been published.
+      bool read(FeedStatsSnapshot &snapshot) const
+      {
+         while (1)
+         {
+            uint64_t before = region_->sequence_.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+               cpuRelax();
+               continue;
+            }
+            memcpy(&snapshot, (const void *)&region_->snapshot_, sizeof(snapshot));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (region_->sequence_.load(std::memory_order_relaxed) == before)
+               return before != 0;
+         }
+      }
+
+   private:
+      FeedStatsReader(const FeedStatsReader &);
+      FeedStatsReader &operator=(const FeedStatsReader &);
+
+      const FeedStatsRegion *region_;
+   };
+
+}
+
+#endif
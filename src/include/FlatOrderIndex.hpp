@@ -0,0 +1,180 @@
+#pragma once
+
+#ifndef __FLATORDERINDEX__
+#define __FLATORDERINDEX__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Open-addressing order index using Robin Hood linear probing.  Each slot
+   // stores its probe distance (0 marks an empty slot), which lets lookups
+   // stop early and lets erase shift the following run back by one instead
+   // of leaving tombstones.
+   template <typename ORDERIDTYPE, typename ORDERTYPE>
+   class FlatOrderIndex
+   {
+   public:
+      FlatOrderIndex(uint32_t capacity = FLATINDEXSIZE)
+          : slots_(0), mask_(0), shift_(0), size_(0)
+      {
+         uint32_t slots = 8;
+         while (slots < capacity)
+            slots *= 2;
+         allocate(slots);
+      }
+
+      ~FlatOrderIndex()
+      {
+         delete[] slots_;
+      }
+
+      ORDERTYPE *find(ORDERIDTYPE id) const
+      {
+         uint32_t index = slotFor(id);
+         for (uint32_t distance = 1;; ++distance)
+         {
+            const Slot &slot = slots_[index];
+            if (slot.distance_ < distance)
+               return 0;
+            if (slot.id_ == id)
+               return slot.order_;
+            index = (index + 1) & mask_;
+         }
+      }
+
+      void insert(ORDERIDTYPE id, ORDERTYPE *order)
+      {
+         if (UNLIKELY((size_ + 1) * 8 > (mask_ + 1) * 7))
+            grow();
+
+         Slot entry;
+         entry.id_ = id;
+         entry.order_ = order;
+         entry.distance_ = 1;
+
+         uint32_t index = slotFor(id);
+         while (1)
+         {
+            Slot &slot = slots_[index];
+            if (slot.distance_ == 0)
+            {
+               slot = entry;
+               ++size_;
+               return;
+            }
+            if (slot.id_ == id)
+            {
+               slot.order_ = order;
+               return;
+            }
+            if (slot.distance_ < entry.distance_)
+            {
+               Slot displaced = slot;
+               slot = entry;
+               entry = displaced;
+            }
+            index = (index + 1) & mask_;
+            ++entry.distance_;
+         }
+      }
+
+      void erase(ORDERIDTYPE id)
+      {
+         uint32_t index = slotFor(id);
+         for (uint32_t distance = 1;; ++distance)
+         {
+            Slot &slot = slots_[index];
+            if (slot.distance_ < distance)
+               return;
+            if (slot.id_ == id)
+               break;
+            index = (index + 1) & mask_;
+         }
+
+         uint32_t next = (index + 1) & mask_;
+         while (slots_[next].distance_ > 1)
+         {
+            slots_[index] = slots_[next];
+            --slots_[index].distance_;
+            index = next;
+            next = (next + 1) & mask_;
+         }
+         slots_[index].distance_ = 0;
+         --size_;
+      }
+
+      bool empty() const { return size_ == 0; }
+      size_t size() const { return size_; }
+
+      template <typename FUNC>
+      void forEach(FUNC func)
+      {
+         for (uint32_t i = 0; i <= mask_; ++i)
+         {
+            if (slots_[i].distance_ != 0)
+               func(slots_[i].order_);
+         }
+      }
+
+      void clear()
+      {
+         memset(slots_, 0, sizeof(Slot) * (mask_ + 1));
+         size_ = 0;
+      }
+
+   private:
+      FlatOrderIndex(const FlatOrderIndex &);
+      FlatOrderIndex &operator=(const FlatOrderIndex &);
+
+      struct Slot
+      {
+         ORDERIDTYPE id_;
+         uint32_t distance_;
+         ORDERTYPE *order_;
+      };
+
+      inline uint32_t slotFor(ORDERIDTYPE id) const
+      {
+         return (uint32_t)(((uint64_t)id * 0x9E3779B97F4A7C15ULL) >> shift_);
+      }
+
+      void allocate(uint32_t slots)
+      {
+         slots_ = new Slot[slots];
+         memset(slots_, 0, sizeof(Slot) * slots);
+         mask_ = slots - 1;
+         shift_ = 64;
+         while (slots > 1)
+         {
+            slots >>= 1;
+            --shift_;
+         }
+         size_ = 0;
+      }
+
+      void grow()
+      {
+         Slot *old_slots = slots_;
+         uint32_t old_count = mask_ + 1;
+         allocate(old_count * 2);
+         for (uint32_t i = 0; i < old_count; ++i)
+         {
+            if (old_slots[i].distance_ != 0)
+               insert(old_slots[i].id_, old_slots[i].order_);
+         }
+         delete[] old_slots;
+      }
+
+      Slot *slots_;
+      uint32_t mask_;
+      uint32_t shift_;
+      uint32_t size_;
+   };
+
+}
+
+#endif
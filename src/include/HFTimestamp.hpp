@@ -4,8 +4,8 @@
 #define __HFTIMESTAMP__
 
 #include <stdint.h>
-#include <unistd.h>
 
+#include "TscClock.hpp"
 #include "Utils.hpp"
 
 namespace zeus_core
@@ -14,41 +14,27 @@ namespace zeus_core
    {
    public:
       HFTimestamp()
-          : start_(0)
+          : clock_(TscClock::instance()), start_(0)
       {
-         int64_t start = RDTSC();
-         usleep(250000);
-         int64_t end = RDTSC();
-         int64_t duration = end - start;
-
-         uint32_t ticks_sec = duration * 4;
-         fprintf(stderr, "Ticks/sec: %u.  MHz: %f\n", ticks_sec, ticks_sec / 1000000.0f);
-         hz_ = ticks_sec;
       }
 
       inline void start()
       {
-         start_ = RDTSC();
+         start_ = clock_.start();
       }
 
       inline uint64_t stop()
       {
          if (UNLIKELY(start_ == 0))
             return 0;
-         uint64_t nano = ((RDTSC() - start_) * 1000000000) / hz_;
+         uint64_t nano = clock_.toNanos(clock_.stop() - start_);
          start_ = 0;
          return nano;
       }
 
    private:
-      inline int64_t RDTSC()
-      {
-         static uint32_t hi, lo;
-         __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
-         return ((uint64_t)lo) | (((uint64_t)hi) << 32);
-      }
+      const TscClock &clock_;
       uint64_t start_;
-      uint64_t hz_;
    };
 
 }
@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef __HASHORDERINDEX__
+#define __HASHORDERINDEX__
+
+#include <unordered_map>
+
+namespace zeus_core
+{
+   template <typename ORDERIDTYPE, typename ORDERTYPE>
+   class HashOrderIndex
+   {
+   public:
+      typedef std::unordered_map<ORDERIDTYPE, ORDERTYPE *> OrderHash;
+
+      HashOrderIndex() : orders_() {}
+
+      ORDERTYPE *find(ORDERIDTYPE id) const
+      {
+         typename OrderHash::const_iterator it = orders_.find(id);
+         if (it == orders_.end())
+            return 0;
+         return it->second;
+      }
+
+      void insert(ORDERIDTYPE id, ORDERTYPE *order)
+      {
+         orders_[id] = order;
+      }
+
+      void erase(ORDERIDTYPE id)
+      {
+         orders_.erase(id);
+      }
+
+      bool empty() const { return orders_.empty(); }
+      size_t size() const { return orders_.size(); }
+
+      template <typename FUNC>
+      void forEach(FUNC func)
+      {
+         for (typename OrderHash::iterator it = orders_.begin(); it != orders_.end(); ++it)
+         {
+            func(it->second);
+         }
+      }
+
+      void clear()
+      {
+         orders_.clear();
+      }
+
+   private:
+      OrderHash orders_;
+   };
+
+}
+
+#endif
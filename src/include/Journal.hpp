@@ -0,0 +1,386 @@
+#pragma once
+
+#ifndef __JOURNAL__
+#define __JOURNAL__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BinaryFeed.hpp"
+#include "SpscRing.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   static const uint64_t JOURNALFILEMAGIC = 0x314C4E524A535A5AULL;
+   static const uint64_t SNAPSHOTFILEMAGIC = 0x3150414E53535A5AULL;
+   static const uint32_t JOURNALFILEVERSION = 2;
+
+   // Book state kept under a path prefix: <path>.snapshot holds every book
+   // as of one source message and <path>.journal every message applied
+   // after it, as binary feed records.  Each snapshot starts a new epoch and
+   // empties the journal, which carries the epoch of the snapshot it
+   // follows, so a journal left behind by a crash between the two writes is
+   // never replayed onto the wrong snapshot.
+#pragma pack(push, 1)
+   struct JournalFileHeader
+   {
+      uint64_t magic_;
+      uint32_t version_;
+      uint32_t record_size_;
+      uint64_t epoch_;
+   };
+
+   // Followed by symbols_ FeedSymbolRecords for symbol IDs 1 upwards, then
+   // books_ SnapshotBooks, each followed by its orders.
+   struct SnapshotFileHeader
+   {
+      uint64_t magic_;
+      uint32_t version_;
+      uint32_t order_size_;
+      uint64_t epoch_;
+      uint64_t sequence_;
+      uint32_t symbols_;
+      uint32_t books_;
+   };
+
+   struct SnapshotBook
+   {
+      uint32_t symbol_id_;
+      uint32_t orders_;
+      uint64_t last_trade_price_;
+      uint32_t last_trade_quantity_;
+      uint32_t reserved_;
+   };
+
+   // Orders are stored bids then asks, best level first and oldest first
+   // within a level, so adding them back in file order rebuilds time
+   // priority.
+   struct SnapshotOrder
+   {
+      uint32_t order_id_;
+      uint32_t price_;
+      uint32_t quantity_;
+      uint32_t display_quantity_;
+      uint32_t hidden_quantity_;
+      uint8_t side_;
+      uint8_t flags_;
+      uint8_t reserved_[2];
+   };
+#pragma pack(pop)
+
+   inline std::string journalPath(const std::string &path) { return path + ".journal"; }
+   inline std::string snapshotPath(const std::string &path) { return path + ".snapshot"; }
+
+   // Returns the header of a mapped snapshot, or 0 with a message if it is
+   // not one this build can read.
+   inline const SnapshotFileHeader *snapshotFileHeader(const char *data, size_t size)
+   {
+      const SnapshotFileHeader *header = (const SnapshotFileHeader *)data;
+      if (size < sizeof(SnapshotFileHeader) || header->magic_ != SNAPSHOTFILEMAGIC)
+      {
+         fprintf(stderr, "Not a book snapshot file.\n");
+         return 0;
+      }
+      if (header->version_ != JOURNALFILEVERSION || header->order_size_ != sizeof(SnapshotOrder))
+      {
+         fprintf(stderr, "Unsupported book snapshot version %u.\n", header->version_);
+         return 0;
+      }
+      return header;
+   }
+
+   // Returns the header of a mapped journal if it follows the snapshot of
+   // epoch, otherwise 0.
+   inline const JournalFileHeader *journalFileHeader(const char *data, size_t size, uint64_t epoch)
+   {
+      const JournalFileHeader *header = (const JournalFileHeader *)data;
+      if (size < sizeof(JournalFileHeader) || header->magic_ != JOURNALFILEMAGIC ||
+          header->version_ != JOURNALFILEVERSION || header->record_size_ != sizeof(FeedRecord) ||
+          header->epoch_ != epoch)
+         return 0;
+      return header;
+   }
+
+   // Journal of applied messages.  The book thread only copies each record
+   // into a ring; a background thread drains whatever has queued, writes it
+   // with one write() and makes it durable with one fdatasync(), so the
+   // sync cost is shared by every record that arrived while the previous
+   // one ran (group commit).  Snapshots pass through the
+   // same ring, so the journal is emptied exactly at the message the
+   // snapshot was taken after.
+   class Journal
+   {
+   public:
+      Journal(const std::string &path, WaitStrategy wait_strategy = eWS_SpinYield)
+          : path_(path), fd_(-1), exit_(false), thread_(0), ring_(JOURNALRINGSLOTS, wait_strategy), group_(),
+            group_records_(0), group_sequence_(0), epoch_(0), failed_(false), durable_sequence_(0), records_(0),
+            commits_(0), snapshots_(0)
+      {
+         group_.resize((size_t)JOURNALGROUPRECORDS * sizeof(FeedRecord));
+      }
+
+      ~Journal()
+      {
+         stop();
+         if (fd_ >= 0)
+            close(fd_);
+      }
+
+      // The ring's cache-line alignment is beyond what new guarantees.
+      static Journal *create(const std::string &path, WaitStrategy wait_strategy = eWS_SpinYield)
+      {
+         void *memory = 0;
+         if (posix_memalign(&memory, alignof(Journal), sizeof(Journal)) != 0)
+            throw std::bad_alloc();
+         return new (memory) Journal(path, wait_strategy);
+      }
+
+      static void destroy(Journal *journal)
+      {
+         if (journal == 0)
+            return;
+         journal->~Journal();
+         free(journal);
+      }
+
+      // Writes image as the first snapshot, starts an empty journal after it
+      // and starts the writer thread.  Takes ownership of image.
+      bool start(std::vector<char> *image)
+      {
+         fd_ = open(journalPath(path_).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+         if (fd_ < 0)
+         {
+            fprintf(stderr, "Unable to open journal %s: %s\n", journalPath(path_).c_str(), strerror(errno));
+            delete image;
+            return false;
+         }
+         bool written = writeSnapshot(*image);
+         delete image;
+         if (!written)
+            return false;
+         thread_ = new std::thread(std::bind(&Journal::runWriter, this));
+         return true;
+      }
+
+      void append(const FeedRecord &record)
+      {
+         ring_.write(eJM_Record, &record, sizeof(record), eFP_Block);
+      }
+
+      // Queues image, built after every record appended so far, to replace
+      // the snapshot.  Takes ownership of image.
+      void snapshot(std::vector<char> *image)
+      {
+         ring_.write(eJM_Snapshot, &image, sizeof(image), eFP_Block);
+      }
+
+      // Commits everything queued and stops the writer thread.
+      void stop()
+      {
+         if (thread_ == 0)
+            return;
+
+         exit_ = true;
+         ring_.wake();
+         thread_->join();
+         delete thread_;
+         thread_ = 0;
+      }
+
+      // Sequence of the last record known to be on disk.
+      uint64_t durableSequence() const { return durable_sequence_.load(std::memory_order_acquire); }
+
+      // Epoch for the next snapshot: unique across restarts, and increasing.
+      uint64_t nextEpoch()
+      {
+         uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+         epoch_ = now > epoch_ ? now : epoch_ + 1;
+         return epoch_;
+      }
+
+      void printStatistics() const
+      {
+         uint64_t records = records_.load(std::memory_order_relaxed);
+         uint64_t commits = commits_.load(std::memory_order_relaxed);
+         fprintf(stderr, "\n[Journal Statistics]\n");
+         fprintf(stderr, "   %-30s %10lu\n", "Journal Records:", records);
+         fprintf(stderr, "   %-30s %10lu\n", "Group Commits:", commits);
+         fprintf(stderr, "   %-30s %10.1f\n", "Records per Commit:", commits != 0 ? (double)records / commits : 0.0);
+         fprintf(stderr, "   %-30s %10lu\n", "Snapshots:", snapshots_.load(std::memory_order_relaxed));
+         fprintf(stderr, "   %-30s %10lu\n", "Durable Sequence:", durableSequence());
+      }
+
+   private:
+      Journal(const Journal &);
+      Journal &operator=(const Journal &);
+
+      enum JournalMessage
+      {
+         eJM_Record = 1,
+         eJM_Snapshot = 2
+      };
+
+      void runWriter()
+      {
+         while (1)
+         {
+            uint32_t drained = ring_.drain([this](uint32_t type, const char *data, uint32_t len) {
+               writeMessage(type, data, len);
+            }, JOURNALGROUPRECORDS);
+            if (drained != 0)
+            {
+               commit();
+               continue;
+            }
+            if (exit_ == true)
+            {
+               while (ring_.drain([this](uint32_t type, const char *data, uint32_t len) {
+                  writeMessage(type, data, len);
+               }, JOURNALGROUPRECORDS) != 0)
+               {
+                  commit();
+               }
+               return;
+            }
+            ring_.wait();
+         }
+      }
+
+      void writeMessage(uint32_t type, const char *data, uint32_t)
+      {
+         if (type == eJM_Snapshot)
+         {
+            std::vector<char> *image = *(std::vector<char> *const *)data;
+            commit();
+            writeSnapshot(*image);
+            delete image;
+            return;
+         }
+
+         memcpy(&group_[(size_t)group_records_ * sizeof(FeedRecord)], data, sizeof(FeedRecord));
+         group_sequence_ = ((const FeedRecord *)data)->sequence_;
+         if (++group_records_ == JOURNALGROUPRECORDS)
+            commit();
+      }
+
+      // One write and one sync for the whole group.
+      void commit()
+      {
+         if (group_records_ == 0)
+            return;
+         if (!failed_ && (!writeAll(&group_[0], (size_t)group_records_ * sizeof(FeedRecord)) || fdatasync(fd_) != 0))
+            fail("write journal");
+         records_.store(records_.load(std::memory_order_relaxed) + group_records_, std::memory_order_relaxed);
+         commits_.store(commits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+         if (!failed_)
+            durable_sequence_.store(group_sequence_, std::memory_order_release);
+         group_records_ = 0;
+      }
+
+      // The new snapshot is made durable and renamed over the old one before
+      // the journal is emptied, so a crash in between leaves the new
+      // snapshot and a journal from the old epoch, which recovery ignores.
+      bool writeSnapshot(std::vector<char> &image)
+      {
+         if (failed_)
+            return false;
+         uint64_t epoch = ((SnapshotFileHeader *)&image[0])->epoch_;
+         std::string snapshot_path = snapshotPath(path_);
+         std::string temporary_path = snapshot_path + ".tmp";
+         int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+         if (fd < 0)
+            return fail("create snapshot");
+         bool written = writeAll(fd, &image[0], image.size()) && fdatasync(fd) == 0;
+         close(fd);
+         if (!written || rename(temporary_path.c_str(), snapshot_path.c_str()) != 0)
+            return fail("write snapshot");
+         syncDirectory();
+
+         JournalFileHeader header;
+         header.magic_ = JOURNALFILEMAGIC;
+         header.version_ = JOURNALFILEVERSION;
+         header.record_size_ = sizeof(FeedRecord);
+         header.epoch_ = epoch;
+         if (ftruncate(fd_, 0) != 0 || !writeAll(&header, sizeof(header)) || fdatasync(fd_) != 0)
+            return fail("reset journal");
+         snapshots_.store(snapshots_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+         return true;
+      }
+
+      // Makes the snapshot rename durable.
+      void syncDirectory()
+      {
+         size_t slash = path_.rfind('/');
+         std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path_.substr(0, slash));
+         int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+         if (fd < 0)
+            return;
+         fsync(fd);
+         close(fd);
+      }
+
+      bool writeAll(const void *data, size_t len) { return writeAll(fd_, data, len); }
+
+      static bool writeAll(int fd, const void *data, size_t len)
+      {
+         const char *position = (const char *)data;
+         while (len > 0)
+         {
+            ssize_t written = write(fd, position, len);
+            if (written < 0)
+            {
+               if (errno == EINTR)
+                  continue;
+               return false;
+            }
+            position += written;
+            len -= written;
+         }
+         return true;
+      }
+
+      // Stops journaling after the first I/O error rather than leave a
+      // journal with a gap in it.
+      bool fail(const char *what)
+      {
+         if (!failed_)
+            fprintf(stderr, "Unable to %s for %s: %s.  Journaling stopped.\n", what, path_.c_str(), strerror(errno));
+         failed_ = true;
+         return false;
+      }
+
+      std::string path_;
+      int fd_;
+      std::atomic<bool> exit_;
+      std::thread *thread_;
+      SpscRing ring_;
+      std::vector<char> group_;
+      uint32_t group_records_;
+      uint64_t group_sequence_;
+      uint64_t epoch_;
+      bool failed_;
+      std::atomic<uint64_t> durable_sequence_;
+      std::atomic<uint64_t> records_;
+      std::atomic<uint64_t> commits_;
+      std::atomic<uint64_t> snapshots_;
+   };
+
+}
+
+#endif
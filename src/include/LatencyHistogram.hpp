@@ -0,0 +1,149 @@
+#pragma once
+
+#ifndef __LATENCYHISTOGRAM__
+#define __LATENCYHISTOGRAM__
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // HDR-style log-linear histogram.  Values below 2^HISTOGRAMSUBBITS are
+   // counted exactly; above that every power of two is split into
+   // 2^(HISTOGRAMSUBBITS - 1) equal buckets, so a recorded value is known to
+   // within 1 part in 512.  Values above 2^HISTOGRAMMAXBITS share the top
+   // bucket.  Memory is fixed at construction and record() is O(1).
+   class LatencyHistogram
+   {
+   public:
+      enum
+      {
+         SUB_BUCKETS = 1 << HISTOGRAMSUBBITS,
+         HALF_BUCKETS = SUB_BUCKETS / 2,
+         BUCKETS = (HISTOGRAMMAXBITS - HISTOGRAMSUBBITS + 2) * HALF_BUCKETS
+      };
+
+      LatencyHistogram()
+          : counts_(BUCKETS, 0), total_(0), sum_(0), min_(UINT64_MAX), max_(0)
+      {
+      }
+
+      void record(uint64_t value)
+      {
+         ++counts_[indexFor(value)];
+         ++total_;
+         sum_ += value;
+         if (value < min_)
+            min_ = value;
+         if (value > max_)
+            max_ = value;
+      }
+
+      void merge(const LatencyHistogram &other)
+      {
+         for (uint32_t i = 0; i < BUCKETS; ++i)
+         {
+            counts_[i] += other.counts_[i];
+         }
+         total_ += other.total_;
+         sum_ += other.sum_;
+         if (other.min_ < min_)
+            min_ = other.min_;
+         if (other.max_ > max_)
+            max_ = other.max_;
+      }
+
+      // Moves everything recorded since the last snapshot into interval and
+      // starts a new interval.
+      void snapshot(LatencyHistogram &interval)
+      {
+         interval.reset();
+         interval.counts_.swap(counts_);
+         interval.total_ = total_;
+         interval.sum_ = sum_;
+         interval.min_ = min_;
+         interval.max_ = max_;
+         reset();
+      }
+
+      void reset()
+      {
+         if (total_ != 0)
+            std::fill(counts_.begin(), counts_.end(), 0);
+         total_ = 0;
+         sum_ = 0;
+         min_ = UINT64_MAX;
+         max_ = 0;
+      }
+
+      // Smallest recorded value v such that percent% of the samples are <= v,
+      // reported as the top of its bucket.
+      uint64_t valueAtPercentile(double percent) const
+      {
+         if (total_ == 0)
+            return 0;
+         if (percent > 100.)
+            percent = 100.;
+
+         uint64_t target = (uint64_t)(percent / 100. * total_ + 0.5);
+         if (target == 0)
+            target = 1;
+
+         uint64_t seen = 0;
+         for (uint32_t i = 0; i < BUCKETS; ++i)
+         {
+            seen += counts_[i];
+            if (seen >= target)
+            {
+               uint64_t value = highestValueFor(i);
+               if (value > max_)
+                  value = max_;
+               if (value < min_)
+                  value = min_;
+               return value;
+            }
+         }
+         return max_;
+      }
+
+      uint64_t count() const { return total_; }
+      uint64_t min() const { return total_ == 0 ? 0 : min_; }
+      uint64_t max() const { return max_; }
+      uint64_t mean() const { return total_ == 0 ? 0 : sum_ / total_; }
+
+   private:
+      static uint32_t indexFor(uint64_t value)
+      {
+         if (value < SUB_BUCKETS)
+            return (uint32_t)value;
+
+         uint32_t bucket = 63 - __builtin_clzll(value) - (HISTOGRAMSUBBITS - 1);
+         if (UNLIKELY(bucket > HISTOGRAMMAXBITS - HISTOGRAMSUBBITS))
+            return BUCKETS - 1;
+         return (bucket + 1) * HALF_BUCKETS + (uint32_t)(value >> bucket) - HALF_BUCKETS;
+      }
+
+      static uint64_t highestValueFor(uint32_t index)
+      {
+         if (index < SUB_BUCKETS)
+            return index;
+
+         uint32_t bucket = index / HALF_BUCKETS - 1;
+         uint64_t lowest = (uint64_t)(index % HALF_BUCKETS + HALF_BUCKETS) << bucket;
+         return lowest + ((uint64_t)1 << bucket) - 1;
+      }
+
+      std::vector<uint64_t> counts_;
+      uint64_t total_;
+      uint64_t sum_;
+      uint64_t min_;
+      uint64_t max_;
+   };
+
+}
+
+#endif
@@ -0,0 +1,158 @@
+#pragma once
+
+#ifndef __LEVELPOOL__
+#define __LEVELPOOL__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <vector>
+
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Free-list pool of fixed-size price level nodes, carved from slabs of
+   // LEVELPOOLSIZE.  The node size is fixed by the first acquire(); the free
+   // list is threaded through the free nodes themselves.  Memory goes back
+   // to the heap only when the pool is destroyed.
+   class LevelNodePool
+   {
+   public:
+      LevelNodePool(uint32_t slab_size = LEVELPOOLSIZE)
+          : slabs_(), free_(0), node_size_(0), slab_size_(slab_size == 0 ? 1 : slab_size), capacity_(0), in_use_(0)
+      {
+      }
+
+      ~LevelNodePool()
+      {
+         for (uint32_t i = 0; i < slabs_.size(); ++i)
+         {
+            delete[] slabs_[i];
+         }
+      }
+
+      // Returns 0 if size is not this pool's node size.
+      void *acquire(size_t size)
+      {
+         if (UNLIKELY(node_size_ == 0))
+            node_size_ = roundSize(size);
+         else if (UNLIKELY(roundSize(size) != node_size_))
+            return 0;
+
+         if (UNLIKELY(free_ == 0))
+            addSlab();
+         FreeNode *node = free_;
+         free_ = node->next_;
+         ++in_use_;
+         return node;
+      }
+
+      bool owns(size_t size) const { return node_size_ != 0 && roundSize(size) == node_size_; }
+
+      void release(void *memory)
+      {
+         FreeNode *node = (FreeNode *)memory;
+         node->next_ = free_;
+         free_ = node;
+         --in_use_;
+      }
+
+      uint32_t capacity() const { return capacity_; }
+      uint32_t inUse() const { return in_use_; }
+
+   private:
+      LevelNodePool(const LevelNodePool &);
+      LevelNodePool &operator=(const LevelNodePool &);
+
+      struct FreeNode
+      {
+         FreeNode *next_;
+      };
+
+      static size_t roundSize(size_t size)
+      {
+         const size_t align = alignof(max_align_t);
+         if (size < sizeof(FreeNode))
+            size = sizeof(FreeNode);
+         return (size + align - 1) & ~(align - 1);
+      }
+
+      void addSlab()
+      {
+         char *slab = new char[node_size_ * slab_size_];
+         for (uint32_t i = 0; i < slab_size_; ++i)
+         {
+            FreeNode *node = (FreeNode *)(slab + i * node_size_);
+            node->next_ = free_;
+            free_ = node;
+         }
+         slabs_.push_back(slab);
+         capacity_ += slab_size_;
+      }
+
+      std::vector<char *> slabs_;
+      FreeNode *free_;
+      size_t node_size_;
+      uint32_t slab_size_;
+      uint32_t capacity_;
+      uint32_t in_use_;
+   };
+
+   // Standard allocator over a LevelNodePool, so a node-based container's
+   // single-node allocations come from the pool.  Anything else (arrays, or
+   // a second node type) falls back to operator new.
+   template <typename T>
+   class LevelPoolAllocator
+   {
+   public:
+      typedef T value_type;
+
+      explicit LevelPoolAllocator(LevelNodePool *pool) : pool_(pool) {}
+
+      template <typename U>
+      LevelPoolAllocator(const LevelPoolAllocator<U> &other) : pool_(other.pool())
+      {
+      }
+
+      T *allocate(size_t count)
+      {
+         if (count == 1)
+         {
+            void *memory = pool_->acquire(sizeof(T));
+            if (LIKELY(memory != 0))
+               return (T *)memory;
+         }
+         return (T *)::operator new(count * sizeof(T));
+      }
+
+      void deallocate(T *memory, size_t count)
+      {
+         if (count == 1 && pool_->owns(sizeof(T)))
+            pool_->release(memory);
+         else
+            ::operator delete(memory);
+      }
+
+      LevelNodePool *pool() const { return pool_; }
+
+   private:
+      LevelNodePool *pool_;
+   };
+
+   template <typename T, typename U>
+   inline bool operator==(const LevelPoolAllocator<T> &lhs, const LevelPoolAllocator<U> &rhs)
+   {
+      return lhs.pool() == rhs.pool();
+   }
+
+   template <typename T, typename U>
+   inline bool operator!=(const LevelPoolAllocator<T> &lhs, const LevelPoolAllocator<U> &rhs)
+   {
+      return lhs.pool() != rhs.pool();
+   }
+
+}
+
+#endif
@@ -3,104 +3,237 @@
 #ifndef __LOGGER__
 #define __LOGGER__
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <atomic>
-#include <chrono>
 #include <functional>
-#include <iostream>
-#include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
 
+#include "MessageTrace.hpp"
+#include "SpscRing.hpp"
+#include "ThreadPlacement.hpp"
+#include "Utils.hpp"
+
 #define TRUE 1
 
+enum LoggerRecordType
+{
+   eLR_Text
+};
+
+enum LoggerOutputMode
+{
+   eLO_Text,
+   eLO_Binary
+};
+
+// Renders a binary record as text on the logger thread, appending to a
+// buffer grown with growBuffer().
+typedef void (*EventFormatter)(const char *data, uint32_t len, char *&buffer, int &index, int &max_buffer);
+
+struct LoggerOptions
+{
+   LoggerOptions()
+       : ring_slots_(LOGGERRINGSLOTS), wait_strategy_(zeus_core::eWS_SpinYield), full_policy_(zeus_core::eFP_Block),
+         output_mode_(eLO_Text), binary_path_(), cpu_(-1)
+   {
+   }
+
+   uint32_t ring_slots_;
+   zeus_core::WaitStrategy wait_strategy_;
+   zeus_core::FullPolicy full_policy_;
+   LoggerOutputMode output_mode_;
+   std::string binary_path_;
+   int cpu_;
+};
+
 class Logger
 {
 public:
-   Logger()
-       : exit_(false), messages_available_(false), thread_(0), messages_(), mutex_()
+   Logger(const LoggerOptions &options = LoggerOptions())
+       : exit_(false), thread_(0), options_(options), ring_(options.ring_slots_, options.wait_strategy_),
+         formatter_(0), trace_(0), binary_file_(0), batch_(0), batch_len_(0), batch_max_(LOGGERBATCHSIZE)
    {
+      batch_ = (char *)calloc(batch_max_, sizeof(char));
+      if (options_.output_mode_ == eLO_Binary)
+      {
+         binary_file_ = fopen(options_.binary_path_.c_str(), "wb");
+         if (binary_file_ == NULL)
+         {
+            fprintf(stderr, "Unable to open binary output file %s.  Falling back to text output.\n", options_.binary_path_.c_str());
+            options_.output_mode_ = eLO_Text;
+         }
+      }
    }
 
    ~Logger()
+   {
+      stopLogger();
+      if (binary_file_ != 0)
+         fclose(binary_file_);
+      free(batch_);
+   }
+
+   void stopLogger()
    {
       if (thread_ == 0)
          return;
 
       exit_ = true;
+      ring_.wake();
       thread_->join();
       delete thread_;
       thread_ = 0;
    }
 
-   void stopLogger()
+   void setEventFormatter(EventFormatter formatter)
    {
-      exit_ = true;
-      thread_->join();
-      delete thread_;
-      thread_ = 0;
+      formatter_ = formatter;
+   }
+
+   // Must be set before the first print; the logger thread stamps write
+   // times into trace from then on.
+   void setTrace(zeus_core::MessageTrace *trace)
+   {
+      trace_ = trace;
+   }
+
+   void print(const char *msg)
+   {
+      print(msg, strlen(msg));
+   }
+
+   void print(const char *msg, size_t len)
+   {
+      if (thread_ == 0)
+      {
+         init();
+      }
+
+      while (len > 0)
+      {
+         uint32_t chunk = len > LOGGERMAXRECORD ? LOGGERMAXRECORD : len;
+         if (!ring_.write(eLR_Text, msg, chunk, options_.full_policy_))
+            return;
+         msg += chunk;
+         len -= chunk;
+      }
    }
 
-   void print(std::string msg)
+   // Reserves len bytes for a binary record written in place by the caller.
+   // Returns 0 if the record was dropped; otherwise publish() must follow.
+   char *claim(uint32_t type, uint32_t len)
    {
       if (thread_ == 0)
       {
          init();
       }
+      return ring_.claim(type, len, options_.full_policy_);
+   }
 
-      std::lock_guard<std::mutex> lock(mutex_);
-      messages_.push(msg);
-      messages_available_ = true;
+   void publish()
+   {
+      ring_.publish();
    }
 
    void runLogger()
    {
+      zeus_core::pinThread(options_.cpu_, "logger");
       while (1)
       {
-         if (messages_available_ == true)
+         uint32_t drained = drainMessages();
+         if (drained == 0)
          {
-            copyMessages();
-            printMessages();
-         }
-         if (exit_ == true)
-         {
-            copyMessages();
-            printMessages();
-            return;
+            if (exit_ == true)
+            {
+               drainMessages();
+               if (binary_file_ != 0)
+                  fflush(binary_file_);
+               return;
+            }
+            ring_.wait();
          }
       }
    }
 
-private:
-   void copyMessages()
+   uint64_t fullEvents() const { return ring_.fullEvents(); }
+   uint64_t dropped() const { return ring_.dropped(); }
+
+   void printStatistics() const
    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      while (messages_.size() != 0)
-      {
-         messages_to_print_.push(messages_.front());
-         messages_.pop();
-      }
-      messages_available_ = false;
+      fprintf(stderr, "\n[Logger Statistics]\n");
+      fprintf(stderr, "   %-30s %10lu\n", "Queue Full Events:", fullEvents());
+      fprintf(stderr, "   %-30s %10lu\n", "Dropped Messages:", dropped());
    }
+
+private:
+   Logger(const Logger &);
+   Logger &operator=(const Logger &);
+
    void init()
    {
       thread_ = new std::thread(std::bind(&Logger::runLogger, this));
    }
-   void printMessages()
+
+   uint32_t drainMessages()
    {
-      while (messages_to_print_.size() != 0)
+      uint32_t drained = ring_.drain([this](uint32_t type, const char *data, uint32_t len) {
+         writeMessage(type, data, len);
+      });
+      flushBatch();
+      return drained;
+   }
+
+   void writeMessage(uint32_t type, const char *data, uint32_t len)
+   {
+      if (type != eLR_Text)
       {
-         fprintf(stderr, "%s", messages_to_print_.front().c_str());
-         messages_to_print_.pop();
+         if (UNLIKELY(trace_ != 0))
+            trace_->recordWrite(data, len);
+         if (binary_file_ != 0)
+         {
+            fwrite(data, 1, len, binary_file_);
+            if (UNLIKELY(trace_ != 0))
+               trace_->flushWrites();
+         }
+         else if (formatter_ != 0)
+            formatter_(data, len, batch_, batch_len_, batch_max_);
+      }
+      else
+      {
+         if (batch_len_ + len > (uint32_t)batch_max_)
+            flushBatch();
+         memcpy(&batch_[batch_len_], data, len);
+         batch_len_ += len;
       }
+
+      if (batch_len_ >= LOGGERBATCHSIZE)
+         flushBatch();
+   }
+
+   void flushBatch()
+   {
+      if (batch_len_ == 0)
+         return;
+      fwrite(batch_, 1, batch_len_, stderr);
+      batch_len_ = 0;
+      if (UNLIKELY(trace_ != 0))
+         trace_->flushWrites();
    }
 
    std::atomic<bool> exit_;
-   std::atomic<bool> messages_available_;
    std::thread *thread_;
-   std::queue<std::string> messages_;
-   std::queue<std::string> messages_to_print_;
-   std::mutex mutex_;
+   LoggerOptions options_;
+   zeus_core::SpscRing ring_;
+   EventFormatter formatter_;
+   zeus_core::MessageTrace *trace_;
+   FILE *binary_file_;
+   char *batch_;
+   int batch_len_;
+   int batch_max_;
 };
 
 #endif
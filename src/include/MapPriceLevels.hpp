@@ -0,0 +1,226 @@
+#pragma once
+
+#ifndef __MAPPRICELEVELS__
+#define __MAPPRICELEVELS__
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "FeedErrorStats.hpp"
+#include "LevelPool.hpp"
+#include "OrderDLList.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Price levels in a std::map whose nodes come from a LevelNodePool.  A
+   // level that empties stays in the map until retention more levels have
+   // emptied after it, so a re-add at a recently used price revives it with
+   // no insert at all; levels that fall out of that window are erased back
+   // to the pool.  Retained levels are empty and invisible to every query
+   // below.
+   template <typename ORDERTYPE, typename PRICE = unsigned long long>
+   class MapPriceLevels
+   {
+   public:
+      typedef CountedOrderList<ORDERTYPE> Level;
+      typedef PRICE Price;
+
+      MapPriceLevels(uint32_t retention = LEVELRETAINCOUNT)
+          : pool_(), levels_(std::less<Price>(), SlotAllocator(&pool_)), level_count_(0),
+            retained_(retention), retained_head_(0), retained_count_(0), empties_(0)
+      {
+      }
+
+      bool empty() const { return level_count_ == 0; }
+
+      Level *findLevel(Price price)
+      {
+         typename LevelMap::iterator it = levels_.find(price);
+         if (it == levels_.end() || it->second.getQuantity() == 0)
+            return 0;
+         return &it->second;
+      }
+
+      Level &addLevel(Price price)
+      {
+         typename LevelMap::iterator it = levels_.lower_bound(price);
+         if (it == levels_.end() || it->first != price)
+         {
+            it = levels_.insert(it, typename LevelMap::value_type(price, LevelSlot()));
+            ++level_count_;
+            FeedErrorStats::instance()->levelAllocated();
+         }
+         else if (it->second.getQuantity() == 0)
+         {
+            ++level_count_;
+            FeedErrorStats::instance()->levelReused();
+         }
+         return it->second;
+      }
+
+      // The level at price must already be empty.
+      void removeLevel(Price price)
+      {
+         typename LevelMap::iterator it = levels_.find(price);
+         --level_count_;
+         if (retained_.empty())
+         {
+            eraseLevel(it);
+            return;
+         }
+
+         // Stamp first, so an older entry for this same level is skipped.
+         it->second.emptied_ = ++empties_;
+         if (retained_count_ == retained_.size())
+            dropOldestRetained();
+         RetainedLevel &retained = retained_[(retained_head_ + retained_count_) % retained_.size()];
+         retained.level_ = it;
+         retained.emptied_ = empties_;
+         ++retained_count_;
+      }
+
+      // How many emptied levels to keep; 0 erases levels as soon as they
+      // empty.
+      void setRetention(uint32_t retention)
+      {
+         while (retained_count_ > 0)
+         {
+            dropOldestRetained();
+         }
+         retained_.assign(retention, RetainedLevel());
+         retained_head_ = 0;
+      }
+
+      Price lowestPrice() const { return lowest()->first; }
+      Price highestPrice() const { return highest()->first; }
+
+      Level *lowestLevel() { return const_cast<LevelSlot *>(&lowest()->second); }
+      Level *highestLevel() { return const_cast<LevelSlot *>(&highest()->second); }
+
+      // Map nodes never move, so Level pointers stay valid until erased.
+      uint32_t relocations() const { return 0; }
+
+      template <typename FUNC>
+      void forEachDescending(FUNC func)
+      {
+         for (typename LevelMap::reverse_iterator it = levels_.rbegin(); it != levels_.rend(); ++it)
+         {
+            if (it->second.getQuantity() != 0)
+               func(it->first, it->second);
+         }
+      }
+
+      // Visits levels best-first for the given side, stopping when func
+      // returns false.
+      template <typename FUNC>
+      void visitFromLowest(FUNC func)
+      {
+         for (typename LevelMap::iterator it = levels_.begin(); it != levels_.end(); ++it)
+         {
+            if (it->second.getQuantity() != 0 && !func(it->first, it->second))
+               return;
+         }
+      }
+
+      template <typename FUNC>
+      void visitFromHighest(FUNC func)
+      {
+         for (typename LevelMap::reverse_iterator it = levels_.rbegin(); it != levels_.rend(); ++it)
+         {
+            if (it->second.getQuantity() != 0 && !func(it->first, it->second))
+               return;
+         }
+      }
+
+      void clear()
+      {
+         for (typename LevelMap::iterator it = levels_.begin(); it != levels_.end(); ++it)
+         {
+            if (it->second.getQuantity() != 0)
+               it->second.clearLevel();
+         }
+         levels_.clear();
+         level_count_ = 0;
+         retained_head_ = 0;
+         retained_count_ = 0;
+      }
+
+      uint32_t levelCount() const { return level_count_; }
+      uint32_t retainedCount() const { return levels_.size() - level_count_; }
+      const LevelNodePool &pool() const { return pool_; }
+
+   private:
+      MapPriceLevels(const MapPriceLevels &);
+      MapPriceLevels &operator=(const MapPriceLevels &);
+
+      // emptied_ stamps when the level last emptied, so an older retained
+      // entry for a level that was revived or emptied again is ignored.
+      struct LevelSlot : public Level
+      {
+         LevelSlot() : emptied_(0) {}
+
+         uint64_t emptied_;
+      };
+
+      typedef LevelPoolAllocator<std::pair<const Price, LevelSlot> > SlotAllocator;
+      typedef std::map<Price, LevelSlot, std::less<Price>, SlotAllocator> LevelMap;
+
+      struct RetainedLevel
+      {
+         RetainedLevel() : level_(), emptied_(0) {}
+
+         typename LevelMap::iterator level_;
+         uint64_t emptied_;
+      };
+
+      // At most retention empty levels sit at either end, so these scans
+      // are bounded.
+      typename LevelMap::const_iterator lowest() const
+      {
+         typename LevelMap::const_iterator it = levels_.begin();
+         while (it->second.getQuantity() == 0)
+         {
+            ++it;
+         }
+         return it;
+      }
+
+      typename LevelMap::const_reverse_iterator highest() const
+      {
+         typename LevelMap::const_reverse_iterator it = levels_.rbegin();
+         while (it->second.getQuantity() == 0)
+         {
+            ++it;
+         }
+         return it;
+      }
+
+      void eraseLevel(typename LevelMap::iterator it)
+      {
+         levels_.erase(it);
+         FeedErrorStats::instance()->levelFreed();
+      }
+
+      void dropOldestRetained()
+      {
+         RetainedLevel &oldest = retained_[retained_head_];
+         if (oldest.level_->second.emptied_ == oldest.emptied_ && oldest.level_->second.getQuantity() == 0)
+            eraseLevel(oldest.level_);
+         retained_head_ = (retained_head_ + 1) % retained_.size();
+         --retained_count_;
+      }
+
+      LevelNodePool pool_;
+      LevelMap levels_;
+      uint32_t level_count_;
+      std::vector<RetainedLevel> retained_;
+      uint32_t retained_head_;
+      uint32_t retained_count_;
+      uint64_t empties_;
+   };
+
+}
+
+#endif
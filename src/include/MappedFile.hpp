@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef __MAPPEDFILE__
+#define __MAPPEDFILE__
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zeus_core
+{
+   // Read-only mapping of a whole file, advised for a single sequential pass.
+   class MappedFile
+   {
+   public:
+      MappedFile() : data_(0), size_(0) {}
+
+      ~MappedFile()
+      {
+         unmap();
+      }
+
+      bool map(int fd, int advice = MADV_SEQUENTIAL)
+      {
+         unmap();
+
+         struct stat st;
+         if (fstat(fd, &st) != 0)
+         {
+            fprintf(stderr, "Unable to stat file for mapping: %s\n", strerror(errno));
+            return false;
+         }
+         if (st.st_size == 0)
+            return true;
+
+         void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (data == MAP_FAILED)
+         {
+            fprintf(stderr, "Unable to map file: %s\n", strerror(errno));
+            return false;
+         }
+         madvise(data, st.st_size, advice);
+
+         data_ = (const char *)data;
+         size_ = st.st_size;
+         return true;
+      }
+
+      void unmap()
+      {
+         if (data_ != 0)
+            munmap((void *)data_, size_);
+         data_ = 0;
+         size_ = 0;
+      }
+
+      const char *data() const { return data_; }
+      size_t size() const { return size_; }
+
+   private:
+      MappedFile(const MappedFile &);
+      MappedFile &operator=(const MappedFile &);
+
+      const char *data_;
+      size_t size_;
+   };
+
+}
+
+#endif
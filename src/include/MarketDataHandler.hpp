@@ -3,13 +3,24 @@
 #ifndef __MARKETDATAHANDLER__
 #define __MARKETDATAHANDLER__
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
 #include <string>
 #include <vector>
 
 #include "HFTimestamp.hpp"
 #include "PerfMetrics.hpp"
+#include "BinaryFeed.hpp"
 #include "Book.hpp"
+#include "Journal.hpp"
+#include "MappedFile.hpp"
+#include "MessageTrace.hpp"
 #include "Parser.hpp"
+#include "SymbolDirectory.hpp"
+#include "TopOfBook.hpp"
 
 #ifdef ENABLE_PROFILING
 #define START()       \
@@ -25,106 +36,960 @@
 #define STOP(y)
 #endif
 
+#define TRACE_STAGE(stage)               \
+   {                                      \
+      if (UNLIKELY(trace_ != 0))          \
+         trace_->stamp(stage);            \
+   }
+
 namespace zeus_core
 {
-   template <typename ORDERIDTYPE, typename ORDERTYPE>
+   template <typename ORDERIDTYPE, typename ORDERTYPE,
+             typename LEVELS = MapPriceLevels<ORDERTYPE>,
+             typename ORDERINDEX = HashOrderIndex<ORDERIDTYPE, ORDERTYPE> >
    class MarketDataHandler
    {
    public:
+      typedef Book<ORDERIDTYPE, ORDERTYPE, LEVELS, ORDERINDEX> BookType;
+
+      MarketDataHandler(uint32_t order_pool_size = ORDERPOOLSIZE, const LoggerOptions &logger_options = LoggerOptions())
+          : order_pool_(order_pool_size), logger_(logger_options), symbols_(), books_(), book_depth_(0), level_retention_(LEVELRETAINCOUNT), parser_(), trace_(0), pending_ingest_(0), top_of_book_(0),
+            decoded_(MESSAGEBATCHSIZE), midpoint_pending_(), pending_books_(), conflate_batches_(false), output_conflation_(), matching_(false), feed_symbols_(1, 0),
+            journal_(0), snapshot_interval_(SNAPSHOTINTERVAL), messages_(0), snapshot_sequence_(0), recovering_(false)
 #ifdef ENABLE_PROFILING
-      MarketDataHandler()
-          : order_book_(), parser_(), timer_(), add_("AddOrder"), modify_("ModifyOrder"), remove_("RemoveOrder"), trade_("Trade"), midquote_("MidQuote Print"), book_print_("Book Print")
+            , timer_(), add_("AddOrder"), modify_("ModifyOrder"), remove_("RemoveOrder"), trade_("Trade"), midquote_("MidQuote Print"), book_print_("Book Print")
+#endif
       {
+         bookFor(0);
       }
 
       ~MarketDataHandler()
       {
-         order_book_.getLoggerReference().stopLogger();
+         logger_.stopLogger();
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            delete books_[i];
+         }
+         delete trace_;
+         Journal::destroy(journal_);
 
+#ifdef ENABLE_PROFILING
          add_.print();
          modify_.print();
          remove_.print();
          trade_.print();
          midquote_.print();
          book_print_.print();
-      }
 #endif
+      }
+
+      void processMessage(const char *line)
+      {
+         processMessage(line, strlen(line));
+      }
+
+      void processMessage(const char *line, size_t len)
+      {
+         if (UNLIKELY(trace_ != 0))
+            pending_ingest_ = trace_->now();
+         MessageFields fields;
+         parser_.splitFields(line, len, fields);
+         processMessage(fields);
+      }
+
+      void processMessage(const MessageFields &fields)
+      {
+         ++messages_;
+         applyMessage(fields, INVALIDSYMBOL);
+         snapshotIfDue();
+      }
+
+      // Entry point for callers that have already resolved the symbol, such
+      // as the shard workers of ShardedMarketDataHandler.
+      void processMessage(const char *line, size_t len, uint32_t symbol_id)
+      {
+         if (UNLIKELY(trace_ != 0))
+            pending_ingest_ = trace_->now();
+         MessageFields fields;
+         parser_.splitFields(line, len, fields);
+         processMessage(fields, symbol_id);
+      }
+
+      void processMessage(const MessageFields &fields, uint32_t symbol_id)
+      {
+         ++messages_;
+         applyMessage(fields, symbol_id);
+         snapshotIfDue();
+      }
+
+      // Applies one binary feed record.  Records were validated when the
+      // feed was encoded, so there is nothing to parse or check.
+      void processRecord(const FeedRecord &record)
+      {
+         uint64_t ingest = UNLIKELY(trace_ != 0) ? trace_->now() : 0;
+         DecodedMessage &decoded = decoded_[0];
+         if (!decodeRecord(record, decoded))
+            return;
+         if (UNLIKELY(trace_ != 0))
+         {
+            trace_->beginMessage(ingest, decoded.symbol_id_);
+            trace_->setMessageType(decoded.type_);
+            trace_->stamp(eTS_Parsed);
+         }
+
+         BookType &order_book = applyDecoded(decoded);
+         TRACE_STAGE(eTS_Booked);
+         publishMidpoint(order_book);
+         snapshotIfDue();
+      }
+
+      // processBatch() for binary feed records: count records are applied
+      // in blocks of MESSAGEBATCHSIZE, with the same midpoint conflation.
+      // Returns the messages applied.
+      uint32_t processRecords(const FeedRecord *records, uint32_t count)
+      {
+         if (UNLIKELY(trace_ != 0))
+         {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+               processRecord(records[i]);
+            }
+            return count;
+         }
+
+         uint32_t valid = 0;
+         for (uint32_t offset = 0; offset < count; offset += MESSAGEBATCHSIZE)
+         {
+            uint32_t block = count - offset < MESSAGEBATCHSIZE ? count - offset : MESSAGEBATCHSIZE;
+            uint32_t decoded = 0;
+            for (uint32_t i = 0; i < block; ++i)
+            {
+               if (decodeRecord(records[offset + i], decoded_[decoded]))
+                  ++decoded;
+            }
+            applyBatch(decoded);
+            valid += decoded;
+         }
+         return valid;
+      }
+
+      // Processes count messages in blocks of MESSAGEBATCHSIZE: each block is
+      // decoded into a compact array first, then applied to the books, so
+      // the parse and book-update loops each stay hot in cache.  Output is
+      // identical to calling processMessage() per message unless conflation
+      // is on, in which case each touched book prints one midpoint for its
+      // final state at the end of the block.  Returns the valid messages.
+      uint32_t processBatch(const MessageFields *messages, uint32_t count)
+      {
+         return processBatch(messages, 0, count);
+      }
+
+      // As above with symbols already resolved; symbol_ids may be null.
+      uint32_t processBatch(const MessageFields *messages, const uint32_t *symbol_ids, uint32_t count)
+      {
+         if (UNLIKELY(trace_ != 0))
+         {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+               if (symbol_ids != 0)
+                  processMessage(messages[i], symbol_ids[i]);
+               else
+                  processMessage(messages[i]);
+            }
+            return count;
+         }
+
+         uint32_t valid = 0;
+         for (uint32_t offset = 0; offset < count; offset += MESSAGEBATCHSIZE)
+         {
+            uint32_t block = count - offset < MESSAGEBATCHSIZE ? count - offset : MESSAGEBATCHSIZE;
+            uint32_t decoded = 0;
+            for (uint32_t i = 0; i < block; ++i)
+            {
+               if (decodeMessage(messages[offset + i], symbol_ids != 0 ? symbol_ids[offset + i] : INVALIDSYMBOL,
+                                 decoded_[decoded]))
+                  ++decoded;
+            }
+            applyBatch(decoded);
+            valid += decoded;
+         }
+         return valid;
+      }
+
+      // For lines a front end has already validated and counted, such as
+      // those from ShardedMarketDataHandler's dispatcher: their parse
+      // results are not counted again.
+      void setPrevalidated(bool prevalidated)
+      {
+         parser_.setReporting(!prevalidated);
+      }
+
+      // Publishes one midpoint per book per batch instead of one per message.
+      void setConflation(bool conflate)
+      {
+         conflate_batches_ = conflate;
+      }
+
+      // Applies Book output conflation to every book, current and future.
+      void setOutputConflation(const ConflationOptions &options)
+      {
+         output_conflation_ = options;
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->setConflation(options);
+         }
+      }
+
+      // Puts every book, current and future, in matching mode.
+      void setMatching(bool matching)
+      {
+         matching_ = matching;
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->setMatching(matching);
+         }
+      }
+
+      Logger &getLoggerReference()
+      {
+         return logger_;
+      }
+
+      void setBookDepth(uint32_t depth)
+      {
+         book_depth_ = depth;
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->setSnapshotDepth(depth);
+         }
+      }
+
+      void setLevelRetention(uint32_t retention)
+      {
+         level_retention_ = retention;
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->setLevelRetention(retention);
+         }
+      }
+
+      // Prints every book this handler owns, in symbol ID order.
+      // Prints every book from symbol first_book on.
+      void printCurrentOrderBook(uint32_t first_book = 0)
+      {
+         START()
+         for (uint32_t i = first_book; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->printBook();
+         }
+         STOP(book_print_);
+      }
+
+      // Traces every message from ingest to the write of its midquote into
+      // a trace of up to capacity messages.  Must be called before the first
+      // message.  shutdown() prints the stage breakdown and writes the
+      // Chrome trace-event JSON to path.
+      void enableTrace(const std::string &path, uint32_t capacity = TRACECAPACITY)
+      {
+         if (trace_ != 0)
+            return;
+         trace_ = new MessageTrace(path, capacity);
+         logger_.setTrace(trace_);
+      }
+
+      // Publishes every book's top of book to publisher, which must outlive
+      // the handler's message processing.
+      void setTopOfBook(TopOfBookPublisher *publisher)
+      {
+         top_of_book_ = publisher;
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               bindTopOfBook(*books_[i]);
+         }
+      }
+
+      // Journals every applied message to <path>.journal, after a snapshot
+      // of the books in <path>.snapshot that is replaced every
+      // snapshot_interval messages.  Call after recover(), if at all, and
+      // before the first message.
+      bool enableJournal(const std::string &path, uint32_t snapshot_interval = SNAPSHOTINTERVAL)
+      {
+         if (journal_ != 0)
+            return true;
+         journal_ = Journal::create(path);
+         snapshot_interval_ = snapshot_interval == 0 ? 1 : snapshot_interval;
+         if (!journal_->start(buildSnapshot()))
+         {
+            Journal::destroy(journal_);
+            journal_ = 0;
+            return false;
+         }
+         return true;
+      }
+
+      // Rebuilds the books from <path>.snapshot and the journal written
+      // after it, printing nothing, so the work is bounded by the snapshot
+      // interval rather than by the messages seen so far.  messageCount()
+      // is then the last source message the books include; any rejected
+      // messages after it are rejected again when the feed resumes there,
+      // as the books are unchanged by them.  Must be called before the
+      // first message.  Returns true with no change if there is no
+      // snapshot, false if the snapshot cannot be read.
+      bool recover(const std::string &path)
+      {
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+         int fd = open(snapshotPath(path).c_str(), O_RDONLY);
+         if (fd < 0)
+         {
+            if (errno != ENOENT)
+            {
+               fprintf(stderr, "Unable to open snapshot %s: %s\n", snapshotPath(path).c_str(), strerror(errno));
+               return false;
+            }
+            fprintf(stderr, "No snapshot at %s; starting with empty books.\n", snapshotPath(path).c_str());
+            return true;
+         }
+         MappedFile snapshot;
+         bool mapped = snapshot.map(fd);
+         close(fd);
+         const SnapshotFileHeader *header = mapped ? snapshotFileHeader(snapshot.data(), snapshot.size()) : 0;
+         if (header == 0)
+            return false;
+
+         setRecovering(true);
+         uint64_t orders = 0;
+         uint64_t replayed = 0;
+         bool restored = restoreSnapshot(*header, snapshot.size(), orders);
+         if (restored)
+            replayed = replayJournal(path, *header);
+         setRecovering(false);
+         if (!restored)
+         {
+            fprintf(stderr, "Snapshot %s is truncated.\n", snapshotPath(path).c_str());
+            return false;
+         }
+
+         std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+         fprintf(stderr, "Recovered %lu orders at message %lu and %lu journal records to message %lu in %.3f ms.\n",
+                 (unsigned long)orders, (unsigned long)header->sequence_, (unsigned long)replayed,
+                 (unsigned long)messages_, elapsed.count() * 1000);
+         return true;
+      }
+
+      // Source messages handled so far.
+      uint64_t messageCount() const { return messages_; }
+
+      void shutdown()
+      {
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->flushConflated();
+         }
+         logger_.stopLogger();
+         logger_.printStatistics();
+         if (journal_ != 0)
+         {
+            journal_->stop();
+            journal_->printStatistics();
+         }
+         if (trace_ != 0)
+            trace_->report();
+      }
+
+      BookType *findBook(uint32_t symbol_id)
+      {
+         return symbol_id < books_.size() ? books_[symbol_id] : 0;
+      }
+
+      const SymbolDirectory &symbols() const { return symbols_; }
+      const MessageTrace *trace() const { return trace_; }
+
+   private:
+      MarketDataHandler(const MarketDataHandler &);
+      MarketDataHandler &operator=(const MarketDataHandler &);
+
+      BookType &bookFor(uint32_t symbol_id)
+      {
+         if (LIKELY(symbol_id < books_.size() && books_[symbol_id] != 0))
+            return *books_[symbol_id];
+
+         if (symbol_id >= books_.size())
+         {
+            books_.resize(symbol_id + 1, 0);
+            midpoint_pending_.resize(symbol_id + 1, false);
+         }
+         books_[symbol_id] = new BookType(order_pool_, logger_, symbol_id);
+         books_[symbol_id]->setSnapshotDepth(book_depth_);
+         books_[symbol_id]->setLevelRetention(level_retention_);
+         books_[symbol_id]->setConflation(output_conflation_);
+         books_[symbol_id]->setMatching(matching_);
+         books_[symbol_id]->setQuiet(recovering_);
+         if (top_of_book_ != 0)
+            bindTopOfBook(*books_[symbol_id]);
+         return *books_[symbol_id];
+      }
+
+      // Books print nothing while recovering.
+      void setRecovering(bool recovering)
+      {
+         recovering_ = recovering;
+         for (uint32_t i = 0; i < books_.size(); ++i)
+         {
+            if (books_[i] != 0)
+               books_[i]->setQuiet(recovering);
+         }
+      }
+
+      // Interns symbol, journaling it if it is new so recovery assigns the
+      // same IDs in the same order.
+      uint32_t internSymbol(const char *symbol, uint32_t len)
+      {
+         uint32_t known = symbols_.size();
+         uint32_t symbol_id = symbols_.intern(symbol, len);
+         if (UNLIKELY(journal_ != 0) && symbols_.size() != known)
+         {
+            FeedSymbolRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type_ = eFR_Symbol;
+            record.len_ = len;
+            record.symbol_id_ = symbol_id;
+            record.sequence_ = messages_;
+            memcpy(record.name_, symbol, len);
+            journal_->append((const FeedRecord &)record);
+         }
+         return symbol_id;
+      }
 
-      void processMessage(char *line)
+      // Journal records are binary feed records in our own symbol IDs.  Only
+      // messages the book applied are journaled, so recovery never replays
+      // one the book rejected and counts its error again.
+      void journalOrder(MessageType mt, uint32_t symbol_id, const ORDERTYPE &order, uint64_t sequence)
       {
-         MessageType mt = parser_.getMessageType(line);
-         bool valid_message = false;
+         FeedRecord record;
+         memset(&record, 0, sizeof(record));
+         record.type_ = mt == eMT_Add ? eFR_Add : (mt == eMT_Modify ? eFR_Modify : eFR_Remove);
+         record.side_ = order.order_side_ == eS_Buy ? 'B' : 'S';
+         record.symbol_id_ = symbol_id;
+         record.sequence_ = sequence;
+         record.order_id_ = order.order_id_;
+         record.quantity_ = order.order_qty_;
+         record.price_ = order.order_price_;
+         record.display_quantity_ = order.order_display_qty_;
+         record.flags_ = order.order_flags_;
+         journal_->append(record);
+      }
+
+      void journalTrade(uint32_t symbol_id, const TradeMessage &tm, uint64_t sequence)
+      {
+         FeedRecord record;
+         memset(&record, 0, sizeof(record));
+         record.type_ = eFR_Trade;
+         record.symbol_id_ = symbol_id;
+         record.sequence_ = sequence;
+         record.quantity_ = tm.trade_qty_;
+         record.price_ = tm.trade_price_;
+         journal_->append(record);
+      }
+
+      // Called between messages, never inside a batch, so a snapshot covers
+      // exactly the messages up to messages_.
+      void snapshotIfDue()
+      {
+         if (UNLIKELY(journal_ != 0) && messages_ - snapshot_sequence_ >= snapshot_interval_)
+            journal_->snapshot(buildSnapshot());
+      }
+
+      // Serializes the symbol directory and every book's resting orders.
+      // Runs on the book thread; the journal thread writes the image.
+      std::vector<char> *buildSnapshot()
+      {
+         snapshot_sequence_ = messages_;
+         std::vector<char> *image = new std::vector<char>(sizeof(SnapshotFileHeader));
+         SnapshotFileHeader header;
+         memset(&header, 0, sizeof(header));
+         header.magic_ = SNAPSHOTFILEMAGIC;
+         header.version_ = JOURNALFILEVERSION;
+         header.order_size_ = sizeof(SnapshotOrder);
+         header.epoch_ = journal_->nextEpoch();
+         header.sequence_ = messages_;
+         header.symbols_ = symbols_.size() - 1;
+
+         for (uint32_t symbol_id = 1; symbol_id < symbols_.size(); ++symbol_id)
+         {
+            const SymbolEntry *entry = symbols_.find(symbol_id);
+            FeedSymbolRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type_ = eFR_Symbol;
+            record.len_ = strnlen(entry->name_, SYMBOLLENMAX);
+            record.symbol_id_ = symbol_id;
+            record.sequence_ = messages_;
+            memcpy(record.name_, entry->name_, record.len_);
+            image->insert(image->end(), (const char *)&record, (const char *)(&record + 1));
+         }
+
+         for (uint32_t symbol_id = 0; symbol_id < books_.size(); ++symbol_id)
+         {
+            if (books_[symbol_id] == 0)
+               continue;
+            BookType &book = *books_[symbol_id];
+            size_t book_offset = image->size();
+            SnapshotBook saved;
+            memset(&saved, 0, sizeof(saved));
+            saved.symbol_id_ = symbol_id;
+            saved.last_trade_price_ = book.lastTradePrice();
+            saved.last_trade_quantity_ = book.lastTradeQuantity();
+            image->resize(book_offset + sizeof(SnapshotBook));
+
+            book.forEachOrder([&](const ORDERTYPE &order) {
+               SnapshotOrder entry;
+               memset(&entry, 0, sizeof(entry));
+               entry.order_id_ = order.order_id_;
+               entry.price_ = order.order_price_;
+               entry.quantity_ = order.order_qty_;
+               entry.display_quantity_ = order.order_display_qty_;
+               entry.hidden_quantity_ = order.order_hidden_qty_;
+               entry.side_ = order.order_side_;
+               entry.flags_ = order.order_flags_;
+               image->insert(image->end(), (const char *)&entry, (const char *)(&entry + 1));
+               ++saved.orders_;
+            });
+            memcpy(&(*image)[book_offset], &saved, sizeof(saved));
+            ++header.books_;
+         }
+         memcpy(&(*image)[0], &header, sizeof(header));
+         return image;
+      }
+
+      bool restoreSnapshot(const SnapshotFileHeader &header, size_t size, uint64_t &orders)
+      {
+         const char *position = (const char *)(&header + 1);
+         const char *end = (const char *)&header + size;
+         if ((size_t)(end - position) < (size_t)header.symbols_ * sizeof(FeedSymbolRecord))
+            return false;
+         for (uint32_t i = 0; i < header.symbols_; ++i)
+         {
+            defineSymbol(*(const FeedSymbolRecord *)position);
+            position += sizeof(FeedSymbolRecord);
+         }
+
+         for (uint32_t i = 0; i < header.books_; ++i)
+         {
+            if ((size_t)(end - position) < sizeof(SnapshotBook))
+               return false;
+            const SnapshotBook &saved = *(const SnapshotBook *)position;
+            position += sizeof(SnapshotBook);
+            if ((size_t)(end - position) < (size_t)saved.orders_ * sizeof(SnapshotOrder) ||
+                saved.symbol_id_ >= symbols_.size())
+               return false;
+
+            BookType &order_book = bookFor(saved.symbol_id_);
+            const SnapshotOrder *entry = (const SnapshotOrder *)position;
+            for (uint32_t j = 0; j < saved.orders_; ++j, ++entry)
+            {
+               ORDERTYPE *order = order_pool_.acquire();
+               *order = ORDERTYPE();
+               order->order_id_ = entry->order_id_;
+               order->order_price_ = entry->price_;
+               order->order_qty_ = entry->quantity_;
+               order->order_display_qty_ = entry->display_quantity_;
+               order->order_hidden_qty_ = entry->hidden_quantity_;
+               order->order_side_ = (Side)entry->side_;
+               order->order_flags_ = entry->flags_;
+               order_book.restoreOrder(order);
+            }
+            order_book.restoreLastTrade(saved.last_trade_price_, saved.last_trade_quantity_);
+            orders += saved.orders_;
+            position = (const char *)entry;
+         }
+         messages_ = header.sequence_;
+         return true;
+      }
+
+      // Applies the journal that follows the snapshot; every record in it
+      // was accepted after the snapshot was taken.  A torn last record is
+      // ignored.  Symbol records may run ahead of the messages of their
+      // batch, so the recovered position is the last applied message.
+      uint64_t replayJournal(const std::string &path, const SnapshotFileHeader &snapshot)
+      {
+         int fd = open(journalPath(path).c_str(), O_RDONLY);
+         if (fd < 0)
+            return 0;
+         MappedFile journal;
+         bool mapped = journal.map(fd);
+         close(fd);
+         const JournalFileHeader *header = mapped ? journalFileHeader(journal.data(), journal.size(), snapshot.epoch_) : 0;
+         if (header == 0)
+            return 0;
+
+         const FeedRecord *record = (const FeedRecord *)(header + 1);
+         uint64_t count = (journal.size() - sizeof(JournalFileHeader)) / sizeof(FeedRecord);
+         uint64_t position = snapshot.sequence_;
+         for (uint64_t i = 0; i < count; ++i, ++record)
+         {
+            if (decodeRecord(*record, decoded_[0]))
+            {
+               applyDecoded(decoded_[0]);
+               position = record->sequence_;
+            }
+         }
+         messages_ = position;
+         return count;
+      }
+
+      // Parses and applies one message; the caller has counted it.  A
+      // symbol_id of INVALIDSYMBOL means resolve it from the message, which
+      // only happens once the message has validated, so a corrupt line
+      // never adds a symbol or a book.
+      void applyMessage(const MessageFields &fields, uint32_t symbol_id)
+      {
+         if (UNLIKELY(trace_ != 0))
+         {
+            trace_->beginMessage(pending_ingest_ != 0 ? pending_ingest_ : trace_->now(),
+                                 symbol_id != INVALIDSYMBOL ? symbol_id : 0);
+            pending_ingest_ = 0;
+         }
+
+         const char *symbol = 0;
+         uint32_t symbol_len = 0;
+         if (symbol_id == INVALIDSYMBOL && !readSymbol(fields, symbol, symbol_len))
+            return;
+
+         MessageType mt = parser_.getMessageType(fields);
+         if (UNLIKELY(trace_ != 0))
+            trace_->setMessageType(mt);
          if (mt == eMT_Unknown)
          {
             FeedErrorStats::instance()->corruptMessage();
             return;
          }
-         else if (mt == eMT_Trade)
+
+         START();
+         TradeMessage tm;
+         ORDERTYPE scratch;
+         ORDERTYPE *ole = 0;
+         bool valid_message;
+         if (mt == eMT_Trade)
          {
-            START();
-            TradeMessage tm;
-            parser_.parseTrade(line, tm);
-            if (tm.trade_price_ != 0)
+            parser_.parseTrade(fields, tm);
+            valid_message = tm.trade_price_ != 0;
+         }
+         else if (mt == eMT_Add)
+         {
+            ole = order_pool_.acquire();
+            parser_.parseOrder(fields, *ole);
+            valid_message = ole->order_side_ != eS_Unknown;
+         }
+         else
+         {
+            parser_.parseOrder(fields, scratch);
+            valid_message = scratch.order_side_ != eS_Unknown;
+         }
+         TRACE_STAGE(eTS_Parsed);
+
+         if (valid_message && symbol_id == INVALIDSYMBOL)
+         {
+            symbol_id = resolveSymbol(symbol, symbol_len);
+            valid_message = symbol_id != INVALIDSYMBOL;
+            if (UNLIKELY(trace_ != 0))
+               trace_->setSymbol(symbol_id);
+         }
+         if (!valid_message)
+         {
+            if (ole != 0)
+               order_pool_.release(ole);
+            if (mt == eMT_Trade)
             {
-               valid_message = true;
-               order_book_.handleTrade(tm);
+               STOP(trade_);
             }
+            return;
+         }
+
+         BookType &order_book = bookFor(symbol_id);
+         switch (mt)
+         {
+         case eMT_Trade:
+            if (order_book.handleTrade(tm) && UNLIKELY(journal_ != 0))
+               journalTrade(symbol_id, tm, messages_);
+            TRACE_STAGE(eTS_Booked);
             STOP(trade_);
+            break;
+         case eMT_Add:
+            // The book may fill and release the order, so journal a copy.
+            if (UNLIKELY(journal_ != 0))
+               scratch = *ole;
+            if (order_book.addOrder(ole) && UNLIKELY(journal_ != 0))
+               journalOrder(mt, symbol_id, scratch, messages_);
+            TRACE_STAGE(eTS_Booked);
+            STOP(add_);
+            break;
+         case eMT_Modify:
+            if (order_book.modifyOrder(scratch) && UNLIKELY(journal_ != 0))
+               journalOrder(mt, symbol_id, scratch, messages_);
+            TRACE_STAGE(eTS_Booked);
+            STOP(modify_);
+            break;
+         case eMT_Remove:
+            if (order_book.removeOrder(scratch) && UNLIKELY(journal_ != 0))
+               journalOrder(mt, symbol_id, scratch, messages_);
+            TRACE_STAGE(eTS_Booked);
+            STOP(remove_);
+            break;
+         default:
+            fprintf(stderr, "Unknown order type hit in switch.  This should not happen.\n");
+            FAILASSERT();
+            break;
          }
-         else
+         publishMidpoint(order_book);
+      }
+
+      // Reads the message's symbol field, if any, without interning it.
+      // Returns false, having counted the message, if the name could never
+      // be interned.
+      bool readSymbol(const MessageFields &fields, const char *&symbol, uint32_t &len)
+      {
+         parser_.getSymbol(fields, symbol, len);
+         if (symbol != 0 && !SymbolDirectory::validSymbol(len))
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return false;
+         }
+         return true;
+      }
+
+      // The ID of a symbol read by readSymbol() from a message that has
+      // since validated, or INVALIDSYMBOL, counted, if the directory is full.
+      uint32_t resolveSymbol(const char *symbol, uint32_t len)
+      {
+         if (symbol == 0)
+            return 0;
+         uint32_t symbol_id = internSymbol(symbol, len);
+         if (symbol_id == INVALIDSYMBOL)
+            FeedErrorStats::instance()->corruptMessage();
+         return symbol_id;
+      }
+
+      struct DecodedMessage
+      {
+         ORDERTYPE order_;
+         TradeMessage trade_;
+         uint32_t symbol_id_;
+         MessageType type_;
+         uint64_t sequence_;
+      };
+
+      // Parses one message into decoded, applying the same validation and
+      // error counting as processMessage().  symbol_id of INVALIDSYMBOL
+      // means resolve it from the message.
+      bool decodeMessage(const MessageFields &fields, uint32_t symbol_id, DecodedMessage &decoded)
+      {
+         decoded.sequence_ = ++messages_;
+         const char *symbol = 0;
+         uint32_t symbol_len = 0;
+         if (symbol_id == INVALIDSYMBOL && !readSymbol(fields, symbol, symbol_len))
+            return false;
+
+         decoded.type_ = parser_.getMessageType(fields);
+         switch (decoded.type_)
+         {
+         case eMT_Unknown:
+            FeedErrorStats::instance()->corruptMessage();
+            return false;
+         case eMT_Trade:
+            parser_.parseTrade(fields, decoded.trade_);
+            if (decoded.trade_.trade_price_ == 0)
+               return false;
+            break;
+         default:
+            decoded.order_ = ORDERTYPE();
+            parser_.parseOrder(fields, decoded.order_);
+            if (decoded.order_.order_side_ == eS_Unknown)
+               return false;
+            break;
+         }
+
+         if (symbol_id == INVALIDSYMBOL)
+            symbol_id = resolveSymbol(symbol, symbol_len);
+         decoded.symbol_id_ = symbol_id;
+         return symbol_id != INVALIDSYMBOL;
+      }
+
+      // Fills decoded from a binary feed record.  Symbol records only bind
+      // the encoder's symbol ID to ours and create the book, as the first
+      // text message naming a symbol does, so they return false.
+      bool decodeRecord(const FeedRecord &record, DecodedMessage &decoded)
+      {
+         messages_ = record.sequence_;
+         decoded.sequence_ = record.sequence_;
+         if (UNLIKELY(record.type_ == eFR_Symbol))
+         {
+            defineSymbol((const FeedSymbolRecord &)record);
+            return false;
+         }
+
+         decoded.symbol_id_ = LIKELY(record.symbol_id_ < feed_symbols_.size()) ? feed_symbols_[record.symbol_id_] : INVALIDSYMBOL;
+         if (UNLIKELY(decoded.symbol_id_ == INVALIDSYMBOL))
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return false;
+         }
+
+         switch (record.type_)
+         {
+         case eFR_Trade:
+            decoded.type_ = eMT_Trade;
+            decoded.trade_.trade_qty_ = record.quantity_;
+            decoded.trade_.trade_price_ = record.price_;
+            return true;
+         case eFR_Add:
+            decoded.type_ = eMT_Add;
+            break;
+         case eFR_Modify:
+            decoded.type_ = eMT_Modify;
+            break;
+         case eFR_Remove:
+            decoded.type_ = eMT_Remove;
+            break;
+         default:
+            FeedErrorStats::instance()->corruptMessage();
+            return false;
+         }
+         decoded.order_ = ORDERTYPE();
+         decoded.order_.order_id_ = record.order_id_;
+         decoded.order_.order_side_ = record.side_ == 'B' ? eS_Buy : eS_Sell;
+         decoded.order_.order_qty_ = record.quantity_;
+         decoded.order_.order_price_ = record.price_;
+         decoded.order_.order_display_qty_ = record.display_quantity_;
+         decoded.order_.order_flags_ = record.flags_;
+         return true;
+      }
+
+      void defineSymbol(const FeedSymbolRecord &record)
+      {
+         uint32_t symbol_id = internSymbol(record.name_, record.len_ <= SYMBOLLENMAX ? record.len_ : 0);
+         if (symbol_id == INVALIDSYMBOL)
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return;
+         }
+         if (record.symbol_id_ >= feed_symbols_.size())
+            feed_symbols_.resize(record.symbol_id_ + 1, INVALIDSYMBOL);
+         feed_symbols_[record.symbol_id_] = symbol_id;
+         bookFor(symbol_id);
+      }
+
+      BookType &applyDecoded(DecodedMessage &decoded)
+      {
+         BookType &order_book = bookFor(decoded.symbol_id_);
+         bool applied = false;
+         switch (decoded.type_)
+         {
+         case eMT_Add:
+         {
+            ORDERTYPE *ole = order_pool_.acquire();
+            *ole = decoded.order_;
+            applied = order_book.addOrder(ole);
+            break;
+         }
+         case eMT_Modify:
+            applied = order_book.modifyOrder(decoded.order_);
+            break;
+         case eMT_Remove:
+            applied = order_book.removeOrder(decoded.order_);
+            break;
+         case eMT_Trade:
+            applied = order_book.handleTrade(decoded.trade_);
+            break;
+         default:
+            break;
+         }
+
+         if (UNLIKELY(journal_ != 0) && applied)
          {
-            START();
-            ORDERTYPE *ole = new ORDERTYPE();
-            parser_.parseOrder(line, *ole);
-            if (ole->order_side_ == eS_Unknown)
+            if (decoded.type_ == eMT_Trade)
+               journalTrade(decoded.symbol_id_, decoded.trade_, decoded.sequence_);
+            else
+               journalOrder(decoded.type_, decoded.symbol_id_, decoded.order_, decoded.sequence_);
+         }
+         return order_book;
+      }
+
+      void publishMidpoint(BookType &order_book)
+      {
+         START();
+         uint64_t sequence = order_book.lastSequence();
+         order_book.printMidpoint();
+         STOP(midquote_);
+         if (UNLIKELY(trace_ != 0) && order_book.lastSequence() != sequence)
+         {
+            trace_->stamp(eTS_Enqueued);
+            trace_->setSequence(order_book.lastSequence());
+         }
+      }
+
+      void applyBatch(uint32_t count)
+      {
+         for (uint32_t i = 0; i < count; ++i)
+         {
+            DecodedMessage &decoded = decoded_[i];
+            BookType &order_book = applyDecoded(decoded);
+
+            if (!conflate_batches_)
             {
-               delete ole;
+               order_book.printMidpoint();
             }
-            else
+            else if (!midpoint_pending_[decoded.symbol_id_])
             {
-               switch (mt)
-               {
-               case eMT_Add:
-                  order_book_.addOrder(ole);
-                  STOP(add_);
-                  valid_message = true;
-                  break;
-               case eMT_Modify:
-                  order_book_.modifyOrder(ole);
-                  STOP(modify_);
-                  valid_message = true;
-                  break;
-               case eMT_Remove:
-                  order_book_.removeOrder(ole);
-                  STOP(remove_);
-                  valid_message = true;
-                  break;
-               default:
-                  fprintf(stderr, "Unknown order type hit in switch.  This should not happen.\n");
-                  delete ole;
-                  FAILASSERT();
-                  break;
-               }
+               midpoint_pending_[decoded.symbol_id_] = true;
+               pending_books_.push_back(decoded.symbol_id_);
             }
          }
-         if (valid_message)
+
+         for (uint32_t i = 0; i < pending_books_.size(); ++i)
          {
-            START();
-            order_book_.printMidpoint();
-            STOP(midquote_);
+            books_[pending_books_[i]]->printMidpoint();
+            midpoint_pending_[pending_books_[i]] = false;
          }
+         pending_books_.clear();
+         snapshotIfDue();
       }
 
-      void printCurrentOrderBook()
+      // Books fed by a sharded dispatcher use its symbol IDs, which this
+      // handler's directory doesn't know; the dispatcher names those.
+      void bindTopOfBook(BookType &book)
       {
-         START()
-         order_book_.printBook();
-         STOP(book_print_);
+         const SymbolEntry *entry = symbols_.find(book.symbolId());
+         book.setTopOfBook(top_of_book_->bind(book.symbolId(), entry != 0 ? entry->name_ : 0));
       }
 
-   private:
-      Book<ORDERIDTYPE, ORDERTYPE> order_book_;
+      OrderPool<ORDERTYPE> order_pool_;
+      Logger logger_;
+      SymbolDirectory symbols_;
+      std::vector<BookType *> books_;
+      uint32_t book_depth_;
+      uint32_t level_retention_;
       Parser parser_;
+      MessageTrace *trace_;
+      uint64_t pending_ingest_;
+      TopOfBookPublisher *top_of_book_;
+      std::vector<DecodedMessage> decoded_;
+      std::vector<uint8_t> midpoint_pending_;
+      std::vector<uint32_t> pending_books_;
+      bool conflate_batches_;
+      ConflationOptions output_conflation_;
+      bool matching_;
+      std::vector<uint32_t> feed_symbols_;
+      Journal *journal_;
+      uint32_t snapshot_interval_;
+      uint64_t messages_;
+      uint64_t snapshot_sequence_;
+      bool recovering_;
 
 #ifdef ENABLE_PROFILING
       HFTimestamp timer_;
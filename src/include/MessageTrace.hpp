@@ -0,0 +1,274 @@
+#pragma once
+
+#ifndef __MESSAGETRACE__
+#define __MESSAGETRACE__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OutputEvents.hpp"
+#include "PerfMetrics.hpp"
+#include "TscClock.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   enum TraceStage
+   {
+      eTS_Ingest,
+      eTS_Parsed,
+      eTS_Booked,
+      eTS_Enqueued,
+      eTS_Written,
+      eTS_Count
+   };
+
+   // One traced message.  Stamps are raw TscClock cycles; 0 means the
+   // message never reached that stage.
+   struct StageTrace
+   {
+      uint64_t stamps_[eTS_Count];
+      uint64_t sequence_;
+      uint32_t symbol_;
+      uint32_t message_type_;
+   };
+
+   struct WriteTrace
+   {
+      uint64_t sequence_;
+      uint64_t written_;
+      uint32_t symbol_;
+   };
+
+   // Fixed-capacity append-only buffer owned by a single thread.  Records
+   // past the capacity are counted and dropped; nothing is ever allocated
+   // after construction.
+   template <typename RECORD>
+   class TraceBuffer
+   {
+   public:
+      TraceBuffer(uint32_t capacity)
+          : records_(capacity), size_(0), dropped_(0)
+      {
+      }
+
+      RECORD *append()
+      {
+         if (UNLIKELY(size_ == records_.size()))
+         {
+            ++dropped_;
+            return 0;
+         }
+         return &records_[size_++];
+      }
+
+      RECORD &operator[](uint32_t i) { return records_[i]; }
+      const RECORD &operator[](uint32_t i) const { return records_[i]; }
+      uint32_t size() const { return size_; }
+      uint64_t dropped() const { return dropped_; }
+
+   private:
+      std::vector<RECORD> records_;
+      uint32_t size_;
+      uint64_t dropped_;
+   };
+
+   // Pipeline trace for one MarketDataHandler.  The handler thread stamps
+   // ingest, post-parse, post-book-update and enqueue of each message; the
+   // logger thread stamps when the midquote event the message produced was
+   // written out.  The two sides are joined on (symbol, sequence) once both
+   // threads have stopped.
+   class MessageTrace
+   {
+   public:
+      MessageTrace(const std::string &path, uint32_t capacity = TRACECAPACITY)
+          : path_(path), clock_(TscClock::instance()), stages_(capacity), writes_(capacity), current_(0), unflushed_(0)
+      {
+      }
+
+      // Handler thread.
+      inline void beginMessage(uint64_t ingest, uint32_t symbol)
+      {
+         current_ = stages_.append();
+         if (current_ == 0)
+            return;
+         *current_ = StageTrace();
+         current_->stamps_[eTS_Ingest] = ingest;
+         current_->symbol_ = symbol;
+      }
+
+      inline void stamp(TraceStage stage)
+      {
+         if (current_ != 0)
+            current_->stamps_[stage] = clock_.start();
+      }
+
+      inline void setMessageType(uint32_t message_type)
+      {
+         if (current_ != 0)
+            current_->message_type_ = message_type;
+      }
+
+      inline void setSymbol(uint32_t symbol)
+      {
+         if (current_ != 0)
+            current_->symbol_ = symbol;
+      }
+
+      inline void setSequence(uint64_t sequence)
+      {
+         if (current_ != 0)
+            current_->sequence_ = sequence;
+      }
+
+      inline uint64_t now() const { return clock_.start(); }
+
+      uint32_t traced() const { return stages_.size(); }
+      uint64_t dropped() const { return stages_.dropped(); }
+
+      // Logger thread.  Midquote events mark the end of a message; their
+      // write time is filled in by flushWrites() once the batch holding
+      // them has been written.
+      inline void recordWrite(const char *data, uint32_t len)
+      {
+         if (len < sizeof(EventHeader))
+            return;
+         const EventHeader *header = (const EventHeader *)data;
+         if (header->type_ != eOE_Midquote)
+            return;
+
+         WriteTrace *write = writes_.append();
+         if (write == 0)
+            return;
+         write->sequence_ = header->sequence_;
+         write->symbol_ = header->symbol_;
+         write->written_ = 0;
+      }
+
+      inline void flushWrites()
+      {
+         if (unflushed_ == writes_.size())
+            return;
+         uint64_t written = clock_.stop();
+         for (; unflushed_ < writes_.size(); ++unflushed_)
+         {
+            writes_[unflushed_].written_ = written;
+         }
+      }
+
+      // Both threads must have stopped.  Prints the per-stage breakdown and
+      // writes the Chrome trace-event JSON to the trace path.
+      void report()
+      {
+         joinWrites();
+
+         PerfMetrics parse("Trace: ingest to parsed");
+         PerfMetrics book("Trace: parsed to book updated");
+         PerfMetrics enqueue("Trace: book updated to enqueued");
+         PerfMetrics output("Trace: enqueued to written");
+         PerfMetrics total("Trace: ingest to written");
+         for (uint32_t i = 0; i < stages_.size(); ++i)
+         {
+            const StageTrace &trace = stages_[i];
+            addStage(parse, trace, eTS_Ingest, eTS_Parsed);
+            addStage(book, trace, eTS_Parsed, eTS_Booked);
+            addStage(enqueue, trace, eTS_Booked, eTS_Enqueued);
+            addStage(output, trace, eTS_Enqueued, eTS_Written);
+            addStage(total, trace, eTS_Ingest, eTS_Written);
+         }
+
+         fprintf(stderr, "\n[Message Trace]\n");
+         fprintf(stderr, "   %-30s %10u\n", "Messages Traced:", stages_.size());
+         fprintf(stderr, "   %-30s %10lu\n", "Messages Dropped:", stages_.dropped());
+         parse.print();
+         book.print();
+         enqueue.print();
+         output.print();
+         total.print();
+
+         writeChromeTrace();
+      }
+
+   private:
+      MessageTrace(const MessageTrace &);
+      MessageTrace &operator=(const MessageTrace &);
+
+      static uint64_t writeKey(uint32_t symbol, uint64_t sequence)
+      {
+         return ((uint64_t)symbol << 48) | (sequence & 0xFFFFFFFFFFFFULL);
+      }
+
+      void joinWrites()
+      {
+         std::unordered_map<uint64_t, uint64_t> written;
+         written.reserve(writes_.size());
+         for (uint32_t i = 0; i < writes_.size(); ++i)
+         {
+            written[writeKey(writes_[i].symbol_, writes_[i].sequence_)] = writes_[i].written_;
+         }
+         for (uint32_t i = 0; i < stages_.size(); ++i)
+         {
+            StageTrace &trace = stages_[i];
+            if (trace.sequence_ == 0)
+               continue;
+            std::unordered_map<uint64_t, uint64_t>::iterator it = written.find(writeKey(trace.symbol_, trace.sequence_));
+            if (it != written.end())
+               trace.stamps_[eTS_Written] = it->second;
+         }
+      }
+
+      void addStage(PerfMetrics &metrics, const StageTrace &trace, TraceStage from, TraceStage to) const
+      {
+         if (trace.stamps_[from] != 0 && trace.stamps_[to] >= trace.stamps_[from])
+            metrics.add(clock_.toNanos(trace.stamps_[to] - trace.stamps_[from]));
+      }
+
+      void writeChromeTrace() const
+      {
+         FILE *file = fopen(path_.c_str(), "w");
+         if (file == NULL)
+         {
+            fprintf(stderr, "Unable to open trace file %s.\n", path_.c_str());
+            return;
+         }
+
+         static const char *names[] = {"parse", "book update", "enqueue", "logger write"};
+         uint64_t origin = stages_.size() != 0 ? stages_[0].stamps_[eTS_Ingest] : 0;
+         fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+         fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"handler\"}},\n");
+         fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"logger\"}}");
+         for (uint32_t i = 0; i < stages_.size(); ++i)
+         {
+            const StageTrace &trace = stages_[i];
+            for (uint32_t stage = eTS_Ingest; stage < eTS_Written; ++stage)
+            {
+               uint64_t from = trace.stamps_[stage];
+               uint64_t to = trace.stamps_[stage + 1];
+               if (from == 0 || to < from)
+                  continue;
+               fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"args\":{\"message\":%u,\"type\":%u,\"symbol\":%u,\"sequence\":%lu}}",
+                       names[stage], stage == eTS_Enqueued ? 2 : 1, clock_.toNanos(from - origin) / 1000.,
+                       clock_.toNanos(to - from) / 1000., i, trace.message_type_, trace.symbol_, trace.sequence_);
+            }
+         }
+         fprintf(file, "\n]}\n");
+         fclose(file);
+         fprintf(stderr, "Wrote %u traced messages to %s\n", stages_.size(), path_.c_str());
+      }
+
+      std::string path_;
+      const TscClock &clock_;
+      TraceBuffer<StageTrace> stages_;
+      TraceBuffer<WriteTrace> writes_;
+      StageTrace *current_;
+      uint32_t unflushed_;
+   };
+
+}
+
+#endif
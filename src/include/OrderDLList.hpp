@@ -4,6 +4,7 @@
 #define __ORDERLDLLIST__
 
 #include <stdint.h>
+#include <string.h>
 
 #include "DLList.hpp"
 #include "Logger.hpp"
@@ -14,21 +15,29 @@ namespace zeus_core
    class CountedOrderList : public DLList<NODE>
    {
    public:
+      typedef NODE Node;
+
       CountedOrderList()
-          : level_quantity_(0)
+          : level_quantity_(0), hidden_quantity_(0), order_count_(0), snapshot_dirty_(true)
       {
       }
-      virtual ~CountedOrderList() {}
+      ~CountedOrderList() {}
 
       void addNode(NODE *input)
       {
          level_quantity_ += input->order_qty_;
+         hidden_quantity_ += input->order_hidden_qty_;
+         ++order_count_;
+         snapshot_dirty_ = true;
          DLList<NODE>::addNode(input);
       }
 
       void removeNode(NODE *input)
       {
          level_quantity_ -= input->order_qty_;
+         hidden_quantity_ -= input->order_hidden_qty_;
+         --order_count_;
+         snapshot_dirty_ = true;
          DLList<NODE>::removeNode(input);
       }
 
@@ -37,6 +46,7 @@ namespace zeus_core
          level_quantity_ -= input->order_qty_;
          level_quantity_ += new_quantity;
          input->order_qty_ = new_quantity;
+         snapshot_dirty_ = true;
       }
 
       void clearLevel()
@@ -44,8 +54,9 @@ namespace zeus_core
          NODE *head = DLList<NODE>::getHead();
          while (head != DLList<NODE>::getTail())
          {
+            NODE *previous = head->previous_;
             removeNode(head);
-            head = head->previous_;
+            head = previous;
          }
          removeNode(head);
       }
@@ -67,10 +78,35 @@ namespace zeus_core
          index += sprintf(&buffer[index], "%c %u ", tag, tail->order_qty_);
       }
 
+      // Writes the order quantities oldest first, as printLevel does.
+      char *writeQuantities(char *position)
+      {
+         NODE *tail = DLList<NODE>::getTail();
+         for (uint32_t i = 0; i < order_count_; ++i)
+         {
+            uint32_t quantity = tail->order_qty_;
+            memcpy(position, &quantity, sizeof(quantity));
+            position += sizeof(quantity);
+            tail = tail->next_;
+         }
+         return position;
+      }
+
       uint32_t getQuantity() const { return level_quantity_; }
+      // Iceberg quantity not yet shown; not part of getQuantity().
+      uint64_t getHiddenQuantity() const { return hidden_quantity_; }
+      uint32_t getCount() const { return order_count_; }
+
+      // Set whenever the level's orders change; cleared by DepthSnapshot once
+      // the level has been re-rendered.
+      bool isSnapshotDirty() const { return snapshot_dirty_; }
+      void clearSnapshotDirty() { snapshot_dirty_ = false; }
 
    private:
       uint32_t level_quantity_;
+      uint64_t hidden_quantity_;
+      uint32_t order_count_;
+      bool snapshot_dirty_;
    };
 
 }
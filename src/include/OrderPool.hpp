@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef __ORDERPOOL__
+#define __ORDERPOOL__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Free-list pool of order entries, preallocated in slabs of a fixed size.
+   // The free list is threaded through the entries' own next_ pointers.  If
+   // the preallocated capacity runs out another slab of the same size is
+   // added rather than failing the order.
+   template <typename NODE>
+   class OrderPool
+   {
+   public:
+      OrderPool(uint32_t slab_size = ORDERPOOLSIZE)
+          : slabs_(), free_(0), slab_size_(slab_size), capacity_(0), in_use_(0)
+      {
+         if (slab_size_ == 0)
+            slab_size_ = 1;
+         addSlab();
+      }
+
+      ~OrderPool()
+      {
+         for (uint32_t i = 0; i < slabs_.size(); ++i)
+         {
+            delete[] slabs_[i];
+         }
+      }
+
+      NODE *acquire()
+      {
+         if (UNLIKELY(free_ == 0))
+         {
+            fprintf(stderr, "Order pool exhausted at %u orders.  Adding slab of %u.\n", capacity_, slab_size_);
+            addSlab();
+         }
+         NODE *node = free_;
+         free_ = node->next_;
+         *node = NODE();
+         ++in_use_;
+         return node;
+      }
+
+      void release(NODE *node)
+      {
+         node->next_ = free_;
+         free_ = node;
+         --in_use_;
+      }
+
+      uint32_t capacity() const { return capacity_; }
+      uint32_t inUse() const { return in_use_; }
+
+   private:
+      OrderPool(const OrderPool &);
+      OrderPool &operator=(const OrderPool &);
+
+      void addSlab()
+      {
+         NODE *slab = new NODE[slab_size_];
+         for (uint32_t i = 0; i + 1 < slab_size_; ++i)
+         {
+            slab[i].next_ = &slab[i + 1];
+         }
+         slab[slab_size_ - 1].next_ = free_;
+         free_ = slab;
+         slabs_.push_back(slab);
+         capacity_ += slab_size_;
+      }
+
+      std::vector<NODE *> slabs_;
+      NODE *free_;
+      uint32_t slab_size_;
+      uint32_t capacity_;
+      uint32_t in_use_;
+   };
+
+}
+
+#endif
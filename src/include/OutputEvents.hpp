@@ -0,0 +1,193 @@
+#pragma once
+
+#ifndef __OUTPUTEVENTS__
+#define __OUTPUTEVENTS__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "Utils.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Output events are written in host byte order and must be little-endian."
+#endif
+
+namespace zeus_core
+{
+   // Binary book output.  Events are packed little-endian structs that start
+   // with an EventHeader; length_ covers the whole event including any
+   // trailing variable-length payload.  In text mode the logger thread
+   // renders them with formatOutputEvent(), in binary mode they are written
+   // as-is and the decoder tool renders them offline.
+   enum OutputEventType
+   {
+      eOE_Midquote = 1,
+      eOE_Trade = 2,
+      eOE_BookSnapshot = 3,
+      eOE_Fill = 4
+   };
+
+#pragma pack(push, 1)
+   // symbol_ is the SymbolDirectory ID of the book; 0 is the unnamed book.
+   struct EventHeader
+   {
+      uint32_t length_;
+      uint16_t type_;
+      uint16_t symbol_;
+      uint64_t sequence_;
+      uint64_t timestamp_;
+   };
+
+   // A zero price means that side of the book is empty.
+   struct MidquoteEvent
+   {
+      EventHeader header_;
+      uint64_t bid_price_;
+      uint64_t ask_price_;
+   };
+
+   struct TradeEvent
+   {
+      EventHeader header_;
+      uint64_t price_;
+      uint32_t quantity_;
+   };
+
+   // One execution of a matching-mode Book: the incoming order traded
+   // quantity_ against one resting order at the resting order's price.
+   struct FillEvent
+   {
+      EventHeader header_;
+      uint64_t price_;
+      uint64_t aggressor_id_;
+      uint64_t resting_id_;
+      uint32_t quantity_;
+      uint32_t aggressor_side_;
+   };
+
+   // Followed by level_count_ SnapshotLevels, sell side first, each side in
+   // descending price order.  Each level is followed by its order_count_
+   // uint32_t order quantities, oldest first.
+   struct BookSnapshotEvent
+   {
+      EventHeader header_;
+      uint32_t level_count_;
+      uint32_t order_count_;
+   };
+
+   struct SnapshotLevel
+   {
+      uint64_t price_;
+      uint32_t order_count_;
+      uint32_t side_;
+   };
+#pragma pack(pop)
+
+   inline uint64_t eventTimestamp()
+   {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+   }
+
+   inline void reserveBuffer(char *&buffer, int &index, int &max_buffer, int needed)
+   {
+      while (index + needed > max_buffer)
+         growBuffer(buffer, max_buffer);
+   }
+
+   inline void formatBookSnapshot(const char *data, uint32_t len, char *&buffer, int &index, int &max_buffer)
+   {
+      const BookSnapshotEvent *snapshot = (const BookSnapshotEvent *)data;
+      const char *position = data + sizeof(BookSnapshotEvent);
+      const char *end = data + len;
+
+      bool sell_side = true;
+      for (uint32_t i = 0; i < snapshot->level_count_ && position + sizeof(SnapshotLevel) <= end; ++i)
+      {
+         SnapshotLevel level;
+         memcpy(&level, position, sizeof(level));
+         position += sizeof(level);
+
+         if (sell_side && level.side_ != eS_Sell)
+         {
+            reserveBuffer(buffer, index, max_buffer, 10);
+            index += sprintf(&buffer[index], "\n");
+            sell_side = false;
+         }
+
+         char tag = level.side_ == eS_Sell ? 'S' : 'B';
+         reserveBuffer(buffer, index, max_buffer, 100);
+         index += sprintf(&buffer[index], "%.2f ", level.price_ / 100.);
+         for (uint32_t o = 0; o < level.order_count_ && position + sizeof(uint32_t) <= end; ++o)
+         {
+            uint32_t quantity;
+            memcpy(&quantity, position, sizeof(quantity));
+            position += sizeof(quantity);
+
+            reserveBuffer(buffer, index, max_buffer, 50);
+            index += sprintf(&buffer[index], "%c %u ", tag, quantity);
+         }
+         reserveBuffer(buffer, index, max_buffer, 10);
+         index += sprintf(&buffer[index], "\n");
+      }
+      reserveBuffer(buffer, index, max_buffer, 10);
+      if (sell_side)
+         index += sprintf(&buffer[index], "\n");
+      index += sprintf(&buffer[index], "\n");
+   }
+
+   // Appends the text rendering of one event to buffer, growing it as
+   // needed.  The output matches the book's original text format, prefixed
+   // with "#<symbol id>" for books other than the unnamed one.
+   inline void formatOutputEvent(const char *data, uint32_t len, char *&buffer, int &index, int &max_buffer)
+   {
+      if (len < sizeof(EventHeader))
+         return;
+      const EventHeader *header = (const EventHeader *)data;
+      if (header->symbol_ != 0)
+      {
+         reserveBuffer(buffer, index, max_buffer, 20);
+         index += sprintf(&buffer[index], header->type_ == eOE_BookSnapshot ? "#%u\n" : "#%u ", header->symbol_);
+      }
+
+      switch (header->type_)
+      {
+      case eOE_Midquote:
+      {
+         const MidquoteEvent *midquote = (const MidquoteEvent *)data;
+         reserveBuffer(buffer, index, max_buffer, 40);
+         if (midquote->bid_price_ == 0 || midquote->ask_price_ == 0)
+            index += sprintf(&buffer[index], "NAN\n");
+         else
+            index += sprintf(&buffer[index], "%.2f\n", (midquote->ask_price_ + midquote->bid_price_) / 200.);
+         break;
+      }
+      case eOE_Trade:
+      {
+         const TradeEvent *trade = (const TradeEvent *)data;
+         reserveBuffer(buffer, index, max_buffer, 40);
+         index += sprintf(&buffer[index], "%u@%.2f\n", trade->quantity_, trade->price_ / 100.);
+         break;
+      }
+      case eOE_Fill:
+      {
+         const FillEvent *fill = (const FillEvent *)data;
+         reserveBuffer(buffer, index, max_buffer, 80);
+         index += sprintf(&buffer[index], "F %c %lu %lu %u@%.2f\n", fill->aggressor_side_ == eS_Buy ? 'B' : 'S',
+                          (unsigned long)fill->aggressor_id_, (unsigned long)fill->resting_id_, fill->quantity_,
+                          fill->price_ / 100.);
+         break;
+      }
+      case eOE_BookSnapshot:
+         formatBookSnapshot(data, len, buffer, index, max_buffer);
+         break;
+      default:
+         break;
+      }
+   }
+
+}
+
+#endif
@@ -3,16 +3,13 @@
 #ifndef __PARSER__
 #define __PARSER__
 
+#include <limits.h>
 #include <stdint.h>
-
-#include <boost/spirit/include/qi_uint.hpp>
-#include <boost/spirit/include/qi_real.hpp>
+#include <string.h>
 
 #include "FeedErrorStats.hpp"
 #include "Utils.hpp"
 
-using namespace boost::spirit;
-
 namespace zeus_core
 {
    enum ParseStatus
@@ -25,39 +22,114 @@ namespace zeus_core
       ePS_GenericBadValue
    };
 
+   // Fields of one message, as offsets into the line.  Fields are delimited
+   // the way strtok(",") splits them: leading and repeated commas are
+   // skipped and the trailing newline stays on the last field.
+   struct MessageFields
+   {
+      MessageFields() : line_(0), len_(0), count_(0) {}
+
+      const char *line_;
+      uint32_t len_;
+      uint32_t count_;
+      uint32_t begin_[MESSAGEFIELDSMAX];
+      uint32_t end_[MESSAGEFIELDSMAX];
+
+      inline void addField(uint32_t begin, uint32_t end)
+      {
+         if (begin != end && count_ < MESSAGEFIELDSMAX)
+         {
+            begin_[count_] = begin;
+            end_[count_] = end;
+            ++count_;
+         }
+      }
+   };
+
+   // Single-pass, non-destructive parser for the comma separated feed.  All
+   // entry points work on a (pointer, length) view or on fields already
+   // located by a StructuralIndex and keep no state between calls.  Prices
+   // are decoded as fixed point straight into integer cents.  Results are
+   // counted in FeedErrorStats unless reporting is off, for lines a front
+   // end has already validated and counted.
    class Parser
    {
    public:
-      Parser()
+      Parser() : report_(true)
       {
       }
       ~Parser() {}
 
-      inline MessageType getMessageType(char *message);
+      void setReporting(bool report) { report_ = report; }
+
+      inline void splitFields(const char *message, size_t len, MessageFields &fields);
 
-      inline void parseOrder(char *tk_msg, OrderLevelEntry &ole);
-      inline void parseTrade(char *tk_msg, TradeMessage &tm);
+      inline MessageType getMessageType(const char *message, size_t len);
+      inline MessageType getMessageType(const MessageFields &fields);
+
+      inline bool hasSymbol(const MessageFields &fields);
+      inline bool hasAttributes(const MessageFields &fields);
+      inline void getSymbol(const MessageFields &fields, const char *&symbol, uint32_t &len);
+
+      inline void parseOrder(const char *message, size_t len, OrderLevelEntry &ole);
+      inline void parseOrder(const MessageFields &fields, OrderLevelEntry &ole);
+      inline void parseTrade(const char *message, size_t len, TradeMessage &tm);
+      inline void parseTrade(const MessageFields &fields, TradeMessage &tm);
 
    private:
-      inline ParseStatus tokenizeAndConvertToUint(char *tk_msg, uint32_t &dest);
-      inline ParseStatus tokenizeAndConvertToDouble(char *tk_msg, double &dest);
+      inline ParseStatus convertToUint(const MessageFields &fields, uint32_t field, uint32_t &dest);
+      inline ParseStatus convertToPrice(const MessageFields &fields, uint32_t field, unsigned long long &dest);
+      inline ParseStatus convertToAttributes(const MessageFields &fields, uint32_t field, OrderLevelEntry &ole);
 
       inline void reportStatus(ParseStatus status);
       inline void failOrderParse(OrderLevelEntry &ole, ParseStatus status);
       inline void failTradeParse(TradeMessage &tm, ParseStatus status);
+
+      bool report_;
    };
 
-   inline MessageType Parser::getMessageType(char *tk_msg)
+   inline void Parser::splitFields(const char *message, size_t len, MessageFields &fields)
    {
-      uint32_t len = strlen(tk_msg);
-      if (len == 0 || len > MESSAGELENMAX)
+      fields.line_ = message;
+      fields.len_ = len > UINT_MAX ? UINT_MAX : (uint32_t)len;
+      fields.count_ = 0;
+      if (len > ORDERMESSAGELENMAX)
+         return;
+
+      uint32_t begin = 0;
+      for (uint32_t i = 0; i < len; ++i)
+      {
+         if (message[i] == ',')
+         {
+            fields.addField(begin, i);
+            begin = i + 1;
+         }
+      }
+      fields.addField(begin, len);
+   }
+
+   inline MessageType Parser::getMessageType(const char *message, size_t len)
+   {
+      MessageFields fields;
+      splitFields(message, len, fields);
+      return getMessageType(fields);
+   }
+
+   inline MessageType Parser::getMessageType(const MessageFields &fields)
+   {
+      uint32_t len_max = (hasSymbol(fields) ? SYMBOLMESSAGELENMAX : MESSAGELENMAX) +
+                         (hasAttributes(fields) ? ORDERATTRLENMAX + 1 : 0);
+      if (fields.len_ == 0 || fields.len_ > len_max)
+      {
+         reportStatus(ePS_CorruptMessage);
+         return eMT_Unknown;
+      }
+      if (fields.count_ == 0)
       {
-         FeedErrorStats::instance()->corruptMessage();
          return eMT_Unknown;
       }
 
-      tk_msg = strtok(tk_msg, ",");
-      switch (tk_msg[0])
+      switch (fields.line_[fields.begin_[0]])
       {
       case 'A':
          return eMT_Add;
@@ -77,44 +149,193 @@ namespace zeus_core
       }
    }
 
-   inline ParseStatus Parser::tokenizeAndConvertToUint(char *tk_msg, uint32_t &dest)
+   // A symbol is an optional field straight after the message type, e.g.
+   // "A,AAPL,17,S,25,35.59" or "T,AAPL,40,50.10".  It is recognised by the
+   // extra field and by starting with a letter, which no numeric field can.
+   // An order may also carry an attributes field, so it may have one more.
+   inline bool Parser::hasSymbol(const MessageFields &fields)
+   {
+      if (fields.count_ < 2)
+         return false;
+      bool trade = fields.line_[fields.begin_[0]] == 'T';
+      uint32_t expected = trade ? 4 : 6;
+      char first = fields.line_[fields.begin_[1]];
+      return (fields.count_ == expected || (!trade && fields.count_ == expected + 1)) &&
+             ((unsigned)((first | 0x20) - 'a') < 26);
+   }
+
+   // Order attributes are an optional last field after the price: any of I
+   // (immediate or cancel), F (fill or kill) and P (post only), and H
+   // followed by the displayed quantity for an iceberg, e.g.
+   // "A,17,S,100,35.59,H20" or "A,AAPL,18,B,10,35.50,P".  Like a symbol it
+   // starts with a letter.
+   inline bool Parser::hasAttributes(const MessageFields &fields)
    {
-      tk_msg = strtok(NULL, ",");
-      if (tk_msg == NULL)
+      if (fields.count_ < 6 || fields.line_[fields.begin_[0]] == 'T')
+         return false;
+      uint32_t expected = hasSymbol(fields) ? 7 : 6;
+      if (fields.count_ != expected)
+         return false;
+      char first = fields.line_[fields.begin_[expected - 1]];
+      return (unsigned)((first | 0x20) - 'a') < 26;
+   }
+
+   inline void Parser::getSymbol(const MessageFields &fields, const char *&symbol, uint32_t &len)
+   {
+      if (!hasSymbol(fields))
+      {
+         symbol = 0;
+         len = 0;
+         return;
+      }
+      symbol = fields.line_ + fields.begin_[1];
+      len = fields.end_[1] - fields.begin_[1];
+   }
+
+   inline ParseStatus Parser::convertToUint(const MessageFields &fields, uint32_t field, uint32_t &dest)
+   {
+      if (field >= fields.count_)
       {
          return ePS_CorruptMessage;
       }
-      else if (tk_msg[0] == '-')
+      const char *token = fields.line_ + fields.begin_[field];
+      const char *token_end = fields.line_ + fields.end_[field];
+      if (token[0] == '-')
       {
          return ePS_GenericBadValue;
       }
-      else if (!qi::parse(tk_msg, &tk_msg[strlen(tk_msg)], uint_, dest))
+
+      uint64_t value = 0;
+      const char *digit = token;
+      while (digit < token_end && (unsigned)(*digit - '0') < 10)
+      {
+         value = value * 10 + (*digit - '0');
+         if (value > UINT_MAX)
+            return ePS_GenericBadValue;
+         ++digit;
+      }
+      if (digit == token)
       {
          return ePS_GenericBadValue;
       }
+      dest = (uint32_t)value;
       return ePS_Good;
    }
 
-   inline ParseStatus Parser::tokenizeAndConvertToDouble(char *tk_msg, double &dest)
+   inline ParseStatus Parser::convertToPrice(const MessageFields &fields, uint32_t field, unsigned long long &dest)
    {
-      tk_msg = strtok(NULL, ",");
-      if (tk_msg == NULL)
+      if (field >= fields.count_)
       {
          return ePS_CorruptMessage;
       }
-      else if (tk_msg[0] == '-')
+      const char *token = fields.line_ + fields.begin_[field];
+      const char *token_end = fields.line_ + fields.end_[field];
+      if (token[0] == '-')
       {
          return ePS_GenericBadValue;
       }
-      else if (!qi::parse(tk_msg, &tk_msg[strlen(tk_msg)], double_, dest))
+
+      const char *digit = token;
+      if (digit < token_end && *digit == '+')
+         ++digit;
+
+      unsigned long long units = 0;
+      const char *units_start = digit;
+      while (digit < token_end && (unsigned)(*digit - '0') < 10)
+      {
+         units = units * 10 + (*digit - '0');
+         if (units > MAXPRICE)
+            return ePS_BadPrice;
+         ++digit;
+      }
+      bool has_digits = digit != units_start;
+
+      unsigned long long cents = 0;
+      if (digit < token_end && *digit == '.')
+      {
+         ++digit;
+         uint32_t places = 0;
+         while (digit < token_end && (unsigned)(*digit - '0') < 10)
+         {
+            if (places < 2)
+               cents = cents * 10 + (*digit - '0');
+            else if (*digit != '0')
+               return ePS_BadPrice;
+            ++places;
+            ++digit;
+            has_digits = true;
+         }
+         if (places == 1)
+            cents *= 10;
+      }
+      if (!has_digits)
       {
          return ePS_GenericBadValue;
       }
+
+      dest = units * 100 + cents;
+      return ePS_Good;
+   }
+
+   inline ParseStatus Parser::convertToAttributes(const MessageFields &fields, uint32_t field, OrderLevelEntry &ole)
+   {
+      const char *token = fields.line_ + fields.begin_[field];
+      const char *token_end = fields.line_ + fields.end_[field];
+      if (token_end > token && token_end[-1] == '\n')
+         --token_end;
+      if (token_end - token > ORDERATTRLENMAX)
+         return ePS_CorruptMessage;
+
+      uint8_t flags = 0;
+      for (const char *attribute = token; attribute < token_end; ++attribute)
+      {
+         switch (*attribute)
+         {
+         case 'I':
+            flags |= eOF_ImmediateOrCancel;
+            break;
+         case 'F':
+            flags |= eOF_FillOrKill;
+            break;
+         case 'P':
+            flags |= eOF_PostOnly;
+            break;
+         case 'H':
+         {
+            uint64_t display = 0;
+            const char *digit = attribute + 1;
+            while (digit < token_end && (unsigned)(*digit - '0') < 10)
+            {
+               display = display * 10 + (*digit - '0');
+               if (display > UINT_MAX)
+                  return ePS_BadQuantity;
+               ++digit;
+            }
+            if (display == 0)
+               return ePS_BadQuantity;
+            flags |= eOF_Iceberg;
+            ole.order_display_qty_ = (uint32_t)display;
+            attribute = digit - 1;
+            break;
+         }
+         default:
+            return ePS_CorruptMessage;
+         }
+      }
+
+      // An order is either immediate or rests; post only cannot take.
+      uint8_t immediate = flags & (eOF_ImmediateOrCancel | eOF_FillOrKill);
+      if ((immediate != 0 && (flags & (eOF_PostOnly | eOF_Iceberg)) != 0) ||
+          immediate == (eOF_ImmediateOrCancel | eOF_FillOrKill))
+         return ePS_CorruptMessage;
+      ole.order_flags_ = flags;
       return ePS_Good;
    }
 
    inline void Parser::reportStatus(ParseStatus status)
    {
+      if (!report_)
+         return;
       switch (status)
       {
       case ePS_Good:
@@ -145,9 +366,20 @@ namespace zeus_core
       return reportStatus(status);
    }
 
-   inline void Parser::parseOrder(char *tk_msg, OrderLevelEntry &ole)
+   inline void Parser::parseOrder(const char *message, size_t len, OrderLevelEntry &ole)
    {
-      ParseStatus result = tokenizeAndConvertToUint(tk_msg, ole.order_id_);
+      MessageFields fields;
+      splitFields(message, len, fields);
+      parseOrder(fields, ole);
+   }
+
+   inline void Parser::parseOrder(const MessageFields &fields, OrderLevelEntry &ole)
+   {
+      ole.order_flags_ = 0;
+      ole.order_display_qty_ = 0;
+      ole.order_hidden_qty_ = 0;
+      uint32_t base = hasSymbol(fields) ? 1 : 0;
+      ParseStatus result = convertToUint(fields, base + 1, ole.order_id_);
       if (result != ePS_Good)
       {
          if (result == ePS_CorruptMessage)
@@ -155,14 +387,13 @@ namespace zeus_core
          return failOrderParse(ole, ePS_BadID);
       }
 
-      tk_msg = strtok(NULL, ",");
-      if (tk_msg == NULL)
+      if (fields.count_ <= base + 2)
       {
          return failOrderParse(ole, ePS_CorruptMessage);
       }
       else
       {
-         switch (tk_msg[0])
+         switch (fields.line_[fields.begin_[base + 2]])
          {
          case 'B':
             ole.order_side_ = eS_Buy;
@@ -176,7 +407,7 @@ namespace zeus_core
          }
       }
 
-      result = tokenizeAndConvertToUint(tk_msg, ole.order_qty_);
+      result = convertToUint(fields, base + 3, ole.order_qty_);
       if (result != ePS_Good)
       {
          if (result == ePS_CorruptMessage)
@@ -186,28 +417,26 @@ namespace zeus_core
       if (ole.order_qty_ == 0)
          return failOrderParse(ole, ePS_BadQuantity);
 
-      double price = 0;
-      result = tokenizeAndConvertToDouble(tk_msg, price);
+      result = convertToPrice(fields, base + 4, ole.order_price_);
       if (result != ePS_Good)
       {
          if (result == ePS_CorruptMessage)
             return failOrderParse(ole, result);
          return failOrderParse(ole, ePS_BadPrice);
       }
-      if (static_cast<unsigned long long>(price * 100) == 0)
-         return failOrderParse(ole, ePS_BadPrice);
-      if (price > ULLONG_MAX)
+      if (ole.order_price_ == 0 || ole.order_price_ > MAXPRICE - 1)
       {
          return failOrderParse(ole, ePS_BadPrice);
       }
 
-      if ((double)(price * 100) - static_cast<unsigned long long>(price * 100) != 0)
+      if (hasAttributes(fields))
       {
-         return failOrderParse(ole, ePS_BadPrice);
+         result = convertToAttributes(fields, base + 5, ole);
+         if (result != ePS_Good)
+            return failOrderParse(ole, result);
       }
-      ole.order_price_ = static_cast<unsigned long long>(price * 100);
 
-      FeedErrorStats::instance()->goodMessage();
+      reportStatus(ePS_Good);
    }
 
    inline void Parser::failTradeParse(TradeMessage &tm, ParseStatus status)
@@ -217,46 +446,39 @@ namespace zeus_core
       reportStatus(status);
    }
 
-   inline void Parser::parseTrade(char *tk_msg, TradeMessage &tm)
+   inline void Parser::parseTrade(const char *message, size_t len, TradeMessage &tm)
+   {
+      MessageFields fields;
+      splitFields(message, len, fields);
+      parseTrade(fields, tm);
+   }
+
+   inline void Parser::parseTrade(const MessageFields &fields, TradeMessage &tm)
    {
-      ParseStatus result = tokenizeAndConvertToUint(tk_msg, tm.trade_qty_);
+      uint32_t base = hasSymbol(fields) ? 1 : 0;
+      ParseStatus result = convertToUint(fields, base + 1, tm.trade_qty_);
       if (result != ePS_Good)
       {
          if (result == ePS_CorruptMessage)
             return failTradeParse(tm, result);
-         ;
          return failTradeParse(tm, ePS_BadQuantity);
       }
       if (tm.trade_qty_ == 0)
          return failTradeParse(tm, ePS_BadPrice);
 
-      double price;
-      result = tokenizeAndConvertToDouble(tk_msg, price);
+      result = convertToPrice(fields, base + 2, tm.trade_price_);
       if (result != ePS_Good)
       {
          if (result == ePS_CorruptMessage)
             return failTradeParse(tm, result);
          return failTradeParse(tm, ePS_BadPrice);
       }
-      if (price > ULLONG_MAX)
-      {
-         return failTradeParse(tm, ePS_BadPrice);
-      }
-
-      if ((double)(price * 100) - static_cast<unsigned long long>(price * 100) != 0)
-      {
-         return failTradeParse(tm, ePS_BadPrice);
-      }
-      if (static_cast<unsigned long long>(price * 100) == 0)
-         return failTradeParse(tm, ePS_BadPrice);
-
-      tm.trade_price_ = static_cast<unsigned long long>(price * 100);
-      if (tm.trade_price_ > MAXPRICE - 1)
+      if (tm.trade_price_ == 0 || tm.trade_price_ > MAXPRICE - 1)
       {
          return failTradeParse(tm, ePS_BadPrice);
       }
 
-      FeedErrorStats::instance()->goodMessage();
+      reportStatus(ePS_Good);
    }
 
 }
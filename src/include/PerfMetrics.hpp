@@ -5,71 +5,87 @@
 
 #include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string>
 
-#include <algorithm>
-#include <string>
-#include <vector>
+#include "LatencyHistogram.hpp"
 
+// Latency samples recorded into a fixed-size LatencyHistogram.  Percentiles
+// can be queried at any time; per-thread instances are combined with merge()
+// and takeInterval() gives reset-on-read reporting windows.
 class PerfMetrics
 {
 public:
    PerfMetrics(std::string title, uint32_t sample_count = 0)
-       : title_(title), samples_()
+       : title_(title), histogram_()
    {
-      if (sample_count > 0)
-         samples_.reserve(sample_count);
    }
 
    void add(uint64_t input)
    {
-      samples_.push_back(input);
+      histogram_.record(input);
+   }
+
+   void merge(const PerfMetrics &other)
+   {
+      histogram_.merge(other.histogram_);
+   }
+
+   // Moves the samples recorded since the last call into interval.
+   void takeInterval(PerfMetrics &interval)
+   {
+      histogram_.snapshot(interval.histogram_);
    }
 
-   void print()
+   uint64_t percentile(double percent) const { return histogram_.valueAtPercentile(percent); }
+   uint64_t count() const { return histogram_.count(); }
+   const zeus_core::LatencyHistogram &histogram() const { return histogram_; }
+
+   void print() const
    {
-      if (samples_.size() == 0)
+      uint64_t samples = histogram_.count();
+      if (samples == 0)
       {
          fprintf(stderr, "[%s] No valid samples for run.\n", title_.c_str());
          return;
       }
 
-      std::sort(samples_.begin(), samples_.end());
-      uint64_t sum = 0;
-
       fprintf(stderr, "\nPerformance results for [%s] (unit: nanoseconds)\n", title_.c_str());
-      for (uint32_t i = 0; i < samples_.size(); ++i)
-      {
-         sum += samples_[i];
-      }
-      fprintf(stderr, "   %-10s %10lu\n", "Samples:", samples_.size());
-      fprintf(stderr, "   %-10s %10lu\n", "Min:", samples_[0]);
-      fprintf(stderr, "   %-10s %10lu\n", "Max:", samples_[samples_.size() - 1]);
-      fprintf(stderr, "   %-10s %10lu\n", "Mean:", sum / samples_.size());
-      fprintf(stderr, "   %-10s %10lu\n", "Median:", samples_[samples_.size() / 2]);
-      if (samples_.size() > 10)
+      fprintf(stderr, "   %-10s %10lu\n", "Samples:", samples);
+      fprintf(stderr, "   %-10s %10lu\n", "Min:", histogram_.min());
+      fprintf(stderr, "   %-10s %10lu\n", "Max:", histogram_.max());
+      fprintf(stderr, "   %-10s %10lu\n", "Mean:", histogram_.mean());
+      fprintf(stderr, "   %-10s %10lu\n", "Median:", percentile(50));
+      if (samples > 10)
       {
          fprintf(stderr, "\n   %-20s\n", "[Percentiles]");
-         fprintf(stderr, "   %-10s %10lu\n", "10th:", samples_[(samples_.size() / 10)]);
-         fprintf(stderr, "   %-10s %10lu\n", "20th:", samples_[(samples_.size() / 10.) * 2]);
-         fprintf(stderr, "   %-10s %10lu\n", "50th:", samples_[(samples_.size() / 10.) * 5]);
-         fprintf(stderr, "   %-10s %10lu\n", "70th:", samples_[(samples_.size() / 10.) * 7]);
-         fprintf(stderr, "   %-10s %10lu\n", "90th:", samples_[(samples_.size() / 10.) * 9]);
+         fprintf(stderr, "   %-10s %10lu\n", "10th:", percentile(10));
+         fprintf(stderr, "   %-10s %10lu\n", "20th:", percentile(20));
+         fprintf(stderr, "   %-10s %10lu\n", "50th:", percentile(50));
+         fprintf(stderr, "   %-10s %10lu\n", "70th:", percentile(70));
+         fprintf(stderr, "   %-10s %10lu\n", "90th:", percentile(90));
       }
-      if (samples_.size() > 100)
+      if (samples > 100)
       {
-         fprintf(stderr, "   %-10s %10lu\n", "95th:", samples_[(samples_.size() / 100.) * 95]);
-         fprintf(stderr, "   %-10s %10lu\n", "99th:", samples_[(samples_.size() / 100.) * 99]);
+         fprintf(stderr, "   %-10s %10lu\n", "95th:", percentile(95));
+         fprintf(stderr, "   %-10s %10lu\n", "99th:", percentile(99));
       }
-      if (samples_.size() >= 10000)
+      if (samples >= 10000)
       {
-         fprintf(stderr, "   %-10s %10lu\n", "99.99th:", samples_[(samples_.size() / 10000.) * 9999]);
+         fprintf(stderr, "   %-10s %10lu\n", "99.99th:", percentile(99.99));
       }
    }
 
+   // One-line rendering for periodic reporting of live intervals.
+   void printSummary() const
+   {
+      fprintf(stderr, "[%s] samples %lu min %lu p50 %lu p99 %lu p99.99 %lu max %lu\n", title_.c_str(),
+              histogram_.count(), histogram_.min(), percentile(50), percentile(99), percentile(99.99), histogram_.max());
+   }
+
 private:
    std::string title_;
-   std::vector<uint64_t> samples_;
+   zeus_core::LatencyHistogram histogram_;
 };
 
 #endif
@@ -0,0 +1,210 @@
+#pragma once
+
+#ifndef __PRICELADDER__
+#define __PRICELADDER__
+
+#include <stdint.h>
+
+#include "OrderDLList.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Tick-indexed price levels.  Level i of the array holds price base_ + i.
+   // The window re-centres on the occupied range (growing when the range no
+   // longer fits) and the lowest/highest occupied indices are cached so the
+   // best price on either side is O(1).
+   template <typename ORDERTYPE, typename PRICE = unsigned long long>
+   class PriceLadder
+   {
+   public:
+      typedef CountedOrderList<ORDERTYPE> Level;
+      typedef PRICE Price;
+
+      PriceLadder(uint32_t ticks = LADDERTICKS)
+          : levels_(0), capacity_(ticks), base_(0), low_(0), high_(0), level_count_(0), relocations_(0)
+      {
+         if (capacity_ < 2)
+            capacity_ = 2;
+         levels_ = new Level[capacity_];
+      }
+
+      ~PriceLadder()
+      {
+         delete[] levels_;
+      }
+
+      bool empty() const { return level_count_ == 0; }
+
+      Level *findLevel(Price price)
+      {
+         if (price < base_ || price - base_ >= capacity_)
+            return 0;
+         Level *level = &levels_[price - base_];
+         if (level->getQuantity() == 0)
+            return 0;
+         return level;
+      }
+
+      Level &addLevel(Price price)
+      {
+         if (level_count_ == 0)
+         {
+            base_ = price >= capacity_ / 2 ? price - capacity_ / 2 : 0;
+         }
+         else if (UNLIKELY(price < base_ || price - base_ >= capacity_))
+         {
+            recentre(price);
+         }
+
+         uint32_t index = price - base_;
+         Level &level = levels_[index];
+         if (level.getQuantity() == 0)
+         {
+            if (level_count_ == 0)
+            {
+               low_ = index;
+               high_ = index;
+            }
+            else if (index < low_)
+            {
+               low_ = index;
+            }
+            else if (index > high_)
+            {
+               high_ = index;
+            }
+            ++level_count_;
+         }
+         return level;
+      }
+
+      void removeLevel(Price price)
+      {
+         uint32_t index = price - base_;
+         if (--level_count_ == 0)
+            return;
+
+         if (index == low_)
+         {
+            while (levels_[++low_].getQuantity() == 0)
+               ;
+         }
+         else if (index == high_)
+         {
+            while (levels_[--high_].getQuantity() == 0)
+               ;
+         }
+      }
+
+      Price lowestPrice() const { return base_ + low_; }
+      Price highestPrice() const { return base_ + high_; }
+
+      Level *lowestLevel() { return &levels_[low_]; }
+      Level *highestLevel() { return &levels_[high_]; }
+
+      template <typename FUNC>
+      void forEachDescending(FUNC func)
+      {
+         if (level_count_ == 0)
+            return;
+         for (uint32_t i = high_ + 1; i-- > low_;)
+         {
+            if (levels_[i].getQuantity() != 0)
+               func(base_ + i, levels_[i]);
+         }
+      }
+
+      template <typename FUNC>
+      void visitFromLowest(FUNC func)
+      {
+         if (level_count_ == 0)
+            return;
+         for (uint32_t i = low_; i <= high_; ++i)
+         {
+            if (levels_[i].getQuantity() != 0 && !func(base_ + i, levels_[i]))
+               return;
+         }
+      }
+
+      template <typename FUNC>
+      void visitFromHighest(FUNC func)
+      {
+         if (level_count_ == 0)
+            return;
+         for (uint32_t i = high_ + 1; i-- > low_;)
+         {
+            if (levels_[i].getQuantity() != 0 && !func(base_ + i, levels_[i]))
+               return;
+         }
+      }
+
+      void clear()
+      {
+         forEachDescending([](Price, Level &level) { level.clearLevel(); });
+         level_count_ = 0;
+      }
+
+      uint32_t capacity() const { return capacity_; }
+
+      // Bumped whenever recentring moves the levels, invalidating Level
+      // pointers held by callers.
+      uint32_t relocations() const { return relocations_; }
+
+      // Every tick in the window already has a level, so there is nothing to
+      // allocate, free or retain.
+      void setRetention(uint32_t) {}
+
+   private:
+      PriceLadder(const PriceLadder &);
+      PriceLadder &operator=(const PriceLadder &);
+
+      void recentre(Price price)
+      {
+         Price lo = base_ + low_;
+         Price hi = base_ + high_;
+         if (price < lo)
+            lo = price;
+         if (price > hi)
+            hi = price;
+
+         uint32_t capacity = capacity_;
+         while (hi - lo + 1 > capacity / 2 && capacity < (MAXPRICE))
+            capacity *= 2;
+
+         Price base = 0;
+         if (capacity >= (MAXPRICE))
+            capacity = (MAXPRICE);
+         else if ((lo + hi) / 2 >= capacity / 2)
+            base = (lo + hi) / 2 - capacity / 2;
+         if (base + capacity > (MAXPRICE))
+            base = (MAXPRICE)-capacity;
+
+         Level *levels = new Level[capacity];
+         for (uint32_t i = low_; i <= high_; ++i)
+         {
+            if (levels_[i].getQuantity() != 0)
+               levels[base_ + i - base] = levels_[i];
+         }
+         low_ = base_ + low_ - base;
+         high_ = base_ + high_ - base;
+
+         delete[] levels_;
+         levels_ = levels;
+         capacity_ = capacity;
+         base_ = base;
+         ++relocations_;
+      }
+
+      Level *levels_;
+      uint32_t capacity_;
+      Price base_;
+      uint32_t low_;
+      uint32_t high_;
+      uint32_t level_count_;
+      uint32_t relocations_;
+   };
+
+}
+
+#endif
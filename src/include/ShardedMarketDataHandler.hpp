@@ -0,0 +1,367 @@
+#pragma once
+
+#ifndef __SHARDEDMARKETDATAHANDLER__
+#define __SHARDEDMARKETDATAHANDLER__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Book.hpp"
+#include "FeedErrorStats.hpp"
+#include "Logger.hpp"
+#include "Parser.hpp"
+#include "SpscRing.hpp"
+#include "SymbolDirectory.hpp"
+#include "ThreadPlacement.hpp"
+#include "TopOfBook.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Ring record types above any symbol ID are control messages.
+   enum ShardRecordType
+   {
+      eSR_PrintBook = 0x10000
+   };
+
+   // Multi-core front end for HANDLER (a MarketDataHandler).  The calling
+   // thread is the dispatcher: it validates the message, interns its symbol
+   // and forwards the raw line over an SpscRing to the worker that owns the
+   // symbol.  Each worker is pinned to its own core (worker_cpus, or the
+   // cores after the dispatcher's by default) and runs a private HANDLER
+   // (books, order pool, logger and error counters), built on the worker
+   // core's NUMA node, so workers share nothing on the hot path.  Ordering
+   // is preserved per symbol.
+   template <typename HANDLER>
+   class ShardedMarketDataHandler
+   {
+   public:
+      ShardedMarketDataHandler(uint32_t shards, uint32_t order_pool_size = ORDERPOOLSIZE, const LoggerOptions &logger_options = LoggerOptions(),
+                               const std::vector<int> &worker_cpus = std::vector<int>())
+          : symbols_(shards), parser_(), shards_(), stopped_(false), top_of_book_(0)
+      {
+         if (shards == 0)
+            shards = 1;
+
+         uint32_t cpus = std::thread::hardware_concurrency();
+         for (uint32_t i = 0; i < shards; ++i)
+         {
+            LoggerOptions options = logger_options;
+            if (options.output_mode_ == eLO_Binary)
+               options.binary_path_ += "." + std::to_string(i);
+
+            int cpu = i < worker_cpus.size() ? worker_cpus[i] : (cpus > 1 ? (i + 1) % cpus : 0);
+            ScopedMemoryNode node(cpu >= 0 ? cpuNode(cpu) : -1);
+            Shard *shard = Shard::create(order_pool_size, options);
+            shard->cpu_ = cpu;
+            shard->first_book_ = i == symbols_.shardFor(0) ? 0 : 1;
+            shards_.push_back(shard);
+         }
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->thread_ = new std::thread(&ShardedMarketDataHandler::runShard, shards_[i]);
+         }
+      }
+
+      ~ShardedMarketDataHandler()
+      {
+         stopWorkers();
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            Shard::destroy(shards_[i]);
+         }
+      }
+
+      void processMessage(const char *line)
+      {
+         processMessage(line, strlen(line));
+      }
+
+      void processMessage(const char *line, size_t len)
+      {
+         MessageFields fields;
+         parser_.splitFields(line, len, fields);
+         processMessage(fields);
+      }
+
+      // Invalid lines are counted and dropped here, with the same checks as
+      // MarketDataHandler, before they can add a symbol.  Workers parse only
+      // valid lines and do not count them again.
+      void processMessage(const MessageFields &fields)
+      {
+         const char *symbol;
+         uint32_t symbol_len;
+         parser_.getSymbol(fields, symbol, symbol_len);
+         if (symbol != 0 && !SymbolDirectory::validSymbol(symbol_len))
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return;
+         }
+         if (!validMessage(fields))
+            return;
+
+         uint32_t symbol_id = 0;
+         if (symbol != 0)
+         {
+            uint32_t known = symbols_.size();
+            symbol_id = symbols_.intern(symbol, symbol_len);
+            if (symbol_id == INVALIDSYMBOL)
+            {
+               FeedErrorStats::instance()->corruptMessage();
+               return;
+            }
+            if (top_of_book_ != 0 && symbols_.size() != known)
+               top_of_book_->bind(symbol_id, symbols_.find(symbol_id)->name_);
+         }
+
+         Shard *shard = shards_[symbols_.shardFor(symbol_id)];
+         shard->routed_ = true;
+         shard->ring_.write(symbol_id, fields.line_, fields.len_, eFP_Block);
+      }
+
+      void processBatch(const MessageFields *messages, uint32_t count)
+      {
+         for (uint32_t i = 0; i < count; ++i)
+         {
+            processMessage(messages[i]);
+         }
+      }
+
+      // Workers apply whatever one pass over their ring yields as a batch,
+      // so conflation coalesces midpoints per book within each pass.
+      void setConflation(bool conflate)
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.setConflation(conflate);
+         }
+      }
+
+      void setOutputConflation(const ConflationOptions &options)
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.setOutputConflation(options);
+         }
+      }
+
+      void setMatching(bool matching)
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.setMatching(matching);
+         }
+      }
+
+      void setBookDepth(uint32_t depth)
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.setBookDepth(depth);
+         }
+      }
+
+      void setLevelRetention(uint32_t retention)
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.setLevelRetention(retention);
+         }
+      }
+
+      // Each shard writes its own trace to path.<shard>.
+      void enableTrace(const std::string &path, uint32_t capacity = TRACECAPACITY)
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.enableTrace(path + "." + std::to_string(i), capacity);
+         }
+      }
+
+      // Must be called before the first message.  The dispatcher names each
+      // record as it interns the symbol; the owning worker updates it.
+      void setTopOfBook(TopOfBookPublisher *publisher)
+      {
+         top_of_book_ = publisher;
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.setTopOfBook(publisher);
+         }
+      }
+
+      // Only shards that own a book print, the unnamed book only from the
+      // shard it belongs to, so the output matches a single handler's.
+      void printCurrentOrderBook()
+      {
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            if (shards_[i]->first_book_ == 0 || shards_[i]->routed_)
+               shards_[i]->ring_.write(eSR_PrintBook, 0, 0, eFP_Block);
+         }
+      }
+
+      // Drains and joins the workers and stops their loggers.  Workers count
+      // feed errors into their own FeedErrorStats blocks, which the process
+      // totals already include.
+      void shutdown()
+      {
+         stopWorkers();
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->handler_.shutdown();
+         }
+
+         fprintf(stderr, "\n[Shard Statistics]\n");
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            fprintf(stderr, "   Shard %-24u %10lu\n", i, shards_[i]->messages_);
+         }
+      }
+
+      uint32_t shardCount() const { return shards_.size(); }
+      uint64_t shardMessages(uint32_t shard) const { return shards_[shard]->messages_; }
+      const SymbolDirectory &symbols() const { return symbols_; }
+
+   private:
+      ShardedMarketDataHandler(const ShardedMarketDataHandler &);
+      ShardedMarketDataHandler &operator=(const ShardedMarketDataHandler &);
+
+      struct Shard
+      {
+         Shard(uint32_t order_pool_size, const LoggerOptions &logger_options)
+             : handler_(order_pool_size, logger_options), ring_(SHARDRINGSLOTS, logger_options.wait_strategy_),
+               thread_(0), exit_(false), cpu_(0), first_book_(0), routed_(false), messages_(0), batch_count_(0)
+         {
+            handler_.setPrevalidated(true);
+         }
+
+         ~Shard()
+         {
+            delete thread_;
+         }
+
+         // The ring's cache-line alignment is beyond what new guarantees.
+         static Shard *create(uint32_t order_pool_size, const LoggerOptions &logger_options)
+         {
+            void *memory = 0;
+            if (posix_memalign(&memory, alignof(Shard), sizeof(Shard)) != 0)
+               throw std::bad_alloc();
+            return new (memory) Shard(order_pool_size, logger_options);
+         }
+
+         static void destroy(Shard *shard)
+         {
+            shard->~Shard();
+            free(shard);
+         }
+
+         HANDLER handler_;
+         SpscRing ring_;
+         std::thread *thread_;
+         std::atomic<bool> exit_;
+         int cpu_;
+         uint32_t first_book_;
+         bool routed_;
+         uint64_t messages_;
+         MessageFields batch_[MESSAGEBATCHSIZE];
+         uint32_t batch_symbols_[MESSAGEBATCHSIZE];
+         uint32_t batch_count_;
+         Parser parser_;
+
+         void flushBatch()
+         {
+            handler_.processBatch(batch_, batch_symbols_, batch_count_);
+            messages_ += batch_count_;
+            batch_count_ = 0;
+         }
+      };
+
+      bool validMessage(const MessageFields &fields)
+      {
+         MessageType mt = parser_.getMessageType(fields);
+         if (mt == eMT_Unknown)
+         {
+            FeedErrorStats::instance()->corruptMessage();
+            return false;
+         }
+         if (mt == eMT_Trade)
+         {
+            TradeMessage tm;
+            parser_.parseTrade(fields, tm);
+            return tm.trade_price_ != 0;
+         }
+         OrderLevelEntry ole;
+         parser_.parseOrder(fields, ole);
+         return ole.order_side_ != eS_Unknown;
+      }
+
+      static void runShard(Shard *shard)
+      {
+         pinThread(shard->cpu_, "shard worker");
+
+         // Records stay valid until drain() returns, so a pass is batched
+         // in place and flushed before a book print or at the end.
+         auto process = [shard](uint32_t type, const char *data, uint32_t len) {
+            if (type == eSR_PrintBook)
+            {
+               shard->flushBatch();
+               shard->handler_.printCurrentOrderBook(shard->first_book_);
+               return;
+            }
+            shard->parser_.splitFields(data, len, shard->batch_[shard->batch_count_]);
+            shard->batch_symbols_[shard->batch_count_] = type;
+            if (++shard->batch_count_ == MESSAGEBATCHSIZE)
+               shard->flushBatch();
+         };
+
+         while (1)
+         {
+            uint32_t drained = shard->ring_.drain(process);
+            shard->flushBatch();
+            if (drained == 0)
+            {
+               if (shard->exit_)
+               {
+                  shard->ring_.drain(process);
+                  shard->flushBatch();
+                  break;
+               }
+               shard->ring_.wait();
+            }
+         }
+      }
+
+      void stopWorkers()
+      {
+         if (stopped_)
+            return;
+         stopped_ = true;
+
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->exit_ = true;
+            shards_[i]->ring_.wake();
+         }
+         for (uint32_t i = 0; i < shards_.size(); ++i)
+         {
+            shards_[i]->thread_->join();
+         }
+      }
+
+      SymbolDirectory symbols_;
+      Parser parser_;
+      std::vector<Shard *> shards_;
+      bool stopped_;
+      TopOfBookPublisher *top_of_book_;
+   };
+
+}
+
+#endif
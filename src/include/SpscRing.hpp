@@ -0,0 +1,252 @@
+#pragma once
+
+#ifndef __SPSCRING__
+#define __SPSCRING__
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   enum WaitStrategy
+   {
+      eWS_BusySpin,
+      eWS_SpinYield,
+      eWS_FutexPark
+   };
+
+   enum FullPolicy
+   {
+      eFP_Block,
+      eFP_Drop
+   };
+
+   struct RingRecordHeader
+   {
+      uint32_t len_;
+      uint32_t slots_;
+      uint32_t type_;
+      uint32_t reserved_;
+   };
+
+   inline void cpuRelax()
+   {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+   }
+
+   // Bounded single-producer/single-consumer ring of fixed-size records.  A
+   // message occupies as many consecutive records as it needs (a padding
+   // record fills the gap at the wrap point), so the consumer always sees a
+   // message as one contiguous payload.  Head and tail live on their own
+   // cache lines and each side caches the other's position, only reloading
+   // it when the ring looks full or empty.
+   class SpscRing
+   {
+   public:
+      static const uint32_t RECORD_SIZE = RINGRECORDSIZE;
+      static const uint32_t PADDING_TYPE = 0xFFFFFFFF;
+
+      SpscRing(uint32_t slots = LOGGERRINGSLOTS, WaitStrategy wait_strategy = eWS_SpinYield)
+          : buffer_(0), capacity_(2), mask_(0), wait_strategy_(wait_strategy), head_(0), cached_tail_(0),
+            tail_(0), claim_tail_(0), cached_head_(0), full_events_(0), dropped_(0), parked_(0), futex_word_(0)
+      {
+         while (capacity_ < slots)
+            capacity_ *= 2;
+         mask_ = capacity_ - 1;
+         buffer_ = new char[(size_t)capacity_ * RECORD_SIZE];
+         memset(buffer_, 0, (size_t)capacity_ * RECORD_SIZE);
+      }
+
+      ~SpscRing()
+      {
+         delete[] buffer_;
+      }
+
+      uint32_t maxPayload() const { return capacity_ * RECORD_SIZE - sizeof(RingRecordHeader); }
+
+      // Producer side.  Returns space for len bytes, or 0 if the ring is full
+      // and the policy is eFP_Drop.  The record is invisible to the consumer
+      // until publish().
+      char *claim(uint32_t type, uint32_t len, FullPolicy policy)
+      {
+         uint32_t slots = (len + sizeof(RingRecordHeader) + RECORD_SIZE - 1) / RECORD_SIZE;
+         if (UNLIKELY(slots > capacity_))
+         {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return 0;
+         }
+
+         uint64_t tail = claim_tail_;
+         uint32_t index = tail & mask_;
+         uint32_t padding = index + slots > capacity_ ? capacity_ - index : 0;
+         uint64_t needed = tail + padding + slots;
+
+         if (UNLIKELY(needed - cached_head_ > capacity_))
+         {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (needed - cached_head_ > capacity_)
+            {
+               full_events_.store(full_events_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+               if (policy == eFP_Drop)
+               {
+                  dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                  return 0;
+               }
+               while (needed - cached_head_ > capacity_)
+               {
+                  cpuRelax();
+                  cached_head_ = head_.load(std::memory_order_acquire);
+               }
+            }
+         }
+
+         if (padding != 0)
+         {
+            RingRecordHeader *pad = header(index);
+            pad->len_ = 0;
+            pad->type_ = PADDING_TYPE;
+            pad->slots_ = padding;
+            index = 0;
+         }
+         RingRecordHeader *record = header(index);
+         record->len_ = len;
+         record->type_ = type;
+         record->slots_ = slots;
+         claim_tail_ = needed;
+         return (char *)(record + 1);
+      }
+
+      void publish()
+      {
+         tail_.store(claim_tail_, std::memory_order_release);
+         if (wait_strategy_ == eWS_FutexPark)
+         {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parked_.load(std::memory_order_relaxed) != 0)
+               wake();
+         }
+      }
+
+      bool write(uint32_t type, const void *data, uint32_t len, FullPolicy policy)
+      {
+         char *payload = claim(type, len, policy);
+         if (payload == 0)
+            return false;
+         memcpy(payload, data, len);
+         publish();
+         return true;
+      }
+
+      // Consumer side.  Hands up to max_messages published messages to
+      // func(type, data, len) and releases their records in one store.
+      template <typename FUNC>
+      uint32_t drain(FUNC func, uint32_t max_messages = UINT_MAX)
+      {
+         uint64_t head = head_.load(std::memory_order_relaxed);
+         if (head == cached_tail_)
+         {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+               return 0;
+         }
+
+         uint32_t messages = 0;
+         while (head != cached_tail_ && messages < max_messages)
+         {
+            RingRecordHeader *record = header(head & mask_);
+            if (record->type_ != PADDING_TYPE)
+            {
+               func(record->type_, (const char *)(record + 1), record->len_);
+               ++messages;
+            }
+            head += record->slots_;
+         }
+         head_.store(head, std::memory_order_release);
+         return messages;
+      }
+
+      bool empty()
+      {
+         return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+      }
+
+      // Blocks the consumer for one wait quantum or until data arrives,
+      // according to the wait strategy.
+      void wait()
+      {
+         for (uint32_t i = 0; i < RINGSPINCOUNT; ++i)
+         {
+            if (!empty())
+               return;
+            cpuRelax();
+         }
+
+         if (wait_strategy_ == eWS_SpinYield)
+         {
+            sched_yield();
+         }
+         else if (wait_strategy_ == eWS_FutexPark)
+         {
+            uint32_t word = futex_word_.load(std::memory_order_seq_cst);
+            parked_.store(1, std::memory_order_seq_cst);
+            if (empty())
+            {
+               struct timespec timeout = {0, RINGPARKNANOS};
+               syscall(SYS_futex, (int *)&futex_word_, FUTEX_WAIT_PRIVATE, word, &timeout, NULL, 0);
+            }
+            parked_.store(0, std::memory_order_relaxed);
+         }
+      }
+
+      void wake()
+      {
+         futex_word_.fetch_add(1, std::memory_order_seq_cst);
+         syscall(SYS_futex, (int *)&futex_word_, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+      }
+
+      uint64_t fullEvents() const { return full_events_.load(std::memory_order_relaxed); }
+      uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+      WaitStrategy waitStrategy() const { return wait_strategy_; }
+
+   private:
+      SpscRing(const SpscRing &);
+      SpscRing &operator=(const SpscRing &);
+
+      inline RingRecordHeader *header(uint32_t index)
+      {
+         return (RingRecordHeader *)(buffer_ + (size_t)index * RECORD_SIZE);
+      }
+
+      char *buffer_;
+      uint32_t capacity_;
+      uint32_t mask_;
+      WaitStrategy wait_strategy_;
+
+      alignas(64) std::atomic<uint64_t> head_;
+      uint64_t cached_tail_;
+
+      alignas(64) std::atomic<uint64_t> tail_;
+      uint64_t claim_tail_;
+      uint64_t cached_head_;
+      std::atomic<uint64_t> full_events_;
+      std::atomic<uint64_t> dropped_;
+
+      alignas(64) std::atomic<uint32_t> parked_;
+      std::atomic<uint32_t> futex_word_;
+   };
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+#pragma once
+
+#ifndef __STRUCTURALINDEX__
+#define __STRUCTURALINDEX__
+
+#include <stdint.h>
+
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRUCTURAL_INDEX_X86 1
+#endif
+
+#include "Parser.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   enum StructuralIsa
+   {
+      eSI_Scalar,
+      eSI_SSE2,
+      eSI_AVX2
+   };
+
+   // Each scanner appends the offsets of every ',' and '\n' in
+   // data[begin, len) to out and returns the number written.
+   typedef uint32_t (*StructuralScanner)(const char *data, uint32_t begin, uint32_t len, uint32_t *out);
+
+   inline uint32_t scanStructuralScalar(const char *data, uint32_t begin, uint32_t len, uint32_t *out)
+   {
+      uint32_t count = 0;
+      for (uint32_t i = begin; i < len; ++i)
+      {
+         if (data[i] == ',' || data[i] == '\n')
+            out[count++] = i;
+      }
+      return count;
+   }
+
+#ifdef STRUCTURAL_INDEX_X86
+   __attribute__((target("sse2"))) inline uint32_t scanStructuralSSE2(const char *data, uint32_t begin, uint32_t len, uint32_t *out)
+   {
+      const __m128i comma = _mm_set1_epi8(',');
+      const __m128i newline = _mm_set1_epi8('\n');
+      uint32_t count = 0;
+      uint32_t i = begin;
+      for (; i + 16 <= len; i += 16)
+      {
+         __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+         uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, newline)));
+         while (mask != 0)
+         {
+            out[count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+         }
+      }
+      return count + scanStructuralScalar(data, i, len, out + count);
+   }
+
+   __attribute__((target("avx2"))) inline uint32_t scanStructuralAVX2(const char *data, uint32_t begin, uint32_t len, uint32_t *out)
+   {
+      const __m256i comma = _mm256_set1_epi8(',');
+      const __m256i newline = _mm256_set1_epi8('\n');
+      uint32_t count = 0;
+      uint32_t i = begin;
+      for (; i + 32 <= len; i += 32)
+      {
+         __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+         uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, comma), _mm256_cmpeq_epi8(chunk, newline)));
+         while (mask != 0)
+         {
+            out[count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+         }
+      }
+      return count + scanStructuralSSE2(data, i, len, out + count);
+   }
+#endif
+
+   inline StructuralIsa bestStructuralIsa()
+   {
+#ifdef STRUCTURAL_INDEX_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+         return eSI_AVX2;
+      if (__builtin_cpu_supports("sse2"))
+         return eSI_SSE2;
+#endif
+      return eSI_Scalar;
+   }
+
+   inline const char *structuralIsaName(StructuralIsa isa)
+   {
+      switch (isa)
+      {
+      case eSI_AVX2:
+         return "AVX2";
+      case eSI_SSE2:
+         return "SSE2";
+      default:
+         return "Scalar";
+      }
+   }
+
+   // Vectorized pre-pass over a block of the text feed.  index() records the
+   // offset of every comma and newline in the block once; nextMessage() then
+   // hands out each line's fields from those offsets without looking at the
+   // bytes again.  Unless the block is final, a trailing line without a
+   // newline is left for the next block (see consumed()).
+   class StructuralIndex
+   {
+   public:
+      StructuralIndex(StructuralIsa isa = bestStructuralIsa())
+          : scanner_(&scanStructuralScalar), isa_(eSI_Scalar), offsets_(), data_(0), len_(0), count_(0), next_(0), line_start_(0), final_(false)
+      {
+         setIsa(isa);
+      }
+
+      void setIsa(StructuralIsa isa)
+      {
+         isa_ = eSI_Scalar;
+         scanner_ = &scanStructuralScalar;
+#ifdef STRUCTURAL_INDEX_X86
+         if (isa == eSI_AVX2 && __builtin_cpu_supports("avx2"))
+         {
+            isa_ = eSI_AVX2;
+            scanner_ = &scanStructuralAVX2;
+         }
+         else if (isa != eSI_Scalar)
+         {
+            isa_ = eSI_SSE2;
+            scanner_ = &scanStructuralSSE2;
+         }
+#endif
+      }
+
+      StructuralIsa isa() const { return isa_; }
+
+      void index(const char *data, uint32_t len, bool final)
+      {
+         if (offsets_.size() < len)
+            offsets_.resize(len);
+         data_ = data;
+         len_ = len;
+         final_ = final;
+         count_ = scanner_(data, 0, len, offsets_.data());
+         next_ = 0;
+         line_start_ = 0;
+      }
+
+      bool nextMessage(MessageFields &fields)
+      {
+         if (line_start_ >= len_)
+            return false;
+
+         fields.line_ = data_ + line_start_;
+         fields.count_ = 0;
+
+         uint32_t field_start = line_start_;
+         for (uint32_t i = next_; i < count_; ++i)
+         {
+            uint32_t offset = offsets_[i];
+            if (data_[offset] == '\n')
+            {
+               fields.addField(field_start - line_start_, offset + 1 - line_start_);
+               fields.len_ = offset + 1 - line_start_;
+               next_ = i + 1;
+               line_start_ = offset + 1;
+               return true;
+            }
+            fields.addField(field_start - line_start_, offset - line_start_);
+            field_start = offset + 1;
+         }
+
+         if (!final_)
+            return false;
+
+         fields.addField(field_start - line_start_, len_ - line_start_);
+         fields.len_ = len_ - line_start_;
+         next_ = count_;
+         line_start_ = len_;
+         return true;
+      }
+
+      uint32_t consumed() const { return line_start_; }
+
+   private:
+      StructuralScanner scanner_;
+      StructuralIsa isa_;
+      std::vector<uint32_t> offsets_;
+      const char *data_;
+      uint32_t len_;
+      uint32_t count_;
+      uint32_t next_;
+      uint32_t line_start_;
+      bool final_;
+   };
+
+}
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+#ifndef __SYMBOLDIRECTORY__
+#define __SYMBOLDIRECTORY__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "FlatOrderIndex.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   struct SymbolEntry
+   {
+      uint32_t id_;
+      uint32_t shard_;
+      char name_[SYMBOLLENMAX + 1];
+   };
+
+   // Interns symbol names into dense IDs.  ID 0 is the unnamed symbol used
+   // by messages without a symbol field.  Each new symbol is assigned to a
+   // shard round-robin so shards own a disjoint set of books.  IDs stop at
+   // SYMBOLSMAX, below 0xFFFF, so they fit the 16-bit symbol field of a
+   // binary feed or journal record.
+   class SymbolDirectory
+   {
+   public:
+      SymbolDirectory(uint32_t shards = 1)
+          : index_(1024), entries_(), shards_(shards == 0 ? 1 : shards), next_shard_(0)
+      {
+         addEntry(0, "", 0);
+      }
+
+      ~SymbolDirectory()
+      {
+         for (uint32_t i = 0; i < entries_.size(); ++i)
+         {
+            delete entries_[i];
+         }
+      }
+
+      // Returns the symbol's ID, adding it if it is new, or INVALIDSYMBOL if
+      // the name is empty, too long or the directory is full.
+      uint32_t intern(const char *symbol, uint32_t len)
+      {
+         if (!validSymbol(len))
+            return INVALIDSYMBOL;
+
+         uint64_t key = packSymbol(symbol, len);
+         SymbolEntry *entry = index_.find(key);
+         if (LIKELY(entry != 0))
+            return entry->id_;
+
+         if (entries_.size() > SYMBOLSMAX)
+         {
+            fprintf(stderr, "Symbol directory full at %u symbols.\n", (uint32_t)entries_.size());
+            return INVALIDSYMBOL;
+         }
+         entry = addEntry(key, symbol, len);
+         return entry->id_;
+      }
+
+      const SymbolEntry *find(uint32_t id) const
+      {
+         if (id >= entries_.size())
+            return 0;
+         return entries_[id];
+      }
+
+      uint32_t shardFor(uint32_t id) const
+      {
+         return id < entries_.size() ? entries_[id]->shard_ : 0;
+      }
+
+      uint32_t size() const { return entries_.size(); }
+
+      // Whether a name of len could be interned; lets callers reject a bad
+      // symbol before validating the rest of the message.
+      static bool validSymbol(uint32_t len) { return len != 0 && len <= SYMBOLLENMAX; }
+
+      static uint64_t packSymbol(const char *symbol, uint32_t len)
+      {
+         uint64_t key = 0;
+         memcpy(&key, symbol, len);
+         return key;
+      }
+
+   private:
+      SymbolDirectory(const SymbolDirectory &);
+      SymbolDirectory &operator=(const SymbolDirectory &);
+
+      SymbolEntry *addEntry(uint64_t key, const char *symbol, uint32_t len)
+      {
+         SymbolEntry *entry = new SymbolEntry();
+         entry->id_ = entries_.size();
+         entry->shard_ = 0;
+         if (entry->id_ != 0)
+         {
+            entry->shard_ = next_shard_;
+            next_shard_ = (next_shard_ + 1) % shards_;
+         }
+         memcpy(entry->name_, symbol, len);
+         entry->name_[len] = '\0';
+
+         entries_.push_back(entry);
+         if (entry->id_ != 0)
+            index_.insert(key, entry);
+         return entry;
+      }
+
+      FlatOrderIndex<uint64_t, SymbolEntry> index_;
+      std::vector<SymbolEntry *> entries_;
+      uint32_t shards_;
+      uint32_t next_shard_;
+   };
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+
+#ifndef __THREADPLACEMENT__
+#define __THREADPLACEMENT__
+
+#include <dirent.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   // Cores for the feed (book) thread, the logger thread and each shard
+   // worker.  A cpu of -1 leaves that thread where the scheduler puts it.
+   struct ThreadPlacement
+   {
+      ThreadPlacement() : feed_cpu_(-1), logger_cpu_(-1), worker_cpus_(), lock_memory_(false) {}
+
+      int feed_cpu_;
+      int logger_cpu_;
+      std::vector<int> worker_cpus_;
+      bool lock_memory_;
+   };
+
+   // NUMA node of cpu from sysfs, or -1 if it cannot be determined.
+   inline int cpuNode(int cpu)
+   {
+      char path[64];
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+      DIR *dir = opendir(path);
+      if (dir == 0)
+         return -1;
+
+      int node = -1;
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != 0)
+      {
+         if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+         {
+            node = atoi(entry->d_name + 4);
+            break;
+         }
+      }
+      closedir(dir);
+      return node;
+   }
+
+   // Sets the calling thread's memory policy to prefer node, so pages it
+   // first touches from here on come from that node.  -1 restores the
+   // default (local) policy.  Raw syscall, so there is no libnuma dependency.
+   inline bool preferMemoryNode(int node)
+   {
+      if (node < 0)
+         return syscall(SYS_set_mempolicy, MPOL_DEFAULT, 0, 0) == 0;
+      if (node >= (int)(sizeof(unsigned long) * 8))
+         return false;
+      unsigned long mask = 1UL << node;
+      return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1) == 0;
+   }
+
+   // Pins the calling thread to cpu and prefers that cpu's NUMA node for
+   // its allocations.  role names the thread in the error message.
+   inline bool pinThread(int cpu, const char *role)
+   {
+      if (cpu < 0)
+         return true;
+
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+      {
+         fprintf(stderr, "Unable to pin %s thread to cpu %d.\n", role, cpu);
+         return false;
+      }
+      int node = cpuNode(cpu);
+      if (node >= 0 && !preferMemoryNode(node))
+         fprintf(stderr, "Unable to prefer NUMA node %d for %s thread.\n", node, role);
+      return true;
+   }
+
+   // Allocations made by this thread while in scope prefer node, e.g. to
+   // build a worker's pools on the worker's node before it starts.  The
+   // thread's previous policy is restored on exit.
+   class ScopedMemoryNode
+   {
+   public:
+      ScopedMemoryNode(int node) : restore_(false), mode_(MPOL_DEFAULT), mask_(0)
+      {
+         if (node < 0)
+            return;
+         restore_ = syscall(SYS_get_mempolicy, &mode_, &mask_, sizeof(mask_) * 8 + 1, 0, 0) == 0;
+         if (restore_)
+            preferMemoryNode(node);
+      }
+
+      ~ScopedMemoryNode()
+      {
+         if (restore_)
+            syscall(SYS_set_mempolicy, mode_, mode_ == MPOL_DEFAULT ? 0 : &mask_, sizeof(mask_) * 8 + 1);
+      }
+
+   private:
+      ScopedMemoryNode(const ScopedMemoryNode &);
+      ScopedMemoryNode &operator=(const ScopedMemoryNode &);
+
+      bool restore_;
+      int mode_;
+      unsigned long mask_;
+   };
+
+   // Locks current and future memory.  MCL_FUTURE also makes the kernel
+   // populate each later mapping as it is created, so pools allocated at
+   // startup are prefaulted rather than faulted in on the hot path.  Skipped
+   // with a warning if RLIMIT_MEMLOCK would make later allocations fail.
+   inline bool lockMemory()
+   {
+      struct rlimit limit;
+      if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+      {
+         fprintf(stderr, "Not locking memory: RLIMIT_MEMLOCK is %lu bytes (raise ulimit -l).\n",
+                 (unsigned long)limit.rlim_cur);
+         return false;
+      }
+      if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+      {
+         fprintf(stderr, "Unable to lock memory: %s.\n", strerror(errno));
+         return false;
+      }
+      return true;
+   }
+
+}
+
+#endif
@@ -0,0 +1,278 @@
+#pragma once
+
+#ifndef __TOPOFBOOK__
+#define __TOPOFBOOK__
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "SpscRing.hpp"
+#include "Utils.hpp"
+
+namespace zeus_core
+{
+   static const uint64_t TOPOFBOOKMAGIC = 0x4B4F4F42504F545AULL;
+
+   // Best bid/ask, their sizes and the last trade for one book.  Prices are
+   // in the book's integer price units; 0 means that side is empty.
+   // update_tsc_ is the writer's TscClock reading when the quote changed.
+   struct TopOfBookQuote
+   {
+      uint64_t bid_price_;
+      uint64_t ask_price_;
+      uint64_t last_trade_price_;
+      uint64_t update_tsc_;
+      uint32_t bid_quantity_;
+      uint32_t ask_quantity_;
+      uint32_t last_trade_quantity_;
+      uint32_t symbol_id_;
+      char symbol_[SYMBOLLENMAX];
+   };
+
+   // One cache line per book.  The owning handler thread is the only writer;
+   // sequence_ is odd while it is mid-update, so readers copy the quote and
+   // retry if the sequence changed underneath them.
+   struct alignas(64) TopOfBookRecord
+   {
+      std::atomic<uint64_t> sequence_;
+      TopOfBookQuote quote_;
+
+      inline TopOfBookQuote &beginWrite()
+      {
+         sequence_.store(sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_release);
+         return quote_;
+      }
+
+      inline void endWrite()
+      {
+         sequence_.store(sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+
+      // Returns false if nothing has been published for this book yet.
+      inline bool read(TopOfBookQuote &quote) const
+      {
+         while (1)
+         {
+            uint64_t before = sequence_.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+               cpuRelax();
+               continue;
+            }
+            memcpy(&quote, (const void *)&quote_, sizeof(quote));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence_.load(std::memory_order_relaxed) == before)
+               return before != 0;
+         }
+      }
+   };
+
+   struct alignas(64) TopOfBookRegion
+   {
+      uint64_t magic_;
+      uint32_t capacity_;
+      uint32_t record_size_;
+      std::atomic<uint32_t> symbol_count_;
+   };
+
+   inline size_t topOfBookRegionSize(uint32_t capacity)
+   {
+      return sizeof(TopOfBookRegion) + (size_t)capacity * sizeof(TopOfBookRecord);
+   }
+
+   inline TopOfBookRecord *topOfBookRecords(const TopOfBookRegion *region)
+   {
+      return (TopOfBookRecord *)((char *)region + sizeof(TopOfBookRegion));
+   }
+
+   // Owner of the shared-memory object name (e.g. /zeus_tob).  Records are
+   // indexed by symbol ID; a book binds its record once and then updates it
+   // in place, so publishing never allocates or locks.
+   class TopOfBookPublisher
+   {
+   public:
+      TopOfBookPublisher(const std::string &name, uint32_t capacity = TOPOFBOOKRECORDS)
+          : name_(name), capacity_(capacity), region_(0)
+      {
+      }
+
+      ~TopOfBookPublisher()
+      {
+         stop();
+      }
+
+      bool start()
+      {
+         int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+         if (fd < 0)
+         {
+            fprintf(stderr, "Unable to create shared memory %s.\n", name_.c_str());
+            return false;
+         }
+         size_t size = topOfBookRegionSize(capacity_);
+         if (ftruncate(fd, size) != 0)
+         {
+            fprintf(stderr, "Unable to size shared memory %s.\n", name_.c_str());
+            close(fd);
+            return false;
+         }
+         void *memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+         close(fd);
+         if (memory == MAP_FAILED)
+         {
+            fprintf(stderr, "Unable to map shared memory %s.\n", name_.c_str());
+            return false;
+         }
+         memset(memory, 0, size);
+
+         region_ = new (memory) TopOfBookRegion();
+         region_->capacity_ = capacity_;
+         region_->record_size_ = sizeof(TopOfBookRecord);
+         region_->symbol_count_.store(0, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_release);
+         region_->magic_ = TOPOFBOOKMAGIC;
+         return true;
+      }
+
+      // Unmaps and removes the object; readers keep their existing mapping.
+      void stop()
+      {
+         if (region_ == 0)
+            return;
+         munmap(region_, topOfBookRegionSize(capacity_));
+         shm_unlink(name_.c_str());
+         region_ = 0;
+      }
+
+      // Returns the record for symbol_id, or 0 if it is past the capacity.
+      // A non-null symbol names the record for readers looking it up.
+      TopOfBookRecord *bind(uint32_t symbol_id, const char *symbol)
+      {
+         if (region_ == 0 || symbol_id >= capacity_)
+            return 0;
+
+         TopOfBookRecord *record = topOfBookRecords(region_) + symbol_id;
+         if (symbol != 0 && record->quote_.symbol_[0] == '\0')
+         {
+            TopOfBookQuote &quote = record->beginWrite();
+            quote.symbol_id_ = symbol_id;
+            strncpy(quote.symbol_, symbol, SYMBOLLENMAX);
+            record->endWrite();
+         }
+
+         uint32_t count = region_->symbol_count_.load(std::memory_order_relaxed);
+         while (count <= symbol_id &&
+                !region_->symbol_count_.compare_exchange_weak(count, symbol_id + 1, std::memory_order_release))
+         {
+         }
+         return record;
+      }
+
+      uint32_t capacity() const { return capacity_; }
+
+   private:
+      TopOfBookPublisher(const TopOfBookPublisher &);
+      TopOfBookPublisher &operator=(const TopOfBookPublisher &);
+
+      std::string name_;
+      uint32_t capacity_;
+      TopOfBookRegion *region_;
+   };
+
+   // Read-only view of a TopOfBookPublisher region for a co-located consumer.
+   class TopOfBookReader
+   {
+   public:
+      TopOfBookReader() : region_(0), size_(0) {}
+
+      ~TopOfBookReader()
+      {
+         detach();
+      }
+
+      bool attach(const std::string &name)
+      {
+         detach();
+         int fd = shm_open(name.c_str(), O_RDONLY, 0);
+         if (fd < 0)
+            return false;
+
+         struct stat st;
+         if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TopOfBookRegion))
+         {
+            close(fd);
+            return false;
+         }
+         void *memory = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+         close(fd);
+         if (memory == MAP_FAILED)
+            return false;
+
+         region_ = (const TopOfBookRegion *)memory;
+         size_ = st.st_size;
+         if (region_->magic_ != TOPOFBOOKMAGIC || region_->record_size_ != sizeof(TopOfBookRecord) ||
+             topOfBookRegionSize(region_->capacity_) > size_)
+         {
+            fprintf(stderr, "Shared memory %s is not a compatible top of book region.\n", name.c_str());
+            detach();
+            return false;
+         }
+         return true;
+      }
+
+      void detach()
+      {
+         if (region_ == 0)
+            return;
+         munmap((void *)region_, size_);
+         region_ = 0;
+         size_ = 0;
+      }
+
+      uint32_t symbolCount() const
+      {
+         return region_->symbol_count_.load(std::memory_order_acquire);
+      }
+
+      const TopOfBookRecord *record(uint32_t symbol_id) const
+      {
+         if (symbol_id >= region_->capacity_)
+            return 0;
+         return topOfBookRecords(region_) + symbol_id;
+      }
+
+      // Linear scan by name; look a symbol up once and keep its record.
+      const TopOfBookRecord *find(const char *symbol) const
+      {
+         uint32_t count = symbolCount();
+         for (uint32_t i = 0; i < count; ++i)
+         {
+            const TopOfBookRecord *candidate = record(i);
+            TopOfBookQuote quote;
+            if (candidate->read(quote) && quote.symbol_[0] != '\0' && strncmp(quote.symbol_, symbol, SYMBOLLENMAX) == 0)
+               return candidate;
+         }
+         return 0;
+      }
+
+   private:
+      TopOfBookReader(const TopOfBookReader &);
+      TopOfBookReader &operator=(const TopOfBookReader &);
+
+      const TopOfBookRegion *region_;
+      size_t size_;
+   };
+
+}
+
+#endif
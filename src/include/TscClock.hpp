@@ -0,0 +1,163 @@
+#pragma once
+
+#ifndef __TSCCLOCK__
+#define __TSCCLOCK__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "Utils.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define TSC_CLOCK_X86 1
+#endif
+
+namespace zeus_core
+{
+   // Process-wide cycle counter.  instance() calibrates once: the TSC
+   // frequency comes from CPUID leaf 0x15 when the CPU reports it, otherwise
+   // from a TSCCALIBRATIONNANOS window against CLOCK_MONOTONIC_RAW.  Without
+   // an invariant TSC the clock falls back to CLOCK_MONOTONIC_RAW itself, so
+   // cycles() is then already in nanoseconds.  Cycle counts are converted to
+   // nanoseconds with a 32.32 fixed-point multiplier.
+   class TscClock
+   {
+   public:
+      static const TscClock &instance()
+      {
+         static TscClock clock;
+         return clock;
+      }
+
+      // Serialised reads for the start and end of a measured region: lfence
+      // keeps rdtsc from executing before earlier instructions, rdtscp waits
+      // for the measured code to finish.
+      inline uint64_t start() const
+      {
+#ifdef TSC_CLOCK_X86
+         if (LIKELY(use_tsc_))
+         {
+            uint32_t lo, hi;
+            __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi)::"memory");
+            return ((uint64_t)hi << 32) | lo;
+         }
+#endif
+         return monotonicNanos();
+      }
+
+      inline uint64_t stop() const
+      {
+#ifdef TSC_CLOCK_X86
+         if (LIKELY(use_tsc_))
+         {
+            uint32_t lo, hi, aux;
+            if (has_rdtscp_)
+               __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux)::"memory");
+            else
+               __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi)::"memory");
+            return ((uint64_t)hi << 32) | lo;
+         }
+#endif
+         return monotonicNanos();
+      }
+
+      inline uint64_t toNanos(uint64_t cycles) const
+      {
+         return (uint64_t)(((unsigned __int128)cycles * nanos_per_cycle_) >> 32);
+      }
+
+      uint64_t hz() const { return hz_; }
+      bool invariant() const { return use_tsc_; }
+
+      static uint64_t monotonicNanos()
+      {
+         struct timespec ts;
+         clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+         return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+      }
+
+   private:
+      TscClock()
+          : use_tsc_(false), has_rdtscp_(false), hz_(1000000000ULL), nanos_per_cycle_(1ULL << 32)
+      {
+#ifdef TSC_CLOCK_X86
+         uint32_t eax, ebx, ecx, edx;
+         uint32_t max_extended = __get_cpuid_max(0x80000000, 0);
+         if (max_extended >= 0x80000007 && __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+            use_tsc_ = (edx & (1 << 8)) != 0;
+         if (max_extended >= 0x80000001 && __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+            has_rdtscp_ = (edx & (1 << 27)) != 0;
+
+         if (use_tsc_)
+         {
+            hz_ = cpuidFrequency();
+            if (hz_ == 0)
+               hz_ = measureFrequency();
+            nanos_per_cycle_ = (1000000000ULL << 32) / hz_;
+         }
+         else
+         {
+            fprintf(stderr, "No invariant TSC.  Timing with CLOCK_MONOTONIC_RAW.\n");
+         }
+#endif
+         fprintf(stderr, "Ticks/sec: %lu.  MHz: %f\n", hz_, hz_ / 1000000.0);
+      }
+
+      TscClock(const TscClock &);
+      TscClock &operator=(const TscClock &);
+
+#ifdef TSC_CLOCK_X86
+      static uint64_t cpuidFrequency()
+      {
+         uint32_t denominator, numerator, crystal_hz, edx;
+         if (__get_cpuid_max(0, 0) < 0x15)
+            return 0;
+         __cpuid(0x15, denominator, numerator, crystal_hz, edx);
+         if (denominator == 0 || numerator == 0 || crystal_hz == 0)
+            return 0;
+         return (uint64_t)crystal_hz * numerator / denominator;
+      }
+
+      // Brackets each clock_gettime between two TSC reads and keeps the
+      // tightest bracket at either end of the window.
+      uint64_t measureFrequency() const
+      {
+         uint64_t start_tsc, start_ns;
+         uint64_t end_tsc, end_ns;
+         sample(start_tsc, start_ns);
+         do
+         {
+            sample(end_tsc, end_ns);
+         } while (end_ns - start_ns < TSCCALIBRATIONNANOS);
+         return (end_tsc - start_tsc) * 1000000000ULL / (end_ns - start_ns);
+      }
+
+      void sample(uint64_t &tsc, uint64_t &ns) const
+      {
+         uint64_t best = UINT64_MAX;
+         for (uint32_t i = 0; i < 5; ++i)
+         {
+            uint64_t before = start();
+            uint64_t now = monotonicNanos();
+            uint64_t after = stop();
+            if (after - before < best)
+            {
+               best = after - before;
+               tsc = before + (after - before) / 2;
+               ns = now;
+            }
+         }
+      }
+#endif
+
+      bool use_tsc_;
+      bool has_rdtscp_;
+      uint64_t hz_;
+      uint64_t nanos_per_cycle_;
+   };
+
+}
+
+#endif
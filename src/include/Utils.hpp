@@ -3,6 +3,7 @@
 #ifndef __UTILS__
 #define __UTILS__
 
+#include <assert.h>
 #include <iostream>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,7 +11,40 @@
 
 #define MESSAGELENMIN 5
 #define MESSAGELENMAX 36
+#define MESSAGEFIELDSMAX 8
 #define MAXPRICE 100000 * 100
+#define LADDERTICKS 4096
+#define ORDERPOOLSIZE 262144
+#define FLATINDEXSIZE 1024
+#define DIRECTINDEXSIZE 1048576
+#define REPLAYBLOCKSIZE 65536
+#define BOOKPRINTINTERVAL 10
+#define RINGRECORDSIZE 64
+#define RINGSPINCOUNT 1024
+#define RINGPARKNANOS 1000000
+#define LOGGERRINGSLOTS 65536
+#define LOGGERMAXRECORD 4096
+#define LOGGERBATCHSIZE 65536
+#define SYMBOLLENMAX 8
+#define SYMBOLMESSAGELENMAX (MESSAGELENMAX + SYMBOLLENMAX + 1)
+#define ORDERATTRLENMAX 12
+#define ORDERMESSAGELENMAX (SYMBOLMESSAGELENMAX + ORDERATTRLENMAX + 1)
+#define SYMBOLSMAX 65534
+#define INVALIDSYMBOL 0xFFFFFFFF
+#define SHARDRINGSLOTS 65536
+#define HISTOGRAMSUBBITS 10
+#define HISTOGRAMMAXBITS 40
+#define TSCCALIBRATIONNANOS 1000000
+#define TRACECAPACITY 262144
+#define FEEDSTATSBLOCKSMAX 256
+#define FEEDSTATSINTERVALMS 1000
+#define TOPOFBOOKRECORDS 4096
+#define MESSAGEBATCHSIZE 64
+#define LEVELPOOLSIZE 1024
+#define LEVELRETAINCOUNT 8
+#define JOURNALRINGSLOTS 65536
+#define JOURNALGROUPRECORDS 4096
+#define SNAPSHOTINTERVAL 1000000
 
 #define FAILASSERT()  \
    {                  \
@@ -20,7 +54,7 @@
 #define LIKELY(expr) (__builtin_expect(!!(expr), 1))
 #define UNLIKELY(expr) (__builtin_expect(!!(expr), 0))
 
-void growBuffer(char *&buf, int &max_buffer)
+inline void growBuffer(char *&buf, int &max_buffer)
 {
    int old_max = max_buffer;
    max_buffer *= 2;
@@ -28,7 +62,7 @@ void growBuffer(char *&buf, int &max_buffer)
    memset(&buf[old_max], '\0', max_buffer - old_max);
 }
 
-void safeCopyToBuffer(char *&dest_root, const char *source, int &index, int &max_buffer)
+inline void safeCopyToBuffer(char *&dest_root, const char *source, int &index, int &max_buffer)
 {
    int len = strlen(source);
    if (len == 0)
@@ -63,17 +97,33 @@ enum Side
    eS_Sell
 };
 
+// Time in force and display attributes of an order, honoured by a Book in
+// matching mode.
+enum OrderFlag
+{
+   eOF_ImmediateOrCancel = 1,
+   eOF_FillOrKill = 2,
+   eOF_PostOnly = 4,
+   eOF_Iceberg = 8
+};
+
+// An iceberg rests order_qty_ of at most order_display_qty_ and keeps the
+// rest in order_hidden_qty_, refilled each time the shown part trades.
 struct OrderLevelEntry
 {
    OrderLevelEntry()
-       : order_id_(0), order_price_(0), order_qty_(0), order_side_(eS_Unknown), next_(0), previous_(0)
+       : order_id_(0), order_flags_(0), order_price_(0), order_qty_(0), order_side_(eS_Unknown), order_display_qty_(0),
+         order_hidden_qty_(0), next_(0), previous_(0)
    {
    }
 
    uint32_t order_id_;
+   uint8_t order_flags_;
    unsigned long long order_price_;
    uint32_t order_qty_;
    Side order_side_;
+   uint32_t order_display_qty_;
+   uint32_t order_hidden_qty_;
 
    OrderLevelEntry *next_;
    OrderLevelEntry *previous_;
@@ -4,46 +4,86 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <chrono>
 #include <string>
 #include <fstream>
 
+#include "include/BinaryFeed.hpp"
+#include "include/DirectOrderIndex.hpp"
+#include "include/FlatOrderIndex.hpp"
 #include "include/MarketDataHandler.hpp"
 #include "include/FeedErrorStats.hpp"
+#include "include/FeedStatsPublisher.hpp"
 #include "include/HFTimestamp.hpp"
+#include "include/MappedFile.hpp"
 #include "include/PerfMetrics.hpp"
+#include "include/PriceLadder.hpp"
+#include "include/ShardedMarketDataHandler.hpp"
+#include "include/StructuralIndex.hpp"
+#include "include/ThreadPlacement.hpp"
+#include "include/TopOfBook.hpp"
 #include "include/Utils.hpp"
 
 using namespace zeus_core;
 
-int main(int argc, char **argv)
+enum LevelType
+{
+   eLT_Map,
+   eLT_Ladder
+};
+
+enum OrderIndexType
 {
-   if (argc == 1)
+   eOIT_Hash,
+   eOIT_Flat,
+   eOIT_Direct
+};
+
+struct EngineOptions
+{
+   EngineOptions()
+       : level_type_(eLT_Map), order_index_type_(eOIT_Hash), order_pool_size_(ORDERPOOLSIZE), mapped_replay_(false), binary_feed_(false), batched_replay_(false), conflate_(false), matching_(false), output_conflation_(), book_depth_(0), level_retention_(LEVELRETAINCOUNT), shards_(0), journal_path_(), snapshot_interval_(SNAPSHOTINTERVAL), recover_(false), trace_path_(), stats_name_(), top_of_book_name_(), placement_(), logger_options_()
    {
-      std::cout << "Usage: OrderBookProcessor <filename>" << std::endl;
-      return -1;
    }
 
-   FeedErrorStats::instance()->init();
+   LevelType level_type_;
+   OrderIndexType order_index_type_;
+   uint32_t order_pool_size_;
+   bool mapped_replay_;
+   bool binary_feed_;
+   bool batched_replay_;
+   bool conflate_;
+   bool matching_;
+   ConflationOptions output_conflation_;
+   uint32_t book_depth_;
+   uint32_t level_retention_;
+   uint32_t shards_;
+   std::string journal_path_;
+   uint32_t snapshot_interval_;
+   bool recover_;
+   std::string trace_path_;
+   std::string stats_name_;
+   std::string top_of_book_name_;
+   ThreadPlacement placement_;
+   LoggerOptions logger_options_;
+};
 
-   MarketDataHandler<uint32_t, OrderLevelEntry> feed;
-   const std::string filename(argv[1]);
+struct ReplayStats
+{
+   ReplayStats() : messages_(0), bytes_(0) {}
 
-   FILE *pFile;
-   try
-   {
-      pFile = fopen(filename.c_str(), "r");
-      if (pFile == NULL)
-      {
-         throw;
-      }
-   }
-   catch (...)
-   {
-      std::cout << "Error occured opening file: " << filename << ".  Please check the file and try again." << std::endl;
-      return -1;
-   }
+   uint64_t messages_;
+   uint64_t bytes_;
+};
 
+// Each replay skips the first skip messages, which recovery has already
+// applied, and prints the book only where the full replay would.
+template <typename HANDLER>
+void replayStream(HANDLER &feed, FILE *pFile, ReplayStats &stats, uint64_t skip)
+{
    uint32_t counter = 0;
    size_t len;
    char *buffer = NULL;
@@ -55,21 +95,560 @@ int main(int argc, char **argv)
          if (read == -1)
             break;
 
-         feed.processMessage(buffer);
+         ++counter;
+         if (counter > skip)
+            feed.processMessage(buffer);
+         stats.bytes_ += read;
 
          if (buffer)
             free(buffer);
          buffer = 0;
 
+         if (counter > skip && counter % BOOKPRINTINTERVAL == 0)
+         {
+            feed.printCurrentOrderBook();
+         }
+      }
+   }
+   stats.messages_ = counter;
+}
+
+// Reads BOOKPRINTINTERVAL lines at a time and hands them to processBatch(),
+// so the book prints land exactly where the per-message replay puts them.
+template <typename HANDLER>
+void replayStreamBatched(HANDLER &feed, FILE *pFile, ReplayStats &stats, uint64_t skip)
+{
+   char *buffers[BOOKPRINTINTERVAL] = {0};
+   size_t sizes[BOOKPRINTINTERVAL] = {0};
+   MessageFields batch[BOOKPRINTINTERVAL];
+   Parser parser;
+   uint32_t counter = 0;
+   for (; counter < skip; ++counter)
+   {
+      ssize_t read = getline(&buffers[0], &sizes[0], pFile);
+      if (read == -1)
+         break;
+      stats.bytes_ += read;
+   }
+   while (1)
+   {
+      uint32_t count = 0;
+      uint32_t wanted = BOOKPRINTINTERVAL - counter % BOOKPRINTINTERVAL;
+      while (count < wanted)
+      {
+         ssize_t read = getline(&buffers[count], &sizes[count], pFile);
+         if (read == -1)
+            break;
+         parser.splitFields(buffers[count], read, batch[count]);
+         stats.bytes_ += read;
+         ++count;
+      }
+      if (count == 0)
+         break;
+
+      feed.processBatch(batch, count);
+      counter += count;
+      if (count == wanted)
+         feed.printCurrentOrderBook();
+   }
+   for (uint32_t i = 0; i < BOOKPRINTINTERVAL; ++i)
+   {
+      free(buffers[i]);
+   }
+   stats.messages_ = counter;
+}
+
+template <typename HANDLER>
+bool replayMapped(HANDLER &feed, FILE *pFile, ReplayStats &stats, bool batched, uint64_t skip)
+{
+   MappedFile mapped_file;
+   if (!mapped_file.map(fileno(pFile)))
+      return false;
+
+   StructuralIndex structural_index;
+   MessageFields fields;
+   MessageFields batch[BOOKPRINTINTERVAL];
+   uint32_t batch_count = 0;
+   const char *position = mapped_file.data();
+   const char *end = position + mapped_file.size();
+   uint32_t block = REPLAYBLOCKSIZE;
+   uint32_t counter = 0;
+   while (position < end)
+   {
+      bool final = (size_t)(end - position) <= block;
+      uint32_t len = final ? end - position : block;
+      structural_index.index(position, len, final);
+
+      while (structural_index.nextMessage(batched ? batch[batch_count] : fields))
+      {
          ++counter;
-         if (counter % 10 == 0)
+         if (counter <= skip)
+            continue;
+         if (batched)
+            ++batch_count;
+         else
+            feed.processMessage(fields);
+
+         if (counter % BOOKPRINTINTERVAL == 0)
          {
+            feed.processBatch(batch, batch_count);
+            batch_count = 0;
             feed.printCurrentOrderBook();
          }
       }
+
+      if (structural_index.consumed() == 0)
+      {
+         block *= 2;
+         continue;
+      }
+      position += structural_index.consumed();
+      block = REPLAYBLOCKSIZE;
+   }
+   feed.processBatch(batch, batch_count);
+   stats.messages_ = counter;
+   stats.bytes_ = mapped_file.size();
+   return true;
+}
+
+// Replays a binary feed from TradingEngineFeedEncoder straight out of a
+// mapping.  Book prints follow every BOOKPRINTINTERVAL source messages,
+// including those the encoder dropped, so they land where the text replay
+// puts them.
+template <typename HANDLER>
+bool replayBinary(HANDLER &feed, FILE *pFile, ReplayStats &stats, bool batched, uint64_t skip)
+{
+   MappedFile mapped_file;
+   if (!mapped_file.map(fileno(pFile)))
+      return false;
+   const FeedFileHeader *header = feedFileHeader(mapped_file.data(), mapped_file.size());
+   if (header == 0)
+      return false;
+   creditFeedStats(*header);
+
+   const FeedRecord *record = feedRecords(header);
+   const FeedRecord *end = record + header->records_;
+   while (record < end && record->sequence_ <= skip)
+   {
+      ++record;
+   }
+   for (uint64_t boundary = (skip / BOOKPRINTINTERVAL + 1) * BOOKPRINTINTERVAL;; boundary += BOOKPRINTINTERVAL)
+   {
+      const FeedRecord *run = record;
+      while (run < end && run->sequence_ <= boundary)
+      {
+         ++run;
+      }
+      if (batched)
+         feed.processRecords(record, run - record);
+      else
+         for (; record < run; ++record)
+         {
+            feed.processRecord(*record);
+         }
+      record = run;
+
+      if (boundary > header->messages_)
+         break;
+      feed.printCurrentOrderBook();
+   }
+   stats.messages_ = header->messages_;
+   stats.bytes_ = mapped_file.size();
+   return true;
+}
+
+template <typename HANDLER>
+bool replayBinary(ShardedMarketDataHandler<HANDLER> &, FILE *, ReplayStats &, bool, uint64_t)
+{
+   fprintf(stderr, "Binary feed replay is unsupported with -s; run without -s.\n");
+   return false;
+}
+
+// Recovers the books from the journal if asked to, then journals from
+// there.  skip is set to the input messages the recovered books include.
+template <typename HANDLER>
+bool startJournal(HANDLER &feed, const EngineOptions &options, uint64_t &skip)
+{
+   if (options.journal_path_.empty())
+      return true;
+   if (options.recover_)
+   {
+      if (!feed.recover(options.journal_path_))
+         return false;
+      skip = feed.messageCount();
+   }
+   return feed.enableJournal(options.journal_path_, options.snapshot_interval_);
+}
+
+template <typename HANDLER>
+bool startJournal(ShardedMarketDataHandler<HANDLER> &, const EngineOptions &options, uint64_t &)
+{
+   if (options.journal_path_.empty())
+      return true;
+   fprintf(stderr, "Journal (-j) unsupported with -s; run without -s.\n");
+   return false;
+}
+
+void printReplayStats(const ReplayStats &stats, double seconds)
+{
+   if (seconds <= 0)
+      seconds = 1e-9;
+   fprintf(stderr, "\n[Replay Throughput]\n");
+   fprintf(stderr, "   %-30s %10lu\n", "Messages:", stats.messages_);
+   fprintf(stderr, "   %-30s %10lu\n", "Bytes:", stats.bytes_);
+   fprintf(stderr, "   %-30s %10.3f\n", "Seconds:", seconds);
+   fprintf(stderr, "   %-30s %10.0f\n", "Messages/sec:", stats.messages_ / seconds);
+   fprintf(stderr, "   %-30s %10.0f\n", "Bytes/sec:", stats.bytes_ / seconds);
+}
+
+template <typename FEED>
+bool replayFile(FEED &feed, FILE *pFile, const EngineOptions &options, ReplayStats &stats)
+{
+   feed.setBookDepth(options.book_depth_);
+   feed.setLevelRetention(options.level_retention_);
+   feed.setConflation(options.conflate_);
+   feed.setOutputConflation(options.output_conflation_);
+   feed.setMatching(options.matching_);
+   if (!options.trace_path_.empty())
+      feed.enableTrace(options.trace_path_);
+
+   TopOfBookPublisher top_of_book(options.top_of_book_name_);
+   if (!options.top_of_book_name_.empty())
+   {
+      if (!top_of_book.start())
+         return false;
+      feed.setTopOfBook(&top_of_book);
+   }
+   uint64_t skip = 0;
+   if (!startJournal(feed, options, skip))
+      return false;
+   if (options.binary_feed_)
+   {
+      if (!replayBinary(feed, pFile, stats, options.batched_replay_, skip))
+         return false;
+   }
+   else if (options.mapped_replay_)
+   {
+      if (!replayMapped(feed, pFile, stats, options.batched_replay_, skip))
+         return false;
    }
+   else
+   {
+      if (options.batched_replay_)
+         replayStreamBatched(feed, pFile, stats, skip);
+      else
+         replayStream(feed, pFile, stats, skip);
+   }
+   feed.shutdown();
+   return true;
+}
+
+template <typename HANDLER>
+void processFile(FILE *pFile, const EngineOptions &options)
+{
+   ReplayStats stats;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   if (options.shards_ == 0)
+   {
+      HANDLER feed(options.order_pool_size_, options.logger_options_);
+      if (!replayFile(feed, pFile, options, stats))
+         return;
+   }
+   else
+   {
+      ShardedMarketDataHandler<HANDLER> feed(options.shards_, options.order_pool_size_, options.logger_options_,
+                                             options.placement_.worker_cpus_);
+      if (!replayFile(feed, pFile, options, stats))
+         return;
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   printReplayStats(stats, elapsed.count());
+}
+
+template <typename LEVELS>
+void processFileWithLevels(FILE *pFile, const EngineOptions &options)
+{
+   switch (options.order_index_type_)
+   {
+   case eOIT_Flat:
+      processFile<MarketDataHandler<uint32_t, OrderLevelEntry, LEVELS, FlatOrderIndex<uint32_t, OrderLevelEntry> > >(pFile, options);
+      break;
+   case eOIT_Direct:
+      processFile<MarketDataHandler<uint32_t, OrderLevelEntry, LEVELS, DirectOrderIndex<uint32_t, OrderLevelEntry> > >(pFile, options);
+      break;
+   default:
+      processFile<MarketDataHandler<uint32_t, OrderLevelEntry, LEVELS> >(pFile, options);
+      break;
+   }
+}
+
+// Parses a -C window: comma-separated terms, each a message count or a time
+// with a us or ms suffix, e.g. "0", "100", "50us" or "100,2ms".
+bool parseConflationWindow(const char *spec, ConflationOptions &conflation)
+{
+   conflation.enabled_ = true;
+   while (*spec != '\0')
+   {
+      char *end;
+      unsigned long value = strtoul(spec, &end, 10);
+      if (end == spec)
+         return false;
+      if (strncmp(end, "us", 2) == 0)
+      {
+         conflation.window_nanos_ = value * 1000ULL;
+         end += 2;
+      }
+      else if (strncmp(end, "ms", 2) == 0)
+      {
+         conflation.window_nanos_ = value * 1000000ULL;
+         end += 2;
+      }
+      else
+      {
+         conflation.window_messages_ = value;
+      }
+
+      if (*end == ',')
+         ++end;
+      else if (*end != '\0')
+         return false;
+      spec = end;
+   }
+   return true;
+}
+
+// Parses a -P cpu list: the feed thread's core, the logger's, then one per
+// shard worker, with - leaving that thread unpinned, e.g. "2,3" or "-,1,4,5".
+bool parseCpuList(const char *spec, ThreadPlacement &placement)
+{
+   std::vector<int> cpus;
+   while (*spec != '\0')
+   {
+      char *end = (char *)spec;
+      if (*spec == '-')
+      {
+         cpus.push_back(-1);
+         ++end;
+      }
+      else
+      {
+         cpus.push_back(strtol(spec, &end, 10));
+         if (end == spec || cpus.back() < 0 || cpus.back() >= CPU_SETSIZE)
+            return false;
+      }
+
+      if (*end == ',')
+         ++end;
+      else if (*end != '\0')
+         return false;
+      spec = end;
+   }
+   if (cpus.empty())
+      return false;
+
+   placement.feed_cpu_ = cpus[0];
+   placement.logger_cpu_ = cpus.size() > 1 ? cpus[1] : -1;
+   placement.worker_cpus_.assign(cpus.begin() + (cpus.size() > 1 ? 2 : 1), cpus.end());
+   return true;
+}
+
+void printUsage()
+{
+   std::cout << "Usage: OrderBookProcessor [-l map|ladder] [-i hash|flat|direct] [-p orders] [-b levels] [-r levels] [-s shards] [-m] [-B] [-c] [-C window] [-x] [-j journal [-k messages] [-R]] [-w spin|yield|park] [-d] [-o binary_output] [-t trace.json] [-S /shm_name] [-T /shm_name] [-P cpus] [-L] <filename>" << std::endl;
+   std::cout << "   <filename> is a text feed, or a binary feed written by TradingEngineFeedEncoder (always replayed from a mapping)" << std::endl;
+   std::cout << "   -l   price level implementation (default: map)" << std::endl;
+   std::cout << "   -i   order ID index implementation (default: hash)" << std::endl;
+   std::cout << "   -p   orders preallocated per order pool slab (default: " << ORDERPOOLSIZE << ")" << std::endl;
+   std::cout << "   -b   levels per side in book prints, 0 for the full book (default: 0)" << std::endl;
+   std::cout << "   -r   emptied map price levels kept per side for reuse before being freed (default: " << LEVELRETAINCOUNT << ")" << std::endl;
+   std::cout << "   -s   route messages by symbol to this many pinned worker threads (default: 0, process inline)" << std::endl;
+   std::cout << "   -m   replay from a read-only memory mapping of the file, split with the " << structuralIsaName(bestStructuralIsa()) << " structural index" << std::endl;
+   std::cout << "   -B   decode and apply messages in batches of " << BOOKPRINTINTERVAL << " (the book print interval)" << std::endl;
+   std::cout << "   -c   with -B or -s, publish one midpoint per book per batch instead of one per message" << std::endl;
+   std::cout << "   -C   print midpoints only on a best bid/ask change and aggregate same-price trades, at most once per window of messages and/or time, e.g. 0, 100, 50us or 100,2ms" << std::endl;
+   std::cout << "   -x   matching mode: match adds that cross the opposite side, printing fills and trades, instead of resting them crossed; honours order attributes I (IOC), F (FOK), P (post only) and H<display> (iceberg)" << std::endl;
+   std::cout << "   -j   journal accepted messages to <journal>.journal behind a book snapshot in <journal>.snapshot" << std::endl;
+   std::cout << "   -k   with -j, messages between snapshots (default: " << SNAPSHOTINTERVAL << ")" << std::endl;
+   std::cout << "   -R   with -j, first recover the books from the snapshot and journal, then continue the input after the last message they include" << std::endl;
+   std::cout << "   -w   logger thread wait strategy when idle (default: yield)" << std::endl;
+   std::cout << "   -d   drop log output when the logger queue is full instead of waiting" << std::endl;
+   std::cout << "   -t   trace each message through the pipeline and write a Chrome trace-event JSON file" << std::endl;
+   std::cout << "   -S   publish feed statistics snapshots every " << FEEDSTATSINTERVALMS << "ms to this shared memory object (read with TradingEngineStatsMonitor)" << std::endl;
+   std::cout << "   -T   publish each book's best bid/ask and last trade to this shared memory object" << std::endl;
+   std::cout << "   -P   pin threads to cores: feed, logger, then one per shard worker, - for unpinned, e.g. 2,3,4,5; each thread allocates from its core's NUMA node" << std::endl;
+   std::cout << "   -L   lock all memory with mlockall, prefaulting pools as they are allocated" << std::endl;
+   std::cout << "   -o   write binary output events to this file (decode with TradingEngineDecoder)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+   EngineOptions options;
+
+   int opt;
+   while ((opt = getopt(argc, argv, "l:i:p:b:r:s:mBcC:xj:k:Rw:do:t:S:T:P:L")) != -1)
+   {
+      switch (opt)
+      {
+      case 'l':
+         if (strcmp(optarg, "ladder") == 0)
+            options.level_type_ = eLT_Ladder;
+         else if (strcmp(optarg, "map") != 0)
+         {
+            printUsage();
+            return -1;
+         }
+         break;
+      case 'i':
+         if (strcmp(optarg, "flat") == 0)
+            options.order_index_type_ = eOIT_Flat;
+         else if (strcmp(optarg, "direct") == 0)
+            options.order_index_type_ = eOIT_Direct;
+         else if (strcmp(optarg, "hash") != 0)
+         {
+            printUsage();
+            return -1;
+         }
+         break;
+      case 'p':
+         options.order_pool_size_ = strtoul(optarg, NULL, 10);
+         if (options.order_pool_size_ == 0)
+         {
+            printUsage();
+            return -1;
+         }
+         break;
+      case 'b':
+         options.book_depth_ = strtoul(optarg, NULL, 10);
+         break;
+      case 'r':
+         options.level_retention_ = strtoul(optarg, NULL, 10);
+         break;
+      case 's':
+         options.shards_ = strtoul(optarg, NULL, 10);
+         break;
+      case 'm':
+         options.mapped_replay_ = true;
+         break;
+      case 'w':
+         if (strcmp(optarg, "spin") == 0)
+            options.logger_options_.wait_strategy_ = eWS_BusySpin;
+         else if (strcmp(optarg, "park") == 0)
+            options.logger_options_.wait_strategy_ = eWS_FutexPark;
+         else if (strcmp(optarg, "yield") != 0)
+         {
+            printUsage();
+            return -1;
+         }
+         break;
+      case 'B':
+         options.batched_replay_ = true;
+         break;
+      case 'c':
+         options.conflate_ = true;
+         break;
+      case 'C':
+         if (!parseConflationWindow(optarg, options.output_conflation_))
+         {
+            printUsage();
+            return -1;
+         }
+         break;
+      case 'x':
+         options.matching_ = true;
+         break;
+      case 'j':
+         options.journal_path_ = optarg;
+         break;
+      case 'k':
+         options.snapshot_interval_ = strtoul(optarg, NULL, 10);
+         if (options.snapshot_interval_ == 0)
+         {
+            printUsage();
+            return -1;
+         }
+         break;
+      case 'R':
+         options.recover_ = true;
+         break;
+      case 'd':
+         options.logger_options_.full_policy_ = eFP_Drop;
+         break;
+      case 't':
+         options.trace_path_ = optarg;
+         break;
+      case 'S':
+         options.stats_name_ = optarg;
+         break;
+      case 'T':
+         options.top_of_book_name_ = optarg;
+         break;
+      case 'P':
+         if (!parseCpuList(optarg, options.placement_))
+         {
+            printUsage();
+            return -1;
+         }
+         options.logger_options_.cpu_ = options.placement_.logger_cpu_;
+         break;
+      case 'L':
+         options.placement_.lock_memory_ = true;
+         break;
+      case 'o':
+         options.logger_options_.output_mode_ = eLO_Binary;
+         options.logger_options_.binary_path_ = optarg;
+         break;
+      default:
+         printUsage();
+         return -1;
+      }
+   }
+
+   if (optind >= argc || (options.recover_ && options.journal_path_.empty()))
+   {
+      printUsage();
+      return -1;
+   }
+
+
+   const std::string filename(argv[optind]);
+
+   FILE *pFile;
+   try
+   {
+      pFile = fopen(filename.c_str(), "r");
+      if (pFile == NULL)
+      {
+         throw;
+      }
+   }
+   catch (...)
+   {
+      std::cout << "Error occured opening file: " << filename << ".  Please check the file and try again." << std::endl;
+      return -1;
+   }
+
+   options.binary_feed_ = isBinaryFeed(fileno(pFile));
+
+   // Pin before anything is allocated, so the books and pools land on the
+   // feed core's NUMA node.
+   pinThread(options.placement_.feed_cpu_, "feed");
+   if (options.placement_.lock_memory_)
+      lockMemory();
+
+   FeedStatsPublisher publisher(options.stats_name_);
+   if (!options.stats_name_.empty() && !publisher.start())
+   {
+      fclose(pFile);
+      return -1;
+   }
+
+   if (options.level_type_ == eLT_Ladder)
+      processFileWithLevels<PriceLadder<OrderLevelEntry> >(pFile, options);
+   else
+      processFileWithLevels<MapPriceLevels<OrderLevelEntry> >(pFile, options);
    fclose(pFile);
+   publisher.stop();
 
-   FeedErrorStats::instance()->printStatistics();
+   FeedErrorStats::printStatistics();
    return 0;
 }
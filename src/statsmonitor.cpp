@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "include/FeedStatsPublisher.hpp"
+
+using namespace zeus_core;
+
+// Polls the feed statistics a TradingEngine started with -S publishes to
+// shared memory and prints each new snapshot's totals, deltas and rates.
+int main(int argc, char **argv)
+{
+   if (argc < 2 || argc > 3)
+   {
+      fprintf(stderr, "Usage: TradingEngineStatsMonitor </shm_name> [poll_ms]\n");
+      return -1;
+   }
+   uint32_t poll_ms = argc == 3 ? atoi(argv[2]) : FEEDSTATSINTERVALMS;
+
+   FeedStatsReader reader;
+   if (!reader.attach(argv[1]))
+   {
+      fprintf(stderr, "Unable to attach to feed statistics %s\n", argv[1]);
+      return -1;
+   }
+
+   uint64_t last_publish = 0;
+   FeedStatsSnapshot snapshot;
+   while (1)
+   {
+      if (reader.read(snapshot) && snapshot.publish_count_ != last_publish)
+      {
+         last_publish = snapshot.publish_count_;
+         fprintf(stdout, "\n[Feed Statistics #%lu, interval %.3fs]\n", snapshot.publish_count_,
+                 snapshot.interval_nanos_ / 1e9);
+         fprintf(stdout, "   %-30s %14s %12s %14s\n", "", "Total", "Delta", "Per Second");
+         for (uint32_t counter = 0; counter < eFE_Count; ++counter)
+         {
+            fprintf(stdout, "   %-30s %14lu %12lu %14.1f\n", FeedErrorStats::counterName(counter),
+                    snapshot.totals_[counter], snapshot.deltas_[counter], snapshot.rates_[counter]);
+         }
+         fflush(stdout);
+      }
+      usleep(poll_ms * 1000);
+   }
+   return 0;
+}
@@ -2,15 +2,36 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <thread>
 
+#include "include/BinaryFeed.hpp"
 #include "include/DLList.hpp"
 #include "include/MarketDataHandler.hpp"
 #include "include/HFTimestamp.hpp"
+#include "include/Journal.hpp"
 #include "include/PerfMetrics.hpp"
 #include "include/Logger.hpp"
 #include "include/Book.hpp"
+#include "include/SpscRing.hpp"
+#include "include/MapPriceLevels.hpp"
+#include "include/MappedFile.hpp"
+#include "include/MessageTrace.hpp"
+#include "include/StructuralIndex.hpp"
+#include "include/ThreadPlacement.hpp"
+#include "include/TopOfBook.hpp"
+#include "include/TscClock.hpp"
+#include "include/DepthSnapshot.hpp"
+#include "include/DirectOrderIndex.hpp"
+#include "include/FeedStatsPublisher.hpp"
+#include "include/FlatOrderIndex.hpp"
+#include "include/LatencyHistogram.hpp"
+#include "include/OrderPool.hpp"
+#include "include/OutputEvents.hpp"
+#include "include/PriceLadder.hpp"
+#include "include/ShardedMarketDataHandler.hpp"
 #include "include/Utils.hpp"
 
 using namespace zeus_core;
@@ -147,6 +168,1722 @@ bool testLogger()
    return true;
 }
 
+bool testPriceLadder()
+{
+   PriceLadder<OrderLevelEntry> ladder(8);
+   unsigned long long prices[] = {1000, 1003, 990, 1020, 1001, 5000};
+   OrderLevelEntry orders[6];
+   for (uint32_t i = 0; i < 6; ++i)
+   {
+      orders[i].order_id_ = i;
+      orders[i].order_qty_ = 10;
+      orders[i].order_price_ = prices[i];
+      ladder.addLevel(prices[i]).addNode(&orders[i]);
+   }
+   if (ladder.lowestPrice() != 990 || ladder.highestPrice() != 5000)
+      return false;
+
+   unsigned long long last = ULLONG_MAX;
+   uint32_t count = 0;
+   bool ordered = true;
+   ladder.forEachDescending([&](unsigned long long price, PriceLadder<OrderLevelEntry>::Level &level) {
+      ordered = ordered && price < last && level.getQuantity() == 10;
+      last = price;
+      ++count;
+   });
+   if (!ordered || count != 6)
+      return false;
+
+   ladder.findLevel(990)->removeNode(&orders[2]);
+   ladder.removeLevel(990);
+   ladder.findLevel(5000)->removeNode(&orders[5]);
+   ladder.removeLevel(5000);
+   if (ladder.lowestPrice() != 1000 || ladder.highestPrice() != 1020)
+      return false;
+   if (ladder.findLevel(990) != 0 || ladder.findLevel(1003) == 0)
+      return false;
+
+   ladder.clear();
+   return ladder.empty();
+}
+
+bool testOrderPool()
+{
+   OrderPool<OrderLevelEntry> pool(4);
+   std::vector<OrderLevelEntry *> orders;
+   for (uint32_t i = 0; i < 6; ++i)
+   {
+      OrderLevelEntry *ole = pool.acquire();
+      if (ole->order_id_ != 0 || ole->next_ != 0 || ole->previous_ != 0)
+         return false;
+      ole->order_id_ = i + 1;
+      orders.push_back(ole);
+   }
+   if (pool.capacity() != 8 || pool.inUse() != 6)
+      return false;
+
+   OrderLevelEntry *released = orders.back();
+   orders.pop_back();
+   pool.release(released);
+   if (pool.acquire() != released)
+      return false;
+
+   pool.release(released);
+   for (uint32_t i = 0; i < orders.size(); ++i)
+   {
+      pool.release(orders[i]);
+   }
+   return pool.inUse() == 0;
+}
+
+template <typename INDEX>
+bool checkOrderIndex(INDEX &index)
+{
+   std::unordered_map<uint32_t, OrderLevelEntry *> reference;
+   std::vector<OrderLevelEntry> orders(4096);
+   srand(7);
+   for (uint32_t i = 0; i < 100000; ++i)
+   {
+      uint32_t id = rand() % orders.size();
+      if (rand() % 3 == 0)
+         id *= 977;
+      OrderLevelEntry *ole = &orders[id % orders.size()];
+      if (rand() % 2 == 0)
+      {
+         index.insert(id, ole);
+         reference[id] = ole;
+      }
+      else
+      {
+         index.erase(id);
+         reference.erase(id);
+      }
+      if (index.find(id) != (reference.count(id) ? reference[id] : 0))
+         return false;
+   }
+   for (auto it = reference.begin(); it != reference.end(); ++it)
+   {
+      if (index.find(it->first) != it->second)
+         return false;
+   }
+   uint32_t visited = 0;
+   index.forEach([&](OrderLevelEntry *) { ++visited; });
+   return visited == reference.size() && index.size() == reference.size();
+}
+
+bool testFlatOrderIndex()
+{
+   FlatOrderIndex<uint32_t, OrderLevelEntry> index(8);
+   return checkOrderIndex(index);
+}
+
+bool testDirectOrderIndex()
+{
+   DirectOrderIndex<uint32_t, OrderLevelEntry> index(2048);
+   return checkOrderIndex(index);
+}
+
+bool testParser()
+{
+   Parser parser;
+   const char *add = "A,17,S,25,35.59\n";
+   if (parser.getMessageType(add, strlen(add)) != eMT_Add)
+      return false;
+   OrderLevelEntry ole;
+   parser.parseOrder(add, strlen(add), ole);
+   if (ole.order_id_ != 17 || ole.order_side_ != eS_Sell || ole.order_qty_ != 25 || ole.order_price_ != 3559)
+      return false;
+
+   const char *sub_cent = "A,18,B,25,1.234\n";
+   parser.parseOrder(sub_cent, strlen(sub_cent), ole);
+   if (ole.order_side_ != eS_Unknown)
+      return false;
+
+   const char *trade = "T,40,50.1";
+   if (parser.getMessageType(trade, strlen(trade)) != eMT_Trade)
+      return false;
+   TradeMessage tm;
+   parser.parseTrade(trade, strlen(trade), tm);
+   if (tm.trade_qty_ != 40 || tm.trade_price_ != 5010)
+      return false;
+
+   const char *corrupt = "T,40";
+   parser.parseTrade(corrupt, strlen(corrupt), tm);
+   if (tm.trade_price_ != 0)
+      return false;
+
+   HFTimestamp timer;
+   PerfMetrics parse_time("testParser()");
+   for (uint32_t i = 0; i < 100000; ++i)
+   {
+      timer.start();
+      parser.getMessageType(add, strlen(add));
+      parser.parseOrder(add, strlen(add), ole);
+      parse_time.add(timer.stop());
+   }
+   parse_time.print();
+   return true;
+}
+
+bool openResource(const char *name, MappedFile &mapped_file)
+{
+   const char *directories[] = {"resources/", "../resources/", "../../resources/"};
+   for (uint32_t i = 0; i < 3; ++i)
+   {
+      std::string path = std::string(directories[i]) + name;
+      FILE *file = fopen(path.c_str(), "r");
+      if (file == NULL)
+         continue;
+      bool mapped = mapped_file.map(fileno(file));
+      fclose(file);
+      return mapped;
+   }
+   fprintf(stderr, "Unable to find resources/%s.\n", name);
+   return false;
+}
+
+bool sameFields(const MessageFields &lhs, const MessageFields &rhs)
+{
+   if (lhs.line_ != rhs.line_ || lhs.len_ != rhs.len_)
+      return false;
+   if (lhs.len_ > SYMBOLMESSAGELENMAX)
+      return true;
+   if (lhs.count_ != rhs.count_)
+      return false;
+   for (uint32_t i = 0; i < lhs.count_; ++i)
+   {
+      if (lhs.begin_[i] != rhs.begin_[i] || lhs.end_[i] != rhs.end_[i])
+         return false;
+   }
+   return true;
+}
+
+bool testStructuralIndex()
+{
+   MappedFile mapped_file;
+   if (!openResource("orders.txt", mapped_file))
+      return false;
+   const char *data = mapped_file.data();
+   uint32_t size = mapped_file.size();
+
+   Parser parser;
+   StructuralIsa isas[] = {eSI_Scalar, eSI_SSE2, eSI_AVX2};
+   uint32_t blocks[] = {64, 4096, 65536};
+   for (uint32_t i = 0; i < 3; ++i)
+   {
+      StructuralIndex structural_index(isas[i]);
+      for (uint32_t b = 0; b < 3; ++b)
+      {
+         MessageFields indexed;
+         MessageFields split;
+         uint32_t position = 0;
+         uint32_t block = blocks[b];
+         while (position < size)
+         {
+            bool final = size - position <= block;
+            structural_index.index(data + position, final ? size - position : block, final);
+            while (structural_index.nextMessage(indexed))
+            {
+               const char *newline = (const char *)memchr(indexed.line_, '\n', data + size - indexed.line_);
+               size_t len = newline == NULL ? data + size - indexed.line_ : newline + 1 - indexed.line_;
+               parser.splitFields(indexed.line_, len, split);
+               if (!sameFields(indexed, split))
+                  return false;
+            }
+            if (structural_index.consumed() == 0)
+            {
+               block *= 2;
+               continue;
+            }
+            position += structural_index.consumed();
+            block = blocks[b];
+         }
+      }
+   }
+
+   HFTimestamp timer;
+   PerfMetrics line_path("Per-line split and parse (ns/MB)");
+   PerfMetrics indexed_paths[3] = {PerfMetrics("Scalar structural index (ns/MB)"),
+                                   PerfMetrics("SSE2 structural index (ns/MB)"),
+                                   PerfMetrics("AVX2 structural index (ns/MB)")};
+   OrderLevelEntry ole;
+   TradeMessage tm;
+   for (uint32_t run = 0; run < 20; ++run)
+   {
+      timer.start();
+      const char *position = data;
+      const char *end = data + size;
+      while (position < end)
+      {
+         const char *newline = (const char *)memchr(position, '\n', end - position);
+         const char *next = newline == NULL ? end : newline + 1;
+         MessageType mt = parser.getMessageType(position, next - position);
+         if (mt == eMT_Trade)
+            parser.parseTrade(position, next - position, tm);
+         else if (mt != eMT_Unknown)
+            parser.parseOrder(position, next - position, ole);
+         position = next;
+      }
+      line_path.add(timer.stop() * 1000000ULL / size);
+
+      for (uint32_t i = 0; i < 3; ++i)
+      {
+         StructuralIndex structural_index(isas[i]);
+         MessageFields fields;
+         timer.start();
+         structural_index.index(data, size, true);
+         while (structural_index.nextMessage(fields))
+         {
+            MessageType mt = parser.getMessageType(fields);
+            if (mt == eMT_Trade)
+               parser.parseTrade(fields, tm);
+            else if (mt != eMT_Unknown)
+               parser.parseOrder(fields, ole);
+         }
+         indexed_paths[i].add(timer.stop() * 1000000ULL / size);
+      }
+   }
+   line_path.print();
+   for (uint32_t i = 0; i < 3; ++i)
+   {
+      indexed_paths[i].print();
+   }
+   return true;
+}
+
+bool testSpscRing()
+{
+   WaitStrategy strategies[] = {eWS_BusySpin, eWS_SpinYield, eWS_FutexPark};
+   for (uint32_t s = 0; s < 3; ++s)
+   {
+      SpscRing ring(64, strategies[s]);
+      const uint32_t messages = 200000;
+      std::atomic<bool> ordered(true);
+      std::thread consumer([&]() {
+         uint32_t expected = 0;
+         while (expected < messages)
+         {
+            uint32_t drained = ring.drain([&](uint32_t type, const char *data, uint32_t len) {
+               uint32_t value;
+               memcpy(&value, data, sizeof(value));
+               if (value != expected || type != expected % 7 || len != sizeof(value) + expected % 200)
+                  ordered = false;
+               ++expected;
+            });
+            if (drained == 0)
+               ring.wait();
+         }
+      });
+
+      char payload[sizeof(uint32_t) + 200];
+      for (uint32_t i = 0; i < messages; ++i)
+      {
+         memcpy(payload, &i, sizeof(i));
+         ring.write(i % 7, payload, sizeof(i) + i % 200, eFP_Block);
+      }
+      consumer.join();
+      if (!ordered || ring.dropped() != 0)
+         return false;
+   }
+
+   SpscRing ring(4, eWS_BusySpin);
+   char payload[40] = {0};
+   uint32_t written = 0;
+   for (uint32_t i = 0; i < 10; ++i)
+   {
+      written += ring.write(0, payload, sizeof(payload), eFP_Drop) ? 1 : 0;
+   }
+   return written == 4 && ring.dropped() == 6 && ring.fullEvents() == 6;
+}
+
+bool testOutputEvents()
+{
+   int max_buffer = 16;
+   char *buffer = (char *)calloc(max_buffer, sizeof(char));
+   int index = 0;
+
+   MidquoteEvent midquote = MidquoteEvent();
+   midquote.header_.length_ = sizeof(midquote);
+   midquote.header_.type_ = eOE_Midquote;
+   formatOutputEvent((const char *)&midquote, sizeof(midquote), buffer, index, max_buffer);
+   midquote.bid_price_ = 10025;
+   midquote.ask_price_ = 10150;
+   formatOutputEvent((const char *)&midquote, sizeof(midquote), buffer, index, max_buffer);
+
+   TradeEvent trade = TradeEvent();
+   trade.header_.length_ = sizeof(trade);
+   trade.header_.type_ = eOE_Trade;
+   trade.price_ = 10150;
+   trade.quantity_ = 30;
+   formatOutputEvent((const char *)&trade, sizeof(trade), buffer, index, max_buffer);
+
+   char snapshot[sizeof(BookSnapshotEvent) + 2 * sizeof(SnapshotLevel) + 3 * sizeof(uint32_t)];
+   BookSnapshotEvent *event = (BookSnapshotEvent *)snapshot;
+   event->header_.length_ = sizeof(snapshot);
+   event->header_.type_ = eOE_BookSnapshot;
+   event->level_count_ = 2;
+   event->order_count_ = 3;
+   char *position = snapshot + sizeof(BookSnapshotEvent);
+   SnapshotLevel sell = {10150, 2, eS_Sell};
+   SnapshotLevel buy = {10025, 1, eS_Buy};
+   uint32_t quantities[] = {10, 20, 5};
+   memcpy(position, &sell, sizeof(sell));
+   memcpy(position + sizeof(sell), quantities, 2 * sizeof(uint32_t));
+   position += sizeof(sell) + 2 * sizeof(uint32_t);
+   memcpy(position, &buy, sizeof(buy));
+   memcpy(position + sizeof(buy), &quantities[2], sizeof(uint32_t));
+   formatOutputEvent(snapshot, sizeof(snapshot), buffer, index, max_buffer);
+
+   bool matched = strcmp(buffer, "NAN\n100.88\n30@101.50\n101.50 S 10 S 20 \n\n100.25 B 5 \n\n") == 0;
+   free(buffer);
+   return matched;
+}
+
+bool testDepthSnapshot()
+{
+   typedef MapPriceLevels<OrderLevelEntry> Levels;
+   Levels levels;
+   OrderLevelEntry orders[6];
+   unsigned long long prices[] = {1000, 1001, 1001, 1002, 1003, 1004};
+   for (uint32_t i = 0; i < 6; ++i)
+   {
+      orders[i].order_id_ = i;
+      orders[i].order_qty_ = 10 + i;
+      orders[i].order_price_ = prices[i];
+      levels.addLevel(prices[i]).addNode(&orders[i]);
+   }
+
+   DepthSnapshot<Levels> depth(eS_Sell);
+   depth.refresh(levels, 3);
+   if (depth.levelCount() != 3 || depth.orderCount() != 4 || depth.renderedLevels() != 3)
+      return false;
+   if (depth.level(0).price_ != 1000 || depth.level(1).quantity_ != 23 || depth.level(2).price_ != 1002)
+      return false;
+
+   // Only the touched level is re-read; the level moving into the top three
+   // has not been rendered before.
+   levels.findLevel(1001)->changeNodeQuantity(&orders[1], 5);
+   levels.findLevel(1000)->removeNode(&orders[0]);
+   levels.removeLevel(1000);
+   depth.refresh(levels, 3);
+   if (depth.renderedLevels() != 5 || depth.reusedLevels() != 1)
+      return false;
+   if (depth.level(0).price_ != 1001 || depth.level(0).quantity_ != 17 || depth.level(2).price_ != 1003)
+      return false;
+
+   char buffer[3 * sizeof(SnapshotLevel) + 4 * sizeof(uint32_t)];
+   if (depth.write(buffer) != buffer + depth.writtenSize() || depth.writtenSize() != sizeof(buffer))
+      return false;
+   SnapshotLevel first;
+   memcpy(&first, buffer, sizeof(first));
+   if (first.price_ != 1003 || first.order_count_ != 1)
+      return false;
+
+   HFTimestamp timer;
+   PerfMetrics refresh_time("testDepthSnapshot() clean refresh");
+   depth.refresh(levels, 0);
+   for (uint32_t i = 0; i < 10000; ++i)
+   {
+      timer.start();
+      depth.refresh(levels, 0);
+      refresh_time.add(timer.stop());
+   }
+   refresh_time.print();
+
+   levels.clear();
+   return depth.reusedLevels() >= 10000;
+}
+
+void buildSymbolFeed(std::vector<std::string> &messages, uint32_t symbols, uint32_t count)
+{
+   char line[64];
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      uint32_t symbol = i % symbols;
+      uint32_t id = i / symbols;
+      if (id % 4 == 3)
+      {
+         sprintf(line, "X,S%u,%u,B,10,95.00\n", symbol, id - 3);
+      }
+      else
+      {
+         bool buy = id % 2 == 0;
+         sprintf(line, "A,S%u,%u,%c,10,%u.%02u\n", symbol, id, buy ? 'B' : 'S', buy ? 90 + id % 10 : 101 + id % 10, id % 100);
+      }
+      messages.push_back(line);
+   }
+}
+
+template <typename FEED>
+double replaySymbolFeed(FEED &feed, const std::vector<std::string> &messages)
+{
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < messages.size(); ++i)
+   {
+      feed.processMessage(messages[i].c_str(), messages[i].size());
+   }
+   feed.shutdown();
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+bool testShardedHandler()
+{
+   typedef MarketDataHandler<uint32_t, OrderLevelEntry> Handler;
+   const uint32_t symbols = 64;
+   const uint32_t count = 1000000;
+   std::vector<std::string> messages;
+   buildSymbolFeed(messages, symbols, count);
+
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+
+   {
+      Handler feed(ORDERPOOLSIZE, options);
+      double seconds = replaySymbolFeed(feed, messages);
+      fprintf(stderr, "Inline:   %10.0f messages/sec\n", count / seconds);
+      if (feed.symbols().size() != symbols + 1 || feed.findBook(symbols) == 0 || feed.findBook(symbols + 1) != 0)
+         return false;
+
+      // Lines that fail validation add neither a symbol nor a book.
+      feed.processMessage("Q,NEWSYM,1,B,10,10.00");
+      feed.processMessage("A,NEWSYM,x,B,10,10.00");
+      feed.processMessage("T,NEWSYM,10,0");
+      if (feed.symbols().size() != symbols + 1 || feed.findBook(symbols + 1) != 0)
+         return false;
+   }
+
+   uint32_t shard_counts[] = {1, 2, 4};
+   for (uint32_t s = 0; s < 3; ++s)
+   {
+      ShardedMarketDataHandler<Handler> feed(shard_counts[s], ORDERPOOLSIZE, options);
+      double seconds = replaySymbolFeed(feed, messages);
+      fprintf(stderr, "%u shards: %10.0f messages/sec\n", shard_counts[s], count / seconds);
+
+      uint64_t total = 0;
+      for (uint32_t i = 0; i < feed.shardCount(); ++i)
+      {
+         if (feed.shardMessages(i) != count / shard_counts[s])
+            return false;
+         total += feed.shardMessages(i);
+      }
+      if (total != count)
+         return false;
+   }
+   {
+      // The dispatcher validates before interning, as the inline handler does.
+      ShardedMarketDataHandler<Handler> feed(2, ORDERPOOLSIZE, options);
+      feed.processMessage("A,GOOD,1,B,10,10.00");
+      feed.processMessage("A,BADSIDE,2,Q,10,10.00");
+      feed.processMessage("A,BADQTY,3,B,0,10.00");
+      feed.processMessage("M,BADPX,4,B,10,x");
+      feed.shutdown();
+      if (feed.symbols().size() != 2 || feed.shardMessages(0) + feed.shardMessages(1) != 1)
+         return false;
+   }
+   fprintf(stderr, "Hardware threads: %u\n", std::thread::hardware_concurrency());
+   return true;
+}
+
+bool testLatencyHistogram()
+{
+   LatencyHistogram whole;
+   LatencyHistogram low;
+   LatencyHistogram high;
+   for (uint64_t value = 1; value <= 100000; ++value)
+   {
+      whole.record(value);
+      (value <= 50000 ? low : high).record(value);
+   }
+   if (whole.count() != 100000 || whole.min() != 1 || whole.max() != 100000 || whole.mean() != 50000)
+      return false;
+   if (whole.valueAtPercentile(0.5) != 500)
+      return false;
+
+   double percents[] = {10, 50, 90, 99, 99.99};
+   for (uint32_t i = 0; i < 5; ++i)
+   {
+      uint64_t exact = (uint64_t)(percents[i] * 1000 + 0.5);
+      uint64_t value = whole.valueAtPercentile(percents[i]);
+      if (value < exact || value > exact + exact / 512)
+         return false;
+   }
+   if (whole.valueAtPercentile(100) != 100000)
+      return false;
+
+   low.merge(high);
+   for (uint32_t i = 0; i < 5; ++i)
+   {
+      if (low.valueAtPercentile(percents[i]) != whole.valueAtPercentile(percents[i]))
+         return false;
+   }
+
+   LatencyHistogram interval;
+   whole.snapshot(interval);
+   whole.record((uint64_t)1 << 50);
+   if (interval.count() != 100000 || whole.count() != 1 || whole.valueAtPercentile(50) != (uint64_t)1 << 50)
+      return false;
+
+   HFTimestamp timer;
+   PerfMetrics record_time("testLatencyHistogram() record");
+   for (uint32_t i = 0; i < 100000; ++i)
+   {
+      timer.start();
+      interval.record(i * 7919);
+      record_time.add(timer.stop());
+   }
+   record_time.print();
+   record_time.printSummary();
+   return true;
+}
+
+bool testTscClock()
+{
+   const TscClock &clock = TscClock::instance();
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < 1000; ++i)
+   {
+      HFTimestamp timer;
+      timer.start();
+      timer.stop();
+   }
+   std::chrono::duration<double> construction = std::chrono::steady_clock::now() - start;
+   fprintf(stderr, "1000 HFTimestamps constructed in %.0f us (invariant TSC: %s)\n",
+           construction.count() * 1e6, clock.invariant() ? "yes" : "no");
+   if (construction.count() > 0.1)
+      return false;
+
+   uint64_t cycles = clock.start();
+   uint64_t nanos = TscClock::monotonicNanos();
+   usleep(20000);
+   uint64_t elapsed_cycles = clock.stop() - cycles;
+   uint64_t elapsed_nanos = TscClock::monotonicNanos() - nanos;
+   uint64_t converted = clock.toNanos(elapsed_cycles);
+   uint64_t error = converted > elapsed_nanos ? converted - elapsed_nanos : elapsed_nanos - converted;
+   fprintf(stderr, "20ms sleep: %lu ns by TSC, %lu ns by CLOCK_MONOTONIC_RAW\n", converted, elapsed_nanos);
+   return error < elapsed_nanos / 100;
+}
+
+bool testMessageTrace()
+{
+   TraceBuffer<WriteTrace> buffer(2);
+   if (buffer.append() == 0 || buffer.append() == 0 || buffer.append() != 0 || buffer.dropped() != 1)
+      return false;
+
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+   MarketDataHandler<uint32_t, OrderLevelEntry> feed(ORDERPOOLSIZE, options);
+   feed.enableTrace("/dev/null", 4);
+   const char *messages[] = {"A,1,B,10,50.00\n", "A,2,S,10,50.10\n", "X,3,S,10,50.10\n", "bad\n", "M,1,B,5,50.00\n"};
+   for (uint32_t i = 0; i < 5; ++i)
+   {
+      feed.processMessage(messages[i]);
+   }
+   feed.shutdown();
+   return feed.trace()->traced() == 4 && feed.trace()->dropped() == 1;
+}
+
+bool testFeedStats()
+{
+   FeedErrorTotals before;
+   FeedErrorStats::totals(before);
+
+   const uint32_t threads = 4;
+   const uint32_t increments = 1000000;
+   std::vector<std::thread> workers;
+   PerfMetrics metrics("FeedErrorStats: goodMessage from 4 threads");
+   HFTimestamp timer;
+   timer.start();
+   for (uint32_t i = 0; i < threads; ++i)
+   {
+      workers.push_back(std::thread([increments]() {
+         FeedErrorStats *stats = FeedErrorStats::instance();
+         for (uint32_t n = 0; n < increments; ++n)
+         {
+            stats->goodMessage();
+         }
+         stats->crossedBook();
+      }));
+   }
+   for (uint32_t i = 0; i < threads; ++i)
+   {
+      workers[i].join();
+   }
+   metrics.add(timer.stop() / (threads * increments));
+   metrics.print();
+
+   FeedErrorTotals after;
+   FeedErrorStats::totals(after);
+   if (after.counters_[eFE_GoodMessage] - before.counters_[eFE_GoodMessage] != threads * increments ||
+       after.counters_[eFE_CrossedBook] - before.counters_[eFE_CrossedBook] != threads)
+      return false;
+
+   std::string name = "/zeus_test_stats_" + std::to_string(getpid());
+   FeedStatsPublisher publisher(name, 10);
+   FeedStatsReader reader;
+   if (!publisher.start() || !reader.attach(name))
+      return false;
+
+   FeedErrorStats::instance()->corruptMessage();
+   FeedStatsSnapshot snapshot;
+   for (uint32_t attempt = 0; attempt < 100; ++attempt)
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      if (reader.read(snapshot) && snapshot.totals_[eFE_CorruptMessage] > after.counters_[eFE_CorruptMessage])
+         break;
+   }
+   publisher.stop();
+
+   FeedErrorTotals current;
+   FeedErrorStats::totals(current);
+   for (uint32_t counter = 0; counter < eFE_Count; ++counter)
+   {
+      if (snapshot.totals_[counter] != current.counters_[counter])
+         return false;
+   }
+   return snapshot.publish_count_ != 0 && FeedStatsReader().attach(name) == false;
+}
+
+bool testTopOfBook()
+{
+   std::string name = "/zeus_test_tob_" + std::to_string(getpid());
+   TopOfBookPublisher publisher(name, 16);
+   TopOfBookReader reader;
+   if (!publisher.start() || !reader.attach(name))
+      return false;
+
+   MarketDataHandler<uint32_t, OrderLevelEntry> feed;
+   feed.setTopOfBook(&publisher);
+   const char *messages[] = {"A,IBM,1,B,10,50.00\n", "A,IBM,2,S,7,50.10\n", "A,IBM,3,B,5,50.00\n",
+                             "A,IBM,4,S,4,49.90\n", "T,IBM,4,49.90\n", "A,MSFT,5,S,3,20.00\n"};
+   for (uint32_t i = 0; i < 6; ++i)
+   {
+      feed.processMessage(messages[i]);
+   }
+   feed.shutdown();
+
+   TopOfBookQuote ibm;
+   TopOfBookQuote msft;
+   const TopOfBookRecord *ibm_record = reader.find("IBM");
+   const TopOfBookRecord *msft_record = reader.find("MSFT");
+   if (ibm_record == 0 || msft_record == 0 || !ibm_record->read(ibm) || !msft_record->read(msft))
+      return false;
+   if (ibm.bid_price_ != 5000 || ibm.bid_quantity_ != 11 || ibm.ask_price_ != 5010 || ibm.ask_quantity_ != 7 ||
+       ibm.last_trade_price_ != 4990 || ibm.last_trade_quantity_ != 4)
+      return false;
+   if (msft.bid_price_ != 0 || msft.ask_price_ != 2000 || msft.ask_quantity_ != 3 || reader.find("AAPL") != 0)
+      return false;
+
+   // Writer-to-reader visibility: the writer stamps update_tsc_ and the
+   // reader measures how long the new sequence took to show up.
+   const TscClock &clock = TscClock::instance();
+   TopOfBookRecord *record = publisher.bind(15, "BENCH");
+   const TopOfBookRecord *view = reader.record(15);
+   const uint32_t samples = 20000;
+   std::atomic<uint32_t> acknowledged(0);
+   PerfMetrics visibility("TopOfBook: writer to reader visibility");
+   PerfMetrics read_cost("TopOfBook: uncontended seqlock read");
+
+   std::thread writer([&]() {
+      for (uint32_t i = 1; i <= samples; ++i)
+      {
+         TopOfBookQuote &quote = record->beginWrite();
+         quote.bid_price_ = i;
+         quote.update_tsc_ = clock.start();
+         record->endWrite();
+         while (acknowledged.load(std::memory_order_acquire) != i)
+            std::this_thread::yield();
+      }
+   });
+
+   bool consistent = true;
+   TopOfBookQuote quote;
+   for (uint32_t i = 1; i <= samples; ++i)
+   {
+      while (!view->read(quote) || quote.bid_price_ != i)
+         cpuRelax();
+      visibility.add(clock.toNanos(clock.stop() - quote.update_tsc_));
+      consistent = consistent && quote.bid_price_ == i;
+      acknowledged.store(i, std::memory_order_release);
+   }
+   writer.join();
+
+   for (uint32_t i = 0; i < samples; ++i)
+   {
+      uint64_t start = clock.start();
+      view->read(quote);
+      read_cost.add(clock.toNanos(clock.stop() - start));
+   }
+   visibility.print();
+   read_cost.print();
+
+   publisher.stop();
+   return consistent && !TopOfBookReader().attach(name);
+}
+
+template <typename BOOK>
+bool sameDepth(BOOK *lhs, BOOK *rhs)
+{
+   if (lhs == 0 || rhs == 0 || lhs->sellDepth().levelCount() != rhs->sellDepth().levelCount() ||
+       lhs->buyDepth().levelCount() != rhs->buyDepth().levelCount())
+      return false;
+   for (uint32_t i = 0; i < lhs->sellDepth().levelCount(); ++i)
+   {
+      if (lhs->sellDepth().level(i).price_ != rhs->sellDepth().level(i).price_ ||
+          lhs->sellDepth().level(i).quantity_ != rhs->sellDepth().level(i).quantity_)
+         return false;
+   }
+   for (uint32_t i = 0; i < lhs->buyDepth().levelCount(); ++i)
+   {
+      if (lhs->buyDepth().level(i).price_ != rhs->buyDepth().level(i).price_ ||
+          lhs->buyDepth().level(i).quantity_ != rhs->buyDepth().level(i).quantity_)
+         return false;
+   }
+   return true;
+}
+
+bool testBatchProcessing()
+{
+   typedef MarketDataHandler<uint32_t, OrderLevelEntry> Handler;
+   const uint32_t symbols = 8;
+   const uint32_t count = 1000000;
+   std::vector<std::string> messages;
+   buildSymbolFeed(messages, symbols, count);
+
+   Parser parser;
+   std::vector<MessageFields> fields(count);
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      parser.splitFields(messages[i].c_str(), messages[i].size(), fields[i]);
+   }
+
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+   Handler single(ORDERPOOLSIZE, options);
+   Handler batched(ORDERPOOLSIZE, options);
+   Handler conflated(ORDERPOOLSIZE, options);
+   conflated.setConflation(true);
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      single.processMessage(fields[i]);
+   }
+   std::chrono::duration<double> single_seconds = std::chrono::steady_clock::now() - start;
+
+   start = std::chrono::steady_clock::now();
+   batched.processBatch(&fields[0], count);
+   std::chrono::duration<double> batched_seconds = std::chrono::steady_clock::now() - start;
+
+   start = std::chrono::steady_clock::now();
+   conflated.processBatch(&fields[0], count);
+   std::chrono::duration<double> conflated_seconds = std::chrono::steady_clock::now() - start;
+
+   fprintf(stderr, "Per message:       %10.0f messages/sec\n", count / single_seconds.count());
+   fprintf(stderr, "Batched:           %10.0f messages/sec\n", count / batched_seconds.count());
+   fprintf(stderr, "Batched conflated: %10.0f messages/sec\n", count / conflated_seconds.count());
+
+   single.printCurrentOrderBook();
+   batched.printCurrentOrderBook();
+   conflated.printCurrentOrderBook();
+   for (uint32_t symbol = 1; symbol <= symbols; ++symbol)
+   {
+      Handler::BookType *book = single.findBook(symbol);
+      if (!sameDepth(book, batched.findBook(symbol)) || !sameDepth(book, conflated.findBook(symbol)))
+         return false;
+      if (book->lastSequence() != batched.findBook(symbol)->lastSequence() ||
+          conflated.findBook(symbol)->lastSequence() >= book->lastSequence())
+         return false;
+   }
+   return true;
+}
+
+bool testOutputConflation()
+{
+   typedef MarketDataHandler<uint32_t, OrderLevelEntry> Handler;
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+
+   ConflationOptions on_change;
+   on_change.enabled_ = true;
+   {
+      Handler feed(ORDERPOOLSIZE, options);
+      feed.setOutputConflation(on_change);
+      const char *messages[] = {"A,1,B,10,50.00\n", "A,2,B,10,49.00\n", "A,3,S,10,51.00\n",
+                                "X,2,B,10,49.00\n", "M,1,B,5,50.00\n", "X,3,S,10,51.00\n"};
+      uint64_t expected[] = {1, 1, 2, 2, 2, 3};
+      for (uint32_t i = 0; i < 6; ++i)
+      {
+         feed.processMessage(messages[i]);
+         if (feed.findBook(0)->lastSequence() != expected[i])
+            return false;
+      }
+      feed.shutdown();
+   }
+
+   // After the first print, same-price trades aggregate until the price
+   // changes or the window of 100 messages fills; shutdown flushes the rest.
+   ConflationOptions windowed = on_change;
+   windowed.window_messages_ = 100;
+   {
+      Handler feed(ORDERPOOLSIZE, options);
+      feed.setOutputConflation(windowed);
+      const char *messages[] = {"A,1,B,100,50.00\n", "A,2,S,100,50.00\n", "A,3,S,100,49.00\n",
+                                "T,10,50.00\n", "T,10,50.00\n", "T,10,49.00\n"};
+      for (uint32_t i = 0; i < 6; ++i)
+      {
+         feed.processMessage(messages[i]);
+      }
+      if (feed.findBook(0)->lastSequence() != 3)
+         return false;
+      feed.shutdown();
+      if (feed.findBook(0)->lastSequence() != 5)
+         return false;
+   }
+
+   const uint32_t count = 1000000;
+   std::vector<std::string> messages;
+   buildSymbolFeed(messages, 1, count);
+   ConflationOptions modes[3];
+   modes[1] = on_change;
+   modes[2] = windowed;
+   const char *names[] = {"Unconflated", "BBO change", "BBO change, 100 msgs"};
+   for (uint32_t m = 0; m < 3; ++m)
+   {
+      Handler feed(ORDERPOOLSIZE, options);
+      feed.setOutputConflation(modes[m]);
+      double seconds = replaySymbolFeed(feed, messages);
+      fprintf(stderr, "%-22s %10.0f messages/sec %10lu events\n", names[m], count / seconds,
+              feed.findBook(1)->lastSequence());
+   }
+   return true;
+}
+
+bool testLevelRetention()
+{
+   typedef MapPriceLevels<OrderLevelEntry> Levels;
+   OrderLevelEntry orders[4];
+   unsigned long long prices[] = {100, 101, 102, 103};
+   Levels levels(2);
+   for (uint32_t i = 0; i < 4; ++i)
+   {
+      orders[i].order_id_ = i;
+      orders[i].order_qty_ = 10;
+      orders[i].order_price_ = prices[i];
+      levels.addLevel(prices[i]).addNode(&orders[i]);
+   }
+   uint32_t nodes = levels.pool().inUse();
+   if (nodes != 4 || levels.levelCount() != 4)
+      return false;
+
+   // Emptied levels at the ends stay in the map but are skipped.
+   levels.findLevel(100)->removeNode(&orders[0]);
+   levels.removeLevel(100);
+   levels.findLevel(103)->removeNode(&orders[3]);
+   levels.removeLevel(103);
+   if (levels.findLevel(100) != 0 || levels.lowestPrice() != 101 || levels.highestPrice() != 102 ||
+       levels.retainedCount() != 2 || levels.pool().inUse() != nodes)
+      return false;
+   uint32_t visited = 0;
+   levels.visitFromLowest([&](unsigned long long, Levels::Level &) { return ++visited != 0; });
+   if (visited != 2)
+      return false;
+
+   // A re-add revives the retained level; a third emptied level pushes the
+   // oldest retained one back to the pool.
+   levels.addLevel(100).addNode(&orders[0]);
+   if (levels.lowestPrice() != 100 || levels.retainedCount() != 1 || levels.pool().inUse() != nodes)
+      return false;
+   levels.findLevel(101)->removeNode(&orders[1]);
+   levels.removeLevel(101);
+   levels.findLevel(102)->removeNode(&orders[2]);
+   levels.removeLevel(102);
+   if (levels.retainedCount() != 2 || levels.pool().inUse() != nodes - 1 || levels.levelCount() != 1)
+      return false;
+
+   levels.setRetention(0);
+   if (levels.retainedCount() != 0 || levels.pool().inUse() != 1)
+      return false;
+   levels.clear();
+   if (!levels.empty())
+      return false;
+
+   // Orders oscillating over a few ticks around the touch.
+   const uint32_t count = 10000000;
+   uint32_t retentions[] = {0, LEVELRETAINCOUNT};
+   for (uint32_t r = 0; r < 2; ++r)
+   {
+      Levels churn(retentions[r]);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < count; ++i)
+      {
+         OrderLevelEntry &order = orders[i & 3];
+         order.order_price_ = 1000 + (i * 7) % 5;
+         churn.addLevel(order.order_price_).addNode(&order);
+         churn.findLevel(order.order_price_)->removeNode(&order);
+         churn.removeLevel(order.order_price_);
+      }
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+      fprintf(stderr, "Retention %3u: %8.1f ns per add/remove, %u level nodes\n", retentions[r],
+              elapsed.count() / count, churn.pool().capacity());
+   }
+   return true;
+}
+
+template <typename BOOK>
+bool sameTopOfBook(BOOK &book, unsigned long long bid, uint32_t bid_qty, unsigned long long ask, uint32_t ask_qty)
+{
+   BestBidOffer bbo = book.topOfBook();
+   if (bbo.bid_price_ != bid || bbo.bid_quantity_ != bid_qty || bbo.ask_price_ != ask || bbo.ask_quantity_ != ask_qty)
+      return false;
+   if (bid == 0 || ask == 0)
+      return book.spread() == 0 && book.midpoint() == 0;
+   return book.spread() == (long long)(ask - bid) && book.midpoint() == (bid + ask) / 2;
+}
+
+bool testBestBidOffer()
+{
+   typedef Book<uint32_t, OrderLevelEntry, PriceLadder<OrderLevelEntry> > LadderBook;
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+   Logger logger(options);
+   OrderPool<OrderLevelEntry> pool(16);
+   {
+      LadderBook book(pool, logger);
+      if (!sameTopOfBook(book, 0, 0, 0, 0))
+         return false;
+
+      struct
+      {
+         uint32_t id_;
+         Side side_;
+         uint32_t qty_;
+         unsigned long long price_;
+      } adds[] = {{1, eS_Buy, 10, 1000}, {2, eS_Buy, 5, 1002}, {3, eS_Sell, 7, 1010}, {4, eS_Sell, 3, 1010}};
+      for (uint32_t i = 0; i < 4; ++i)
+      {
+         OrderLevelEntry *ole = pool.acquire();
+         ole->order_id_ = adds[i].id_;
+         ole->order_side_ = adds[i].side_;
+         ole->order_qty_ = adds[i].qty_;
+         ole->order_price_ = adds[i].price_;
+         book.addOrder(ole);
+      }
+      if (!sameTopOfBook(book, 1002, 5, 1010, 10))
+         return false;
+
+      // Far enough from the ladder's window to recentre it, moving every
+      // level the cache points at.
+      OrderLevelEntry *far = pool.acquire();
+      far->order_id_ = 5;
+      far->order_side_ = eS_Sell;
+      far->order_qty_ = 1;
+      far->order_price_ = 1000 + LADDERTICKS * 4;
+      book.addOrder(far);
+      if (!sameTopOfBook(book, 1002, 5, 1010, 10))
+         return false;
+
+      OrderLevelEntry change;
+      change.order_id_ = 3;
+      change.order_side_ = eS_Sell;
+      change.order_qty_ = 2;
+      change.order_price_ = 1010;
+      book.modifyOrder(change);
+      if (!sameTopOfBook(book, 1002, 5, 1010, 5))
+         return false;
+
+      // A crossing buy and the trade that follows it.
+      OrderLevelEntry *cross = pool.acquire();
+      cross->order_id_ = 6;
+      cross->order_side_ = eS_Buy;
+      cross->order_qty_ = 5;
+      cross->order_price_ = 1010;
+      book.addOrder(cross);
+      if (!sameTopOfBook(book, 1010, 5, 1010, 5))
+         return false;
+
+      TradeMessage trade;
+      trade.trade_qty_ = 5;
+      trade.trade_price_ = 1010;
+      book.handleTrade(trade);
+      if (!sameTopOfBook(book, 1002, 5, 1000 + LADDERTICKS * 4, 1))
+         return false;
+
+      change.order_id_ = 1;
+      change.order_side_ = eS_Buy;
+      change.order_qty_ = 10;
+      change.order_price_ = 1003;
+      book.modifyOrder(change);
+      if (!sameTopOfBook(book, 1003, 10, 1000 + LADDERTICKS * 4, 1))
+         return false;
+
+      book.removeOrder(*far);
+      if (!sameTopOfBook(book, 1003, 10, 0, 0))
+         return false;
+   }
+
+   const uint32_t count = 10000000;
+   LadderBook book(pool, logger);
+   OrderLevelEntry *bid = pool.acquire();
+   bid->order_id_ = 1;
+   bid->order_side_ = eS_Buy;
+   bid->order_qty_ = 10;
+   bid->order_price_ = 1000;
+   book.addOrder(bid);
+   unsigned long long sum = 0;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      sum += book.midpoint() + book.spread() + book.topOfBook().bid_quantity_;
+   }
+   std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+   fprintf(stderr, "%10.2f ns per top-of-book query (%llu)\n", elapsed.count() / count, sum);
+   return true;
+}
+
+bool testThreadPlacement()
+{
+   bool pinned = false;
+   bool restored = false;
+   std::thread thread([&]() {
+      if (!pinThread(0, "test"))
+         return;
+      pinned = sched_getcpu() == 0;
+
+      int before = -1;
+      int after = -2;
+      unsigned long mask = 0;
+      syscall(SYS_get_mempolicy, &before, &mask, sizeof(mask) * 8 + 1, 0, 0);
+      {
+         ScopedMemoryNode node(cpuNode(0));
+      }
+      syscall(SYS_get_mempolicy, &after, &mask, sizeof(mask) * 8 + 1, 0, 0);
+      restored = before == after && (cpuNode(0) < 0 || before == MPOL_PREFERRED);
+   });
+   thread.join();
+   if (!pinned || !restored)
+      return false;
+
+   // First touch of fresh pages against pages the kernel populated up front,
+   // which is what mlockall(MCL_FUTURE) does for every later allocation.
+   const size_t size = 64 << 20;
+   const size_t page = sysconf(_SC_PAGESIZE);
+   int flags[] = {MAP_PRIVATE | MAP_ANONYMOUS, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE};
+   const char *names[] = {"Faulted on touch", "Prefaulted"};
+   for (uint32_t f = 0; f < 2; ++f)
+   {
+      char *memory = (char *)mmap(0, size, PROT_READ | PROT_WRITE, flags[f], -1, 0);
+      if (memory == MAP_FAILED)
+         return false;
+      const TscClock &clock = TscClock::instance();
+      uint64_t worst = 0;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t offset = 0; offset < size; offset += page)
+      {
+         uint64_t begin = clock.start();
+         memory[offset] = 1;
+         uint64_t cycles = clock.stop() - begin;
+         if (cycles > worst)
+            worst = cycles;
+      }
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+      fprintf(stderr, "%-18s %8.1f ns per page, worst %8lu ns\n", names[f], elapsed.count() / (size / page),
+              clock.toNanos(worst));
+      munmap(memory, size);
+   }
+   return true;
+}
+
+bool testBinaryFeed()
+{
+   typedef MarketDataHandler<uint32_t, OrderLevelEntry> Handler;
+   const uint32_t symbols = 8;
+   const uint32_t count = 1000000;
+   std::vector<std::string> messages;
+   buildSymbolFeed(messages, symbols, count);
+   messages.push_back("A,S1,5000000,B,0,10.00\n");
+   messages.push_back("M,S2,abc,S,10,10.00\n");
+   messages.push_back("Q,S3,1,B,10,10.00\n");
+
+   FILE *file = tmpfile();
+   if (file == NULL)
+      return false;
+   FeedErrorTotals before;
+   FeedErrorStats::totals(before);
+   FeedEncoder encoder(file);
+   if (!encoder.begin())
+      return false;
+   for (uint32_t i = 0; i < messages.size(); ++i)
+   {
+      if (!encoder.encode(messages[i].c_str(), messages[i].size()))
+         return false;
+   }
+   if (!encoder.finish())
+      return false;
+   FeedErrorTotals after;
+   FeedErrorStats::totals(after);
+
+   MappedFile mapped;
+   bool mapped_ok = mapped.map(fileno(file));
+   fclose(file);
+   const FeedFileHeader *header = mapped_ok ? feedFileHeader(mapped.data(), mapped.size()) : 0;
+   if (header == 0 || header->messages_ != messages.size() || header->records_ != count + symbols ||
+       header->good_ != count || header->invalid_quantity_ != 1 || header->invalid_id_ != 1 ||
+       header->corrupt_ != after.counters_[eFE_CorruptMessage] - before.counters_[eFE_CorruptMessage] ||
+       header->corrupt_ == 0)
+      return false;
+
+   Parser parser;
+   std::vector<MessageFields> fields(messages.size());
+   for (uint32_t i = 0; i < messages.size(); ++i)
+   {
+      parser.splitFields(messages[i].c_str(), messages[i].size(), fields[i]);
+   }
+
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+   Handler text(ORDERPOOLSIZE, options);
+   Handler binary(ORDERPOOLSIZE, options);
+   Handler batched(ORDERPOOLSIZE, options);
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < fields.size(); ++i)
+   {
+      text.processMessage(fields[i]);
+   }
+   std::chrono::duration<double> text_seconds = std::chrono::steady_clock::now() - start;
+
+   const FeedRecord *records = feedRecords(header);
+   start = std::chrono::steady_clock::now();
+   for (uint64_t i = 0; i < header->records_; ++i)
+   {
+      binary.processRecord(records[i]);
+   }
+   std::chrono::duration<double> binary_seconds = std::chrono::steady_clock::now() - start;
+
+   start = std::chrono::steady_clock::now();
+   batched.processRecords(records, header->records_);
+   std::chrono::duration<double> batched_seconds = std::chrono::steady_clock::now() - start;
+
+   fprintf(stderr, "Text, pre-split:   %10.0f messages/sec\n", count / text_seconds.count());
+   fprintf(stderr, "Binary records:    %10.0f messages/sec\n", count / binary_seconds.count());
+   fprintf(stderr, "Binary batched:    %10.0f messages/sec\n", count / batched_seconds.count());
+
+   text.printCurrentOrderBook();
+   binary.printCurrentOrderBook();
+   batched.printCurrentOrderBook();
+   for (uint32_t symbol = 1; symbol <= symbols; ++symbol)
+   {
+      Handler::BookType *book = text.findBook(symbol);
+      if (!sameDepth(book, binary.findBook(symbol)) || !sameDepth(book, batched.findBook(symbol)))
+         return false;
+      if (book->lastSequence() != binary.findBook(symbol)->lastSequence() ||
+          book->lastSequence() != batched.findBook(symbol)->lastSequence())
+         return false;
+      if (strcmp(text.symbols().find(symbol)->name_, binary.symbols().find(symbol)->name_) != 0)
+         return false;
+   }
+
+   // Every symbol ID fits a record's 16 bits without reaching 0xFFFF; a
+   // full directory rejects new symbols instead.
+   SymbolDirectory directory;
+   uint32_t last = 0;
+   for (uint32_t i = 1; i <= SYMBOLSMAX; ++i)
+   {
+      char name[SYMBOLLENMAX + 1];
+      sprintf(name, "Z%u", i);
+      last = directory.intern(name, strlen(name));
+   }
+   return last == SYMBOLSMAX && last < 0xFFFF && directory.intern("FULL", 4) == INVALIDSYMBOL;
+}
+
+// Output sink for a Book that keeps the last midpoint and fill and counts
+// trades instead of logging.
+struct CaptureSink
+{
+   CaptureSink() : type_(0), midquotes_(0), bid_(0), ask_(0), fills_(0), fill_(), trades_(0) {}
+
+   void setEventFormatter(EventFormatter) {}
+
+   char *claim(uint32_t type, uint32_t len)
+   {
+      type_ = type;
+      return len <= sizeof(event_) ? event_ : 0;
+   }
+
+   void publish()
+   {
+      if (type_ == eOE_Midquote)
+      {
+         const MidquoteEvent *event = (const MidquoteEvent *)event_;
+         ++midquotes_;
+         bid_ = event->bid_price_;
+         ask_ = event->ask_price_;
+      }
+      else if (type_ == eOE_Fill)
+      {
+         ++fills_;
+         memcpy(&fill_, event_, sizeof(fill_));
+      }
+      else if (type_ == eOE_Trade)
+      {
+         ++trades_;
+      }
+   }
+
+   char event_[256];
+   uint32_t type_;
+   uint32_t midquotes_;
+   uint64_t bid_;
+   uint64_t ask_;
+   uint32_t fills_;
+   FillEvent fill_;
+   uint32_t trades_;
+};
+
+bool testBookPolicies()
+{
+   typedef Book<uint32_t, OrderLevelEntry, PriceLadder<OrderLevelEntry, uint32_t>,
+                DirectOrderIndex<uint32_t, OrderLevelEntry>, CaptureSink>
+       NarrowBook;
+   if (sizeof(NarrowBook::Price) != sizeof(uint32_t))
+      return false;
+
+   CaptureSink sink;
+   OrderPool<OrderLevelEntry> pool(16);
+   {
+      NarrowBook book(pool, sink);
+      struct
+      {
+         uint32_t id_;
+         Side side_;
+         uint32_t qty_;
+         unsigned long long price_;
+      } adds[] = {{1, eS_Buy, 10, 990}, {2, eS_Sell, 4, 1010}, {3, eS_Buy, 6, 995}, {4, eS_Sell, 2, 1005}};
+      for (uint32_t i = 0; i < 4; ++i)
+      {
+         OrderLevelEntry *ole = pool.acquire();
+         ole->order_id_ = adds[i].id_;
+         ole->order_side_ = adds[i].side_;
+         ole->order_qty_ = adds[i].qty_;
+         ole->order_price_ = adds[i].price_;
+         book.addOrder(ole);
+      }
+      book.printMidpoint();
+      if (sink.midquotes_ != 1 || sink.bid_ != 995 || sink.ask_ != 1005 || book.midpoint() != 1000)
+         return false;
+
+      OrderLevelEntry cancel;
+      cancel.order_id_ = 4;
+      cancel.order_side_ = eS_Sell;
+      cancel.order_qty_ = 2;
+      cancel.order_price_ = 1005;
+      book.removeOrder(cancel);
+      cancel.order_id_ = 3;
+      cancel.order_side_ = eS_Buy;
+      cancel.order_qty_ = 6;
+      cancel.order_price_ = 995;
+      book.removeOrder(cancel);
+      book.printMidpoint();
+      if (sink.midquotes_ != 2 || sink.bid_ != 990 || sink.ask_ != 1010 || book.spread() != 20)
+         return false;
+   }
+
+   // Add/cancel round trips, resting behind a standing level on each side.
+   const uint32_t count = 10000000;
+   NarrowBook book(pool, sink);
+   OrderLevelEntry *bid = pool.acquire();
+   bid->order_id_ = 1;
+   bid->order_side_ = eS_Buy;
+   bid->order_qty_ = 10;
+   bid->order_price_ = 1000;
+   book.addOrder(bid);
+   OrderLevelEntry cancel;
+   cancel.order_id_ = 2;
+   cancel.order_qty_ = 1;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      OrderLevelEntry *ole = pool.acquire();
+      ole->order_id_ = 2;
+      ole->order_side_ = (i & 1) ? eS_Sell : eS_Buy;
+      ole->order_qty_ = 1;
+      ole->order_price_ = (i & 1) ? 1001 + (i & 7) : 999 - (i & 7);
+      book.addOrder(ole);
+      cancel.order_side_ = ole->order_side_;
+      cancel.order_price_ = ole->order_price_;
+      book.removeOrder(cancel);
+   }
+   std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+   fprintf(stderr, "%10.2f ns per add/cancel\n", elapsed.count() / count);
+   return true;
+}
+
+bool sameFill(const CaptureSink &sink, uint32_t fills, uint32_t aggressor, uint32_t resting, uint32_t quantity,
+              uint64_t price)
+{
+   return sink.fills_ == fills && sink.fill_.aggressor_id_ == aggressor && sink.fill_.resting_id_ == resting &&
+          sink.fill_.quantity_ == quantity && sink.fill_.price_ == price;
+}
+
+bool testMatching()
+{
+   typedef Book<uint32_t, OrderLevelEntry, MapPriceLevels<OrderLevelEntry>, HashOrderIndex<uint32_t, OrderLevelEntry>,
+                CaptureSink>
+       MatchingBook;
+   CaptureSink sink;
+   OrderPool<OrderLevelEntry> pool(64);
+   {
+      MatchingBook book(pool, sink);
+      book.setMatching(true);
+      struct
+      {
+         uint32_t id_;
+         Side side_;
+         uint32_t qty_;
+         unsigned long long price_;
+      } adds[] = {{1, eS_Sell, 10, 1000}, {2, eS_Sell, 5, 1000}, {3, eS_Sell, 7, 1001}, {4, eS_Buy, 20, 1001}};
+      for (uint32_t i = 0; i < 4; ++i)
+      {
+         OrderLevelEntry *ole = pool.acquire();
+         ole->order_id_ = adds[i].id_;
+         ole->order_side_ = adds[i].side_;
+         ole->order_qty_ = adds[i].qty_;
+         ole->order_price_ = adds[i].price_;
+         book.addOrder(ole);
+      }
+      // 10 and 5 at 1000 oldest first, then 5 of the 7 at 1001; nothing rests.
+      if (!sameFill(sink, 3, 4, 3, 5, 1001) || sink.trades_ != 2 || !sameTopOfBook(book, 0, 0, 1001, 2))
+         return false;
+
+      OrderLevelEntry *sell = pool.acquire();
+      sell->order_id_ = 5;
+      sell->order_side_ = eS_Sell;
+      sell->order_qty_ = 3;
+      sell->order_price_ = 999;
+      book.addOrder(sell);
+      OrderLevelEntry *buy = pool.acquire();
+      buy->order_id_ = 6;
+      buy->order_side_ = eS_Buy;
+      buy->order_qty_ = 5;
+      buy->order_price_ = 999;
+      book.addOrder(buy);
+      if (!sameFill(sink, 4, 6, 5, 3, 999) || !sameTopOfBook(book, 999, 2, 1001, 2))
+         return false;
+
+      // Repricing the bid through the ask trades it as well.
+      OrderLevelEntry change;
+      change.order_id_ = 6;
+      change.order_side_ = eS_Buy;
+      change.order_qty_ = 2;
+      change.order_price_ = 1001;
+      book.modifyOrder(change);
+      if (!sameFill(sink, 5, 6, 3, 2, 1001) || !sameTopOfBook(book, 0, 0, 0, 0) ||
+          pool.inUse() != 0)
+         return false;
+   }
+
+   // Aggressive flow: each round rests LEVELS sell orders of 10 at
+   // consecutive prices, then one buy of 10 * LEVELS sweeps all of them.
+   const uint32_t rounds = 1000000;
+   const uint32_t levels = 4;
+   MatchingBook book(pool, sink);
+   book.setMatching(true);
+   uint32_t fills = sink.fills_;
+   uint32_t id = 0;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t round = 0; round < rounds; ++round)
+   {
+      for (uint32_t level = 0; level < levels; ++level)
+      {
+         OrderLevelEntry *ole = pool.acquire();
+         ole->order_id_ = ++id;
+         ole->order_side_ = eS_Sell;
+         ole->order_qty_ = 10;
+         ole->order_price_ = 1000 + level;
+         book.addOrder(ole);
+      }
+      OrderLevelEntry *ole = pool.acquire();
+      ole->order_id_ = ++id;
+      ole->order_side_ = eS_Buy;
+      ole->order_qty_ = 10 * levels;
+      ole->order_price_ = 1000 + levels;
+      book.addOrder(ole);
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   fills = sink.fills_ - fills;
+   fprintf(stderr, "%10.0f matches/sec, %10.0f aggressive orders/sec\n", fills / elapsed.count(),
+           rounds / elapsed.count());
+   return fills == rounds * levels && pool.inUse() == 0;
+}
+
+OrderLevelEntry *addAttributed(Book<uint32_t, OrderLevelEntry, MapPriceLevels<OrderLevelEntry>,
+                                    HashOrderIndex<uint32_t, OrderLevelEntry>, CaptureSink> &book,
+                               OrderPool<OrderLevelEntry> &pool, uint32_t id, Side side, uint32_t qty,
+                               unsigned long long price, uint8_t flags, uint32_t display = 0)
+{
+   OrderLevelEntry *ole = pool.acquire();
+   ole->order_id_ = id;
+   ole->order_side_ = side;
+   ole->order_qty_ = qty;
+   ole->order_price_ = price;
+   ole->order_flags_ = flags;
+   ole->order_display_qty_ = display;
+   ole->order_hidden_qty_ = 0;
+   book.addOrder(ole);
+   return ole;
+}
+
+bool testOrderAttributes()
+{
+   Parser parser;
+   OrderLevelEntry ole;
+   const char *good[] = {"A,1,B,10,10.00,I\n", "A,AAPL,2,S,100,10.00,H20\n", "A,3,B,10,10.00,PH5\n", "A,4,B,10,10.00\n"};
+   uint8_t flags[] = {eOF_ImmediateOrCancel, eOF_Iceberg, eOF_PostOnly | eOF_Iceberg, 0};
+   for (uint32_t i = 0; i < 4; ++i)
+   {
+      MessageFields fields;
+      parser.splitFields(good[i], strlen(good[i]), fields);
+      parser.parseOrder(fields, ole);
+      if (ole.order_side_ == eS_Unknown || ole.order_flags_ != flags[i] || parser.getMessageType(fields) != eMT_Add)
+         return false;
+      if (i == 1 && (ole.order_display_qty_ != 20 || ole.order_qty_ != 100 || !parser.hasSymbol(fields)))
+         return false;
+   }
+   const char *bad[] = {"A,5,B,10,10.00,IF\n", "A,6,B,10,10.00,H0\n", "A,7,B,10,10.00,PI\n", "A,8,B,10,10.00,Q\n"};
+   for (uint32_t i = 0; i < 4; ++i)
+   {
+      parser.parseOrder(bad[i], strlen(bad[i]), ole);
+      if (ole.order_side_ != eS_Unknown)
+         return false;
+   }
+
+   typedef Book<uint32_t, OrderLevelEntry, MapPriceLevels<OrderLevelEntry>, HashOrderIndex<uint32_t, OrderLevelEntry>,
+                CaptureSink>
+       MatchingBook;
+   CaptureSink sink;
+   OrderPool<OrderLevelEntry> pool(64);
+   FeedErrorStats *stats = FeedErrorStats::instance();
+   uint64_t killed = stats->count(eFE_OrderKilled);
+   uint64_t expired = stats->count(eFE_RemainderExpired);
+   {
+      MatchingBook book(pool, sink);
+      book.setMatching(true);
+      addAttributed(book, pool, 1, eS_Sell, 100, 1000, eOF_Iceberg, 20);
+      addAttributed(book, pool, 2, eS_Sell, 10, 1000, 0);
+      if (!sameTopOfBook(book, 0, 0, 1000, 30))
+         return false;
+
+      // The iceberg's shown 20 trades, then refills behind order 2.
+      addAttributed(book, pool, 3, eS_Buy, 30, 1000, eOF_ImmediateOrCancel);
+      if (!sameFill(sink, 2, 3, 2, 10, 1000) || !sameTopOfBook(book, 0, 0, 1000, 20))
+         return false;
+
+      // 80 is left, shown and hidden: a FOK for 100 is killed untouched.
+      addAttributed(book, pool, 4, eS_Buy, 100, 1000, eOF_FillOrKill);
+      if (sink.fills_ != 2 || stats->count(eFE_OrderKilled) != killed + 1 || !sameTopOfBook(book, 0, 0, 1000, 20))
+         return false;
+      addAttributed(book, pool, 5, eS_Buy, 80, 1000, eOF_FillOrKill);
+      if (!sameFill(sink, 6, 5, 1, 20, 1000) || !sameTopOfBook(book, 0, 0, 0, 0))
+         return false;
+
+      addAttributed(book, pool, 6, eS_Buy, 5, 1000, eOF_PostOnly);
+      addAttributed(book, pool, 7, eS_Sell, 5, 1000, eOF_PostOnly);
+      if (sink.fills_ != 6 || stats->count(eFE_OrderKilled) != killed + 2 || !sameTopOfBook(book, 1000, 5, 0, 0))
+         return false;
+      addAttributed(book, pool, 8, eS_Sell, 8, 1000, eOF_ImmediateOrCancel);
+      if (!sameFill(sink, 7, 8, 6, 5, 1000) || stats->count(eFE_RemainderExpired) != expired + 1 ||
+          !sameTopOfBook(book, 0, 0, 0, 0) || pool.inUse() != 0)
+         return false;
+
+      // An iceberg remainder rests with only its display quantity shown.
+      addAttributed(book, pool, 9, eS_Sell, 4, 1000, 0);
+      addAttributed(book, pool, 10, eS_Buy, 50, 1000, eOF_Iceberg, 10);
+      if (!sameTopOfBook(book, 1000, 10, 0, 0))
+         return false;
+
+      // Feed trades refill the iceberg from its reserve of 36 too, each
+      // fill of the shown 10 bringing up the next slice.
+      book.setMatching(false);
+      addAttributed(book, pool, 11, eS_Sell, 100, 1000, 0);
+      TradeMessage tm;
+      tm.trade_qty_ = 10;
+      tm.trade_price_ = 1000;
+      book.handleTrade(tm);
+      if (!sameTopOfBook(book, 1000, 10, 1000, 90))
+         return false;
+      for (uint32_t i = 0; i < 3; ++i)
+      {
+         book.handleTrade(tm);
+      }
+      if (!sameTopOfBook(book, 1000, 6, 1000, 60) || pool.inUse() != 2)
+         return false;
+   }
+   {
+      // A feed trade that reaches past the oldest order takes only what is
+      // left of it from the next: [21:2, 22:3 of 13, 23:5] traded 4 leaves
+      // the iceberg showing 1 of its 3, then 3 more refill it and take 2
+      // from order 23.
+      MatchingBook book(pool, sink);
+      book.setMatching(true);
+      addAttributed(book, pool, 21, eS_Buy, 2, 1000, 0);
+      addAttributed(book, pool, 22, eS_Buy, 13, 1000, eOF_Iceberg, 3);
+      addAttributed(book, pool, 23, eS_Buy, 5, 1000, 0);
+      book.setMatching(false);
+      addAttributed(book, pool, 24, eS_Sell, 100, 1000, 0);
+      TradeMessage tm;
+      tm.trade_qty_ = 4;
+      tm.trade_price_ = 1000;
+      book.handleTrade(tm);
+      std::vector<uint32_t> resting;
+      book.forEachOrder([&](const OrderLevelEntry &order) {
+         resting.push_back(order.order_id_);
+         resting.push_back(order.order_qty_);
+         resting.push_back(order.order_hidden_qty_);
+      });
+      uint32_t partial[] = {22, 1, 10, 23, 5, 0, 24, 96, 0};
+      if (resting != std::vector<uint32_t>(partial, partial + 9) || !sameTopOfBook(book, 1000, 6, 1000, 96))
+         return false;
+
+      tm.trade_qty_ = 3;
+      book.handleTrade(tm);
+      resting.clear();
+      book.forEachOrder([&](const OrderLevelEntry &order) {
+         resting.push_back(order.order_id_);
+         resting.push_back(order.order_qty_);
+         resting.push_back(order.order_hidden_qty_);
+      });
+      uint32_t refilled[] = {23, 3, 0, 22, 3, 7, 24, 93, 0};
+      if (resting != std::vector<uint32_t>(refilled, refilled + 9) || !sameTopOfBook(book, 1000, 6, 1000, 93))
+         return false;
+   }
+
+   // Killed FOKs against a deep book: the check reads the best level's
+   // totals and stops, however many levels the book holds.
+   const uint32_t levels = 10000;
+   const uint32_t count = 1000000;
+   MatchingBook book(pool, sink);
+   book.setMatching(true);
+   for (uint32_t level = 0; level < levels; ++level)
+   {
+      addAttributed(book, pool, level + 1, eS_Sell, 10, 1000 + level, 0);
+   }
+   killed = stats->count(eFE_OrderKilled);
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      addAttributed(book, pool, levels + 1 + i, eS_Buy, 11, 1000, eOF_FillOrKill);
+   }
+   std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+   fprintf(stderr, "%10.2f ns per killed FOK against %u levels\n", elapsed.count() / count, levels);
+   return stats->count(eFE_OrderKilled) == killed + count && sink.fills_ == 8;
+}
+
+// Books must match order for order, so time priority survived recovery.
+template <typename BOOK>
+bool sameOrders(BOOK *lhs, BOOK *rhs)
+{
+   if (lhs == 0 || rhs == 0)
+      return false;
+   std::vector<uint64_t> lhs_orders;
+   std::vector<uint64_t> rhs_orders;
+   lhs->forEachOrder([&](const OrderLevelEntry &order) {
+      lhs_orders.push_back(((uint64_t)order.order_id_ << 32) | order.order_qty_);
+   });
+   rhs->forEachOrder([&](const OrderLevelEntry &order) {
+      rhs_orders.push_back(((uint64_t)order.order_id_ << 32) | order.order_qty_);
+   });
+   return lhs_orders == rhs_orders;
+}
+
+bool testJournalRecovery()
+{
+   typedef MarketDataHandler<uint32_t, OrderLevelEntry> Handler;
+   const uint32_t symbols = 8;
+   const uint32_t count = 400000;
+   const uint32_t crash = count / 2 + 7;
+   const uint32_t interval = 50000;
+   std::vector<std::string> messages;
+   buildSymbolFeed(messages, symbols, count);
+
+   char directory[] = "/tmp/journalXXXXXX";
+   if (mkdtemp(directory) == 0)
+      return false;
+   std::string path = std::string(directory) + "/book";
+
+   LoggerOptions options;
+   options.output_mode_ = eLO_Binary;
+   options.binary_path_ = "/dev/null";
+   Handler reference(ORDERPOOLSIZE, options);
+   Handler recovered(ORDERPOOLSIZE, options);
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < crash; ++i)
+   {
+      reference.processMessage(messages[i].c_str(), messages[i].size());
+   }
+   std::chrono::duration<double> replay_seconds = std::chrono::steady_clock::now() - start;
+   {
+      Handler journaled(ORDERPOOLSIZE, options);
+      if (!journaled.enableJournal(path, interval))
+         return false;
+      start = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < crash; ++i)
+      {
+         journaled.processMessage(messages[i].c_str(), messages[i].size());
+      }
+      std::chrono::duration<double> journaled_seconds = std::chrono::steady_clock::now() - start;
+
+      // A duplicate add and a cancel for a missing ID leave the books alone
+      // and are not journaled.
+      journaled.processMessage("A,S1,1,S,10,102.01");
+      journaled.processMessage("X,S1,999999,B,10,95.00");
+      journaled.shutdown();
+      fprintf(stderr, "Unjournaled:       %10.0f messages/sec\n", crash / replay_seconds.count());
+      fprintf(stderr, "Journaled:         %10.0f messages/sec\n", crash / journaled_seconds.count());
+   }
+
+   FeedErrorStats *stats = FeedErrorStats::instance();
+   uint64_t duplicates = stats->count(eFE_DuplicateAdd);
+   uint64_t bad_cancels = stats->count(eFE_BadCancel);
+   start = std::chrono::steady_clock::now();
+   bool ok = recovered.recover(path);
+   std::chrono::duration<double> recovery_seconds = std::chrono::steady_clock::now() - start;
+   fprintf(stderr, "Recovery:          %10.3f ms vs %.3f ms to replay %u messages\n",
+           recovery_seconds.count() * 1000, replay_seconds.count() * 1000, crash);
+   ok = ok && recovered.messageCount() == crash && stats->count(eFE_DuplicateAdd) == duplicates &&
+        stats->count(eFE_BadCancel) == bad_cancels;
+   for (uint32_t symbol = 1; ok && symbol <= symbols; ++symbol)
+   {
+      ok = sameOrders(reference.findBook(symbol), recovered.findBook(symbol)) &&
+           strcmp(reference.symbols().find(symbol)->name_, recovered.symbols().find(symbol)->name_) == 0;
+   }
+
+   for (uint32_t i = crash; ok && i < count; ++i)
+   {
+      reference.processMessage(messages[i].c_str(), messages[i].size());
+      recovered.processMessage(messages[i].c_str(), messages[i].size());
+   }
+   reference.printCurrentOrderBook();
+   recovered.printCurrentOrderBook();
+   for (uint32_t symbol = 1; ok && symbol <= symbols; ++symbol)
+   {
+      ok = sameDepth(reference.findBook(symbol), recovered.findBook(symbol)) &&
+           sameOrders(reference.findBook(symbol), recovered.findBook(symbol));
+   }
+
+   unlink(journalPath(path).c_str());
+   unlink(snapshotPath(path).c_str());
+   rmdir(directory);
+   return ok;
+}
+
 void addTest(std::string name, TestFunction func)
 {
    test_functions_.push_back(TestFunctionPair(name, func));
@@ -158,6 +1895,31 @@ void initTests()
    addTest("DLList: add multiple && multi dtor", &testDLListAddMultiple);
    addTest("DLList: remove node", &testDLListRemoveNodes);
    addTest("Logger: test logger performance", &testLogger);
+   addTest("PriceLadder: recentre and best price tracking", &testPriceLadder);
+   addTest("OrderPool: acquire, release and slab growth", &testOrderPool);
+   addTest("FlatOrderIndex: insert, erase and lookup", &testFlatOrderIndex);
+   addTest("DirectOrderIndex: dense range and overflow", &testDirectOrderIndex);
+   addTest("Parser: field decoding and performance", &testParser);
+   addTest("StructuralIndex: SIMD field location vs per-line split", &testStructuralIndex);
+   addTest("SpscRing: ordering, wait strategies and drop policy", &testSpscRing);
+   addTest("OutputEvents: binary event text rendering", &testOutputEvents);
+   addTest("DepthSnapshot: incremental depth cache", &testDepthSnapshot);
+   addTest("ShardedMarketDataHandler: per-symbol routing and scaling", &testShardedHandler);
+   addTest("LatencyHistogram: percentiles, merge and intervals", &testLatencyHistogram);
+   addTest("TscClock: one-time calibration and cycle conversion", &testTscClock);
+   addTest("MessageTrace: pipeline stage trace and report", &testMessageTrace);
+   addTest("FeedErrorStats: per-thread counters and shared memory snapshots", &testFeedStats);
+   addTest("TopOfBook: shared memory seqlock quotes and visibility latency", &testTopOfBook);
+   addTest("MarketDataHandler: batched decode/apply and midpoint conflation", &testBatchProcessing);
+   addTest("Book: BBO-change and windowed output conflation", &testOutputConflation);
+   addTest("Book: cached best bid/ask and top-of-book queries", &testBestBidOffer);
+   addTest("MapPriceLevels: pooled level nodes and emptied level retention", &testLevelRetention);
+   addTest("ThreadPlacement: pinning, NUMA memory policy and prefaulting", &testThreadPlacement);
+   addTest("Book: compile-time sides with price, index and sink policies", &testBookPolicies);
+   addTest("BinaryFeed: encoder validation and zero-parse replay", &testBinaryFeed);
+   addTest("Book: matching mode price-time crossing and fills", &testMatching);
+   addTest("Book: IOC, FOK, post-only and iceberg orders", &testOrderAttributes);
+   addTest("Journal: group-committed journal, snapshots and recovery", &testJournalRecovery);
 }
 
 int main(int argc, char **argv)
@@ -178,9 +1940,9 @@ int main(int argc, char **argv)
       }
       std::cout << "x: Exit" << std::endl;
 
-      char input[2] = {'0', '0'};
+      std::string input("0");
       std::cin >> input;
-      int input_int = atoi(input);
+      int input_int = atoi(input.c_str());
 
       if (input[0] == 'x' || input[0] == 'X')
       {